@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <nanobench.h>
+
+namespace bench {
+	using clock_t = std::chrono::steady_clock;
+
+	// Every Bench that ran, main() renders them all as JSON with --json.
+	using Results = std::vector<ankerl::nanobench::Bench>;
+
+	inline uint64_t elapsed_ns(clock_t::time_point start, clock_t::time_point end) {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	}
+
+	// Nearest rank percentile, p in [0, 1]. Sorts the samples in place.
+	inline uint64_t percentile(std::vector<uint64_t>& samples, double p) {
+		if (samples.empty()) {
+			return 0;
+		}
+
+		std::sort(samples.begin(), samples.end());
+		const size_t rank = std::min(samples.size() - 1, (size_t)(p * (double)samples.size()));
+		return samples[rank];
+	}
+}
+
+// Each bench file provides one entry point which is run by main() and
+// appends its Bench objects to the results.
+void bench_packet(bench::Results& results);
+void bench_ring_buffer(bench::Results& results);
+void bench_client_manager(bench::Results& results);
+void bench_broadcast(bench::Results& results);
+void bench_job_system(bench::Results& results);
+#ifdef BS_BENCH_GAME_HOST
+void bench_game_host(bench::Results& results);
+
+// Checks the SIMD pong kernel still matches the scalar one before timing
+// them, false (and nothing timed) if it doesn't.
+bool bench_pong_sim(bench::Results& results);
+#endif
@@ -0,0 +1,58 @@
+#define ANKERL_NANOBENCH_IMPLEMENTATION
+#include "bench.h"
+
+#include <fmt/format.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string_view>
+
+// Pass --json <file> to also write every result as JSON, one nanobench
+// json() rendering per Bench, so runs can be diffed between commits.
+int main(int argc, char** argv) {
+	const char* json_path = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string_view(argv[i]) == "--json" && i + 1 < argc) {
+			json_path = argv[++i];
+		}
+		else {
+			fmt::print("usage: bs_bench [--json <file>]\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	// A check that failed fails the run, after the results are written.
+	bool passed = true;
+
+	bench::Results results;
+	bench_packet(results);
+	bench_ring_buffer(results);
+	bench_client_manager(results);
+	bench_broadcast(results);
+	bench_job_system(results);
+#ifdef BS_BENCH_GAME_HOST
+	bench_game_host(results);
+	passed &= bench_pong_sim(results);
+#endif
+
+	if (json_path) {
+		std::ofstream out(json_path);
+		if (!out) {
+			fmt::print("Failed to open {} for writing\n", json_path);
+			return EXIT_FAILURE;
+		}
+
+		out << "{\"benchmarks\": [\n";
+		for (size_t i = 0; i < results.size(); ++i) {
+			if (i > 0) {
+				out << ",\n";
+			}
+			ankerl::nanobench::render(ankerl::nanobench::templates::json(), results[i], out);
+		}
+		out << "]}\n";
+
+		fmt::print("Wrote {} benchmark groups to {}\n", results.size(), json_path);
+	}
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
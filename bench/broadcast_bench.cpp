@@ -0,0 +1,111 @@
+#include "bench.h"
+
+#include <bs/enet.h>
+#include <bs/loopback.h>
+
+#include <enet/enet.h>
+#include <fmt/format.h>
+#include <spdlog/sinks/null_sink.h>
+
+#include <string>
+
+namespace {
+	constexpr const char* HOST = "127.0.0.1";
+	constexpr int32_t PORT = 41230;
+	constexpr size_t MAX_PEERS = 1024;
+	constexpr size_t PAYLOAD_SIZE = 64;
+
+	// Reads whatever has arrived so the clients don't back up.
+	void drain(bs::Transport& clients) {
+		ENetEvent event{};
+		while (clients.service(&event, 0) > 0) {
+			if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+				enet_packet_destroy(event.packet);
+			}
+		}
+	}
+
+	// Fans a packet out from a server to every peer of the clients transport,
+	// which stands in for MAX_PEERS separate clients.
+	void bench_fan_out(ankerl::nanobench::Bench& bench, const char* transport_name, bs::logger_t& logger, bs::Transport_Factory& transports, bs::Transport& clients) {
+		bs::Host_Server server(HOST, PORT, (int32_t)MAX_PEERS, logger, transports);
+		server.start();
+
+		for (size_t i = 0; i < MAX_PEERS; ++i) {
+			clients.connect(HOST, PORT, server.get_channels().size());
+		}
+
+		auto& manager = server.get_client_manager();
+		const auto deadline = bench::clock_t::now() + std::chrono::seconds(10);
+		while (manager.get_connected_clients().size() < MAX_PEERS && bench::clock_t::now() < deadline) {
+			drain(clients);
+			server.tick(1);
+			server.get_packets().clear();
+		}
+
+		const size_t connected = manager.get_connected_clients().size();
+		if (connected < MAX_PEERS) {
+			fmt::print("Broadcast bench: only {} of {} {} peers connected\n", connected, MAX_PEERS, transport_name);
+		}
+
+		std::vector<uint8_t> payload(PAYLOAD_SIZE, 7);
+		bs::Packet packet(nullptr, payload.data(), payload.size());
+
+		// Each iteration queues the packet for every member, has the server push
+		// the datagrams out and lets the clients read them.
+		for (size_t count : { (size_t)16, (size_t)256, connected }) {
+			if (count == 0 || count > connected) {
+				continue;
+			}
+
+			const auto group = manager.create_group();
+			for (size_t i = 0; i < count; ++i) {
+				manager.add_to_group(group, manager.get_connected_clients()[i]->get_id());
+			}
+
+			bench.batch(count);
+			bench.run(fmt::format("broadcast_to_group, {}, {} peers", transport_name, count), [&] {
+				server.broadcast_to_group(group, packet, bs::CHANNEL_UNRELIABLE);
+				server.tick(0);
+				drain(clients);
+				});
+
+			manager.destroy_group(group);
+		}
+
+		if (connected > 0) {
+			bench.batch(connected);
+			bench.run(fmt::format("broadcast_to_clients, {}, {} peers", transport_name, connected), [&] {
+				server.broadcast_to_clients(packet, bs::CHANNEL_UNRELIABLE);
+				server.tick(0);
+				drain(clients);
+				});
+		}
+	}
+}
+
+void bench_broadcast(bench::Results& results) {
+	auto logger = spdlog::null_logger_mt("bench_broadcast");
+	bs::ENet enet(logger);
+
+	ankerl::nanobench::Bench bench;
+	bench.title("Broadcast").unit("peer").minEpochIterations(200);
+
+	// The UDP runs include the kernel's loopback path, the in-process ones
+	// are only bs and ENet's packet handling.
+	{
+		ENetHost* host = enet_host_create(NULL, MAX_PEERS, bs::Channel_Set().size(), 0, 0);
+		ASSERT_PANIC(host != nullptr, "Failed to create the UDP client host");
+
+		bs::Enet_Transport clients(host);
+		bench_fan_out(bench, "udp", logger, bs::Transport_Factory::get_enet(), clients);
+	}
+
+	{
+		bs::Loopback_Network network;
+		bs::Loopback_Transport clients(network, MAX_PEERS);
+		bench_fan_out(bench, "in-process", logger, network, clients);
+	}
+
+	results.push_back(bench);
+}
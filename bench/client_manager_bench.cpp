@@ -0,0 +1,124 @@
+#include "bench.h"
+
+#include <bs/server_client_manager.h>
+
+#include <enet/enet.h>
+#include <spdlog/sinks/null_sink.h>
+
+#include <memory>
+#include <unordered_map>
+
+namespace {
+	constexpr size_t MAX_CLIENTS = 4096;
+	constexpr size_t CHURN_CLIENTS = 100000;
+
+	// The unordered_map of shared_ptr the manager used to be, kept here as the baseline.
+	class Legacy_Client_Map {
+	public:
+		explicit Legacy_Client_Map(bs::logger_t& logger) : m_logger(logger) {}
+
+		std::shared_ptr<bs::Server_Client> add_client(_ENetPeer* peer) {
+			auto id = (bs::client_id)m_clients.size();
+			m_clients.insert({ peer, std::make_shared<bs::Server_Client>(peer, id, m_logger) });
+			return m_clients[peer];
+		}
+
+		std::shared_ptr<bs::Server_Client> get_client(_ENetPeer* peer) {
+			if (m_clients.find(peer) != m_clients.end()) {
+				return m_clients[peer];
+			}
+			return nullptr;
+		}
+
+		void remove_client(_ENetPeer* peer) { m_clients.erase(peer); }
+
+	private:
+		std::unordered_map<_ENetPeer*, std::shared_ptr<bs::Server_Client>> m_clients;
+		bs::logger_t m_logger;
+	};
+}
+
+void bench_client_manager(bench::Results& results) {
+	auto logger = spdlog::null_logger_mt("bench_client_manager");
+	bs::Packet_Sender sender(logger);
+
+	// Peers are never touched by ENet here, they only need to be stable addresses.
+	std::vector<ENetPeer> peers(MAX_CLIENTS);
+
+	ankerl::nanobench::Bench bench;
+	bench.title("Server_Client_Manager").relative(true);
+
+	// Keep the table full and replace the oldest client with a new one
+	// until CHURN_CLIENTS clients have connected and disconnected.
+	bench.unit("client").batch(CHURN_CLIENTS).epochs(5).epochIterations(1);
+	bench.run("legacy map: churn 100k clients", [&] {
+		Legacy_Client_Map clients(logger);
+		for (size_t i = 0; i < CHURN_CLIENTS; ++i) {
+			auto* peer = &peers[i % MAX_CLIENTS];
+			if (i >= MAX_CLIENTS) {
+				clients.remove_client(peer);
+			}
+			ankerl::nanobench::doNotOptimizeAway(clients.add_client(peer));
+		}
+		});
+
+	bench.run("slot table: churn 100k clients", [&] {
+		bs::Server_Client_Manager clients(MAX_CLIENTS, sender, logger);
+		for (size_t i = 0; i < CHURN_CLIENTS; ++i) {
+			auto* peer = &peers[i % MAX_CLIENTS];
+			if (i >= MAX_CLIENTS) {
+				clients.disconnect_client(peer);
+			}
+			ankerl::nanobench::doNotOptimizeAway(clients.add_client(peer));
+		}
+
+		for (auto& peer : peers) {
+			clients.disconnect_client(&peer);
+		}
+		});
+
+	// Lookups from incoming packets against a full table.
+	bench.unit("lookup").batch(1).epochs(11).minEpochIterations(100000).relative(true);
+	{
+		Legacy_Client_Map clients(logger);
+		for (auto& peer : peers) {
+			clients.add_client(&peer);
+		}
+
+		size_t i = 0;
+		bench.run("legacy map: get_client(peer)", [&] {
+			ankerl::nanobench::doNotOptimizeAway(clients.get_client(&peers[i++ % MAX_CLIENTS]));
+			});
+	}
+
+	{
+		bs::Server_Client_Manager clients(MAX_CLIENTS, sender, logger);
+		for (auto& peer : peers) {
+			clients.add_client(&peer);
+		}
+
+		size_t i = 0;
+		bench.run("slot table: get_client(peer)", [&] {
+			ankerl::nanobench::doNotOptimizeAway(clients.get_client(&peers[i++ % MAX_CLIENTS]));
+			});
+
+		bench.run("slot table: get_client(id)", [&] {
+			ankerl::nanobench::doNotOptimizeAway(clients.get_client((bs::client_id)(i++ % MAX_CLIENTS)));
+			});
+
+		bench.unit("client").batch(MAX_CLIENTS);
+		bench.run("slot table: iterate connected", [&] {
+			size_t sum = 0;
+			for (auto* client : clients.get_connected_clients()) {
+				sum += (size_t)client->get_id();
+			}
+			ankerl::nanobench::doNotOptimizeAway(sum);
+			});
+
+		for (auto& peer : peers) {
+			clients.disconnect_client(&peer);
+		}
+	}
+
+	results.push_back(bench);
+}
@@ -0,0 +1,90 @@
+#include "bench.h"
+
+#include <bs/loopback.h>
+
+#include <spdlog/sinks/null_sink.h>
+
+#include <array>
+#include <functional>
+#include <type_traits>
+
+#include "base_game_host.h"
+
+namespace {
+	constexpr int32_t PORT = 41240;
+
+	// Messages pushed through per tick, so the one ENet service call in
+	// Game_Host::tick is shared across a realistic batch.
+	constexpr size_t MESSAGES_PER_TICK = 64;
+
+	using Host = Game_Host<bs::Host_Server>;
+
+	struct Message_Case {
+		const char* name;
+		std::function<bs::Packet(Host&, uint32_t)> build;
+	};
+}
+
+void bench_game_host(bench::Results& results) {
+	auto logger = spdlog::null_logger_mt("bench_game_host");
+
+	// Nothing arrives over the network here, the host only needs somewhere to sit.
+	bs::Loopback_Network network;
+	Host host(logger, "bench", PORT, bs::Host_Server::IO_INLINE, network);
+
+	// Dispatch the way the pong server does, a typed handler per message.
+	std::array<uint64_t, Game::Any_MAX + 1> dispatched{};
+	auto count = [&](const auto* message, const bs::Packet*) {
+		dispatched[Game::AnyTraits<std::remove_cvref_t<decltype(*message)>>::enum_value]++;
+		};
+	host.set_message_handlers(
+		on<Game::ClientConnectedRequest>(count),
+		on<Game::ClientConnectedResponse>(count),
+		on<Game::ClientDisconnected>(count),
+		on<Game::ClientReady>(count),
+		on<Game::ClientReadyResponse>(count),
+		on<Game::GameStarting>(count),
+		on<Game::Tick>(count),
+		on<Game::PlayerMoved>(count),
+		on<Game::TickDelta>(count),
+		on<Game::TickAck>(count),
+		on<Game::PlayerInputs>(count),
+		on<Game::RollbackInputs>(count),
+		on<Game::RollbackChecksum>(count));
+
+	const std::array<uint8_t, 13> snapshot{};
+	const std::array<int8_t, INPUT_REDUNDANCY> inputs{};
+
+	const std::array<Message_Case, 11> cases = { {
+		{ "ClientConnectedRequest", [](Host& h, uint32_t) { return h.create_client_connect_request(); } },
+		{ "ClientConnectedResponse", [](Host& h, uint32_t i) { return h.create_client_connect_response((bs::client_id)i, 16); } },
+		{ "ClientDisconnected", [](Host& h, uint32_t) { return h.create_client_disconnect(); } },
+		{ "ClientReady", [](Host& h, uint32_t i) { return h.create_client_ready(i & 1); } },
+		{ "ClientReadyResponse", [](Host& h, uint32_t i) { return h.create_client_ready_response((int)(i & 1)); } },
+		{ "GameStarting", [](Host& h, uint32_t i) { return h.create_game_starting(10, 20, 30, 40, (float)i, 60, 1, 1); } },
+		{ "Tick", [](Host& h, uint32_t i) { return h.create_tick(10, 20, 30, 40, (float)i, 60, 1, 1, 3, 4); } },
+		{ "PlayerMoved", [](Host& h, uint32_t i) { return h.create_player_moved_message(0, 1, i); } },
+		{ "TickDelta", [&](Host& h, uint32_t i) { return h.create_tick_delta(i + 1, i, snapshot); } },
+		{ "TickAck", [](Host& h, uint32_t i) { return h.create_tick_ack(i); } },
+		{ "PlayerInputs", [&](Host& h, uint32_t i) { return h.create_player_inputs(0, i + 1, inputs); } },
+	} };
+
+	ankerl::nanobench::Bench bench;
+	bench.title("Game_Host build + verify + dispatch").unit("message").batch(MESSAGES_PER_TICK).minEpochIterations(200);
+
+	for (const auto& message_case : cases) {
+		uint32_t sequence = 0;
+		bench.run(message_case.name, [&] {
+			auto& packets = host->get_packets();
+			for (size_t i = 0; i < MESSAGES_PER_TICK; ++i) {
+				bs::Packet packet = message_case.build(host, sequence++);
+				packet.set_type(bs::Packet::EVENT_RECIEVED);
+				packets.push(std::move(packet));
+			}
+			host.tick(0);
+			});
+	}
+
+	ankerl::nanobench::doNotOptimizeAway(dispatched);
+	results.push_back(bench);
+}
@@ -0,0 +1,101 @@
+#include "bench.h"
+
+#include <bs/job_system.h>
+#include <bs/snapshot.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+	// About what a busy server would run, two clients per match.
+	constexpr size_t ROOMS = 4096;
+
+	// Steps simulated per tick, a heavier game does more work per room.
+	constexpr int STEPS_PER_TICK = 16;
+
+	// A pong match boiled down to what costs time every tick: moving and
+	// bouncing the ball, then bit packing a snapshot for each player.
+	struct Room {
+		float x = 0.0f;
+		float y = 0.0f;
+		float vx = 1.5f;
+		float vy = 1.5f;
+		uint32_t score[2] = {};
+
+		bs::Bit_Writer writers[2];
+		uint32_t baseline[4] = {};
+	};
+
+	void tick_room(Room& room) {
+		for (int step = 0; step < STEPS_PER_TICK; ++step) {
+			room.x += room.vx;
+			room.y += room.vy;
+			if (room.y < 0.0f || room.y > 540.0f) {
+				room.vy = -room.vy;
+			}
+			if (room.x < 0.0f || room.x > 960.0f) {
+				room.score[room.x < 0.0f ? 1 : 0]++;
+				room.x = 480.0f;
+				room.vx = -room.vx * 1.08f;
+			}
+		}
+
+		const uint32_t values[4] = {
+			bs::quantize(room.x, -64.0f, 1024.0f, 14),
+			bs::quantize(room.y, -64.0f, 1024.0f, 14),
+			room.score[0],
+			room.score[1],
+		};
+
+		for (auto& writer : room.writers) {
+			writer.clear();
+			for (size_t i = 0; i < 4; ++i) {
+				writer.write_delta(room.baseline[i], values[i], 16);
+			}
+			ankerl::nanobench::doNotOptimizeAway(writer.finish().size());
+		}
+
+		std::copy(std::begin(values), std::end(values), room.baseline);
+	}
+}
+
+void bench_job_system(bench::Results& results) {
+	std::vector<Room> rooms(ROOMS);
+
+	ankerl::nanobench::Bench bench;
+	bench.title(fmt::format("Job_System tick of {} rooms", ROOMS)).unit("tick").relative(true).minEpochIterations(20);
+
+	// The plain loop a single threaded server runs, then the same tick
+	// spread over more and more threads.
+	bench.run("serial loop", [&] {
+		for (auto& room : rooms) {
+			tick_room(room);
+		}
+		});
+
+	const size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	std::vector<size_t> thread_counts;
+	for (size_t threads = 1; threads < cores; threads *= 2) {
+		thread_counts.push_back(threads);
+	}
+	thread_counts.push_back(cores);
+
+	for (const size_t threads : thread_counts) {
+		bs::Job_System jobs(threads - 1);
+
+		// A few pieces per thread so stealing can even out slow ones.
+		const size_t grain = std::max<size_t>(ROOMS / (threads * 8), 16);
+		bench.run(fmt::format("parallel_for, {} threads", threads), [&] {
+			jobs.parallel_for(rooms.size(), grain, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					tick_room(rooms[i]);
+				}
+				});
+			});
+	}
+
+	results.push_back(bench);
+}
@@ -0,0 +1,82 @@
+#include "bench.h"
+
+#include <bs/packet.h>
+#include <bs/packet_pool.h>
+
+#include <enet/enet.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+	// Roughly the size of a pong tick message.
+	constexpr size_t MESSAGE_SIZE = 96;
+
+	// Stands in for a FlatBufferBuilder writing a message back to front in
+	// to whatever buffer it was given.
+	void serialize(uint8_t* block, size_t block_size, uint8_t seed) {
+		std::memset(block + block_size - MESSAGE_SIZE, seed, MESSAGE_SIZE);
+	}
+}
+
+void bench_packet(bench::Results& results) {
+	{
+		// What the service loop does for every received event. The bench
+		// holds its own reference so the packet survives each iteration.
+		std::vector<uint8_t> payload(MESSAGE_SIZE, 1);
+		ENetPacket* received = enet_packet_create(payload.data(), payload.size(), ENET_PACKET_FLAG_RELIABLE);
+		bs::Packet::retain(received);
+
+		ENetPeer peer{};
+		ENetEvent event{};
+		event.type = ENET_EVENT_TYPE_RECEIVE;
+		event.peer = &peer;
+		event.packet = received;
+
+		ankerl::nanobench::Bench bench;
+		bench.title("Packet from ENet event").unit("packet").minEpochIterations(100000);
+		bench.run("Packet(event) + destroy", [&] {
+			bs::Packet packet(&event);
+			ankerl::nanobench::doNotOptimizeAway(packet.get_bytes().data());
+			});
+
+		bench.run("Packet(event) + copy + move", [&] {
+			bs::Packet packet(&event);
+			bs::Packet copy(packet);
+			bs::Packet moved(std::move(packet));
+			ankerl::nanobench::doNotOptimizeAway(copy.get_bytes().data());
+			ankerl::nanobench::doNotOptimizeAway(moved.get_bytes().data());
+			});
+
+		bs::Packet::release(received);
+		results.push_back(bench);
+	}
+
+	ankerl::nanobench::Bench bench;
+	bench.title("Packet creation").unit("packet").relative(true).minEpochIterations(20000);
+
+	{
+		// The old path: build in the builder's own buffer then copy it in
+		// to a freshly allocated ENet packet.
+		std::vector<uint8_t> builder(bs::Packet_Pool::BLOCK_SIZE);
+		uint8_t seed = 0;
+		bench.run("builder buffer + copy", [&] {
+			serialize(builder.data(), builder.size(), seed++);
+			bs::Packet packet(nullptr, builder.data() + builder.size() - MESSAGE_SIZE, MESSAGE_SIZE);
+			ankerl::nanobench::doNotOptimizeAway(packet);
+			});
+	}
+
+	{
+		bs::Packet_Pool pool;
+		uint8_t seed = 0;
+		bench.run("pooled block, no copy", [&] {
+			uint8_t* block = pool.allocate(bs::Packet_Pool::BLOCK_SIZE);
+			serialize(block, bs::Packet_Pool::BLOCK_SIZE, seed++);
+			bs::Packet packet = pool.adopt(nullptr, block, bs::Packet_Pool::BLOCK_SIZE - MESSAGE_SIZE, MESSAGE_SIZE);
+			ankerl::nanobench::doNotOptimizeAway(packet);
+			});
+	}
+
+	results.push_back(bench);
+}
@@ -0,0 +1,118 @@
+#include "bench.h"
+
+#include <fmt/format.h>
+
+#include <cstring>
+#include <vector>
+
+#include "simulation.h"
+
+namespace {
+	// About what a busy server would run, two clients per match.
+	constexpr size_t MATCHES = 4096;
+
+	struct Player {
+		float x = 0.0f;
+		float y = 0.0f;
+		int score = 0;
+	};
+
+	// A match the way the server keeps it, one object per room.
+	struct Match {
+		Player players[2];
+		float ball_x = 0.0f;
+		float ball_y = 0.0f;
+		float ball_vx = 0.0f;
+		float ball_vy = 0.0f;
+	};
+
+	// Spread the balls and paddles out so matches bounce, score and hit
+	// paddles on different ticks.
+	Match make_match(size_t i) {
+		Match match;
+		match.players[0] = { 5.0f, (float)((i * 37) % (HEIGHT - PLAYER_HEIGHT)) };
+		match.players[1] = { (float)(WIDTH - PLAYER_WIDTH - 5), (float)((i * 53) % (HEIGHT - PLAYER_HEIGHT)) };
+		match.ball_x = (float)((i * 97) % WIDTH);
+		match.ball_y = (float)((i * 31) % HEIGHT);
+		match.ball_vx = i % 2 ? BALL_INITIAL_SPEED : -BALL_INITIAL_SPEED;
+		match.ball_vy = i % 3 ? BALL_INITIAL_SPEED : -BALL_INITIAL_SPEED;
+		return match;
+	}
+
+	void fill_batch(Pong_Batch& batch, const std::vector<Match>& matches) {
+		batch.resize(matches.size());
+		for (size_t i = 0; i < matches.size(); ++i) {
+			for (int p = 0; p < 2; ++p) {
+				batch.paddle_x[p][i] = matches[i].players[p].x;
+				batch.paddle_y[p][i] = matches[i].players[p].y;
+				batch.score[p][i] = matches[i].players[p].score;
+			}
+			batch.ball_x[i] = matches[i].ball_x;
+			batch.ball_y[i] = matches[i].ball_y;
+			batch.ball_vx[i] = matches[i].ball_vx;
+			batch.ball_vy[i] = matches[i].ball_vy;
+		}
+	}
+
+	template <typename T>
+	bool same_bits(const std::vector<T>& a, const std::vector<T>& b) {
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+	}
+
+	bool same_bits(const Pong_Batch& a, const Pong_Batch& b) {
+		for (int p = 0; p < 2; ++p) {
+			if (!same_bits(a.paddle_y[p], b.paddle_y[p]) || !same_bits(a.score[p], b.score[p])) {
+				return false;
+			}
+		}
+		return same_bits(a.ball_x, b.ball_x) && same_bits(a.ball_y, b.ball_y)
+			&& same_bits(a.ball_vx, b.ball_vx) && same_bits(a.ball_vy, b.ball_vy);
+	}
+}
+
+bool bench_pong_sim(bench::Results& results) {
+	std::vector<Match> matches;
+	for (size_t i = 0; i < MATCHES; ++i) {
+		matches.push_back(make_match(i));
+	}
+
+	Pong_Batch scalar;
+	Pong_Batch simd;
+	fill_batch(scalar, matches);
+	fill_batch(simd, matches);
+
+	// The fast path is only any use if it plays the same game. A few
+	// minutes of ticks covers plenty of bounces, goals and paddle hits.
+	for (int tick = 0; tick < 60 * 60 * 5; ++tick) {
+		step_batch_scalar(scalar, 0, MATCHES);
+		step_batch(simd, 0, MATCHES);
+	}
+	if (!same_bits(scalar, simd)) {
+		fmt::print("pong simulation: {} kernel is NOT bit identical to the scalar one\n", PONG_SIMD_NAME);
+		return false;
+	}
+	fmt::print("pong simulation: {} kernel is bit identical to the scalar one\n", PONG_SIMD_NAME);
+
+	ankerl::nanobench::Bench bench;
+	bench.title(fmt::format("Pong simulation tick of {} matches", MATCHES)).unit("tick").relative(true).minEpochIterations(100);
+
+	bench.run("game_state_tick per match", [&] {
+		for (auto& match : matches) {
+			game_state_tick(match.players, match.ball_x, match.ball_y, match.ball_vx, match.ball_vy);
+		}
+		ankerl::nanobench::doNotOptimizeAway(matches.front().ball_x);
+		});
+
+	bench.run("Pong_Batch, scalar", [&] {
+		step_batch_scalar(scalar, 0, MATCHES);
+		ankerl::nanobench::doNotOptimizeAway(scalar.ball_x.front());
+		});
+
+	bench.run(fmt::format("Pong_Batch, {}", PONG_SIMD_NAME), [&] {
+		step_batch(simd, 0, MATCHES);
+		ankerl::nanobench::doNotOptimizeAway(simd.ball_x.front());
+		});
+
+	results.push_back(bench);
+	return true;
+}
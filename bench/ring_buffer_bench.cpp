@@ -0,0 +1,158 @@
+#include "bench.h"
+
+#include <bs/ring_buffer.h>
+#include <bs/packet.h>
+
+#include <fmt/format.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace {
+	// The queue Ts_Packet_Queue used to be, kept here as the baseline.
+	template <typename T>
+	class Locked_Queue {
+	public:
+		bool push(T&& value) {
+			std::scoped_lock lock(m_mutex);
+			m_items.push_back(std::move(value));
+			return true;
+		}
+
+		bool pop(T& out) {
+			std::scoped_lock lock(m_mutex);
+			if (m_items.empty()) {
+				return false;
+			}
+			out = std::move(m_items.front());
+			m_items.pop_front();
+			return true;
+		}
+
+		template <typename Fn>
+		size_t drain(Fn&& fn) {
+			size_t count = 0;
+			T item;
+			while (pop(item)) {
+				fn(item);
+				++count;
+			}
+			return count;
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::deque<T> m_items;
+	};
+
+	constexpr size_t ITEMS = 1 << 20;
+
+	template <typename T>
+	T make_item(uint64_t i) {
+		if constexpr (std::is_same_v<T, bs::Packet>) {
+			return bs::Packet();
+		}
+		else {
+			return T(i);
+		}
+	}
+
+	// One producer thread pushes ITEMS values while the consumer drains. The
+	// producer times every push, including any spinning on a full queue.
+	template <typename Queue, typename T>
+	void run_producer_consumer(std::vector<uint64_t>& latencies) {
+		Queue queue;
+		std::atomic<bool> go = false;
+
+		std::thread consumer([&] {
+			while (!go.load(std::memory_order_acquire)) {}
+
+			size_t received = 0;
+			while (received < ITEMS) {
+				const size_t count = queue.drain([&](T& value) { ankerl::nanobench::doNotOptimizeAway(value); });
+				if (count == 0) {
+					std::this_thread::yield();
+				}
+				received += count;
+			}
+			});
+
+		go.store(true, std::memory_order_release);
+
+		for (uint64_t i = 0; i < ITEMS; ++i) {
+			const auto push_start = bench::clock_t::now();
+			while (!queue.push(make_item<T>(i))) {
+				std::this_thread::yield();
+			}
+			latencies.push_back(bench::elapsed_ns(push_start, bench::clock_t::now()));
+		}
+
+		consumer.join();
+	}
+
+	template <typename Queue, typename T>
+	void bench_producer_consumer(ankerl::nanobench::Bench& bench, const char* name) {
+		std::vector<uint64_t> latencies;
+		latencies.reserve(ITEMS * 3);
+
+		bench.run(name, [&] {
+			run_producer_consumer<Queue, T>(latencies);
+			});
+
+		fmt::print("| {:<34} | push p50 {:>5} ns | p99 {:>6} ns | p99.9 {:>7} ns |\n",
+			name,
+			bench::percentile(latencies, 0.50),
+			bench::percentile(latencies, 0.99),
+			bench::percentile(latencies, 0.999));
+	}
+}
+
+void bench_ring_buffer(bench::Results& results) {
+	using Ring = bs::Spsc_Ring_Buffer<uint64_t, 4096>;
+
+	ankerl::nanobench::Bench bench;
+	bench.title("Packet queue (single thread)").unit("item").relative(true).minEpochIterations(10000);
+
+	{
+		Locked_Queue<uint64_t> queue;
+		uint64_t out = 0;
+		bench.run("mutex + deque push/pop", [&] {
+			queue.push(uint64_t(1));
+			queue.pop(out);
+			ankerl::nanobench::doNotOptimizeAway(out);
+			});
+	}
+
+	{
+		Ring ring;
+		uint64_t out = 0;
+		bench.run("spsc ring push/pop", [&] {
+			ring.push(uint64_t(1));
+			ring.pop(out);
+			ankerl::nanobench::doNotOptimizeAway(out);
+			});
+	}
+
+	{
+		bs::Ts_Packet_Queue queue;
+		bench.run("Ts_Packet_Queue push/drain", [&] {
+			queue.push(bs::Packet());
+			queue.drain([](bs::Packet& packet) { ankerl::nanobench::doNotOptimizeAway(packet); });
+			});
+	}
+
+	results.push_back(bench);
+
+	// Whole runs of ITEMS pushes against a consumer on another thread.
+	ankerl::nanobench::Bench contended;
+	contended.title("Packet queue (producer/consumer threads)").unit("item").batch(ITEMS).epochs(3).epochIterations(1).relative(true);
+
+	bench_producer_consumer<Locked_Queue<uint64_t>, uint64_t>(contended, "mutex + deque");
+	bench_producer_consumer<Ring, uint64_t>(contended, "spsc ring");
+	bench_producer_consumer<bs::Ts_Packet_Queue, bs::Packet>(contended, "Ts_Packet_Queue");
+
+	results.push_back(contended);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "packet.h"
+
+namespace bs {
+	// Batch frames pack several small messages for the same peer and channel
+	// in to one ENet packet. The layout, little endian:
+	//
+	//   u32 BATCH_MAGIC, u16 message count, u16 reserved
+	//   per message: u32 length, u32 reserved, the bytes padded to 8
+	//
+	// Every message starts 8 byte aligned so flatbuffers can be read in place
+	// from a view of the frame. A flatbuffer starts with its root offset which
+	// is always smaller than the buffer, so a plain message can't be mistaken
+	// for a frame.
+	inline constexpr uint32_t BATCH_MAGIC = 0x48435442;
+	inline constexpr size_t BATCH_HEADER_SIZE = 8;
+	inline constexpr size_t BATCH_MESSAGE_HEADER_SIZE = 8;
+	inline constexpr size_t BATCH_ALIGNMENT = 8;
+
+	// Receivers stop servicing ENet unless they have room for this many packets.
+	inline constexpr size_t MAX_BATCH_MESSAGES = 64;
+
+	// Leaves room for ENet's own headers inside its default 1400 byte MTU.
+	inline constexpr size_t DEFAULT_BATCH_FRAME_SIZE = 1200;
+
+	// Space a message of the given length takes up inside a frame.
+	inline constexpr size_t get_batch_entry_size(size_t length) {
+		return BATCH_MESSAGE_HEADER_SIZE + ((length + BATCH_ALIGNMENT - 1) & ~(BATCH_ALIGNMENT - 1));
+	}
+
+	// Reads the little endian u32 at offset.
+	inline uint32_t read_batch_u32(std::span<const uint8_t> bytes, size_t offset) {
+		return (uint32_t)bytes[offset] | (uint32_t)bytes[offset + 1] << 8 | (uint32_t)bytes[offset + 2] << 16 | (uint32_t)bytes[offset + 3] << 24;
+	}
+
+	bool is_batch_frame(std::span<const uint8_t> bytes);
+
+	// Writes the messages as a single frame, replacing what was in out.
+	void write_batch_frame(std::span<const Packet> messages, std::vector<uint8_t>& out);
+
+	// Checks every message header lies inside the frame and returns the
+	// message count, or 0 if the frame is malformed.
+	size_t validate_batch_frame(std::span<const uint8_t> bytes);
+
+	// Hands fn a view packet for each message in the frame, in the order they
+	// were sent. Returns false without calling fn if the frame is malformed.
+	template <typename Fn>
+	bool unpack_batch_frame(const Packet& frame, Fn&& fn) {
+		const auto bytes = frame.get_bytes();
+		const size_t count = validate_batch_frame(bytes);
+		if (count == 0) {
+			return false;
+		}
+
+		size_t offset = BATCH_HEADER_SIZE;
+		for (size_t i = 0; i < count; ++i) {
+			const size_t length = read_batch_u32(bytes, offset);
+			fn(frame.make_view(offset + BATCH_MESSAGE_HEADER_SIZE, length));
+			offset += get_batch_entry_size(length);
+		}
+
+		return true;
+	}
+}
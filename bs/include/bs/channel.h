@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "utils.h"
+
+namespace bs {
+	// ENet channel index. It's a distinct type so a channel can't be confused
+	// with the reliable flag the older send overloads take.
+	enum class channel_id : uint8_t {};
+
+	enum Delivery {
+		// Resent until acknowledged and delivered in order.
+		DELIVERY_RELIABLE = 0,
+		// Never resent, anything older than the last packet received is dropped.
+		DELIVERY_UNRELIABLE_SEQUENCED,
+		// Never resent and delivered in whatever order it arrives.
+		DELIVERY_UNSEQUENCED,
+	};
+
+	// Channels every host declares by default. The bool send overloads map
+	// reliable to CHANNEL_RELIABLE and unreliable to CHANNEL_UNRELIABLE.
+	inline constexpr channel_id CHANNEL_RELIABLE{ 0 };
+	inline constexpr channel_id CHANNEL_UNRELIABLE{ 1 };
+	inline constexpr channel_id CHANNEL_UNSEQUENCED{ 2 };
+
+	inline constexpr channel_id get_default_channel(bool reliable) {
+		return reliable ? CHANNEL_RELIABLE : CHANNEL_UNRELIABLE;
+	}
+
+	// ENet packet flags to send with for a delivery mode.
+	uint32_t get_enet_packet_flags(Delivery delivery);
+
+	// The delivery mode a packet was sent or received with.
+	Delivery get_delivery(uint32_t enet_flags);
+
+	struct Channel_Config {
+		const char* name = "";
+		Delivery delivery = DELIVERY_RELIABLE;
+	};
+
+	// Counted per ENet packet, a batch frame counts once.
+	struct Channel_Stats {
+		uint64_t packets_sent = 0;
+		uint64_t bytes_sent = 0;
+		uint64_t packets_received = 0;
+		uint64_t bytes_received = 0;
+	};
+
+	// The channels a host opens with its peers. Each channel has its own
+	// ordering and reliability in ENet so a stalled reliable channel doesn't
+	// hold back the others. Both ends have to declare the same channels, in
+	// the same order, before they start.
+	class Channel_Set {
+	public:
+		// ENet's protocol limit.
+		static constexpr size_t MAX_CHANNELS = 255;
+
+		Channel_Set() {
+			declare("reliable", DELIVERY_RELIABLE);
+			declare("unreliable", DELIVERY_UNRELIABLE_SEQUENCED);
+			declare("unsequenced", DELIVERY_UNSEQUENCED);
+		}
+
+		channel_id declare(const char* name, Delivery delivery) {
+			ASSERT_PANIC(m_channels.size() < MAX_CHANNELS, "Too many channels declared");
+			m_channels.push_back({ { name, delivery }, {} });
+			return channel_id(m_channels.size() - 1);
+		}
+
+		// Drops every channel, including the default ones.
+		void clear() { m_channels.clear(); }
+
+		size_t size() const { return m_channels.size(); }
+		bool is_valid(channel_id channel) const { return (size_t)channel < m_channels.size(); }
+
+		const Channel_Config& get_config(channel_id channel) const { return get(channel).config; }
+		const Channel_Stats& get_stats(channel_id channel) const { return get(channel).stats; }
+
+		void on_sent(channel_id channel, size_t bytes) {
+			auto& stats = get(channel).stats;
+			stats.packets_sent++;
+			stats.bytes_sent += bytes;
+		}
+
+		void on_received(channel_id channel, size_t bytes) {
+			// Peers may open channels we don't know about, don't count those.
+			if (!is_valid(channel)) {
+				return;
+			}
+
+			auto& stats = get(channel).stats;
+			stats.packets_received++;
+			stats.bytes_received += bytes;
+		}
+
+	private:
+		struct Channel {
+			Channel_Config config;
+			Channel_Stats stats;
+		};
+
+		Channel& get(channel_id channel) {
+			ASSERT_PANIC(is_valid(channel), "Unknown channel: {}", (size_t)channel);
+			return m_channels[(size_t)channel];
+		}
+
+		const Channel& get(channel_id channel) const {
+			ASSERT_PANIC(is_valid(channel), "Unknown channel: {}", (size_t)channel);
+			return m_channels[(size_t)channel];
+		}
+
+		std::vector<Channel> m_channels;
+	};
+}
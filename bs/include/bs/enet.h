@@ -15,10 +15,12 @@ namespace bs {
 		ENet(logger_t& logger);
 		~ENet();
 
-		Host_Server* create_server(const char* host, int port, int max_clients);
+		// Hosts sit on real UDP sockets unless given another transport
+		// factory, such as a Loopback_Network.
+		Host_Server* create_server(const char* host, int port, int max_clients, Transport_Factory& transports = Transport_Factory::get_enet());
 		void destroy_server(Host_Server* server);
 
-		Host_Client* create_host_client();
+		Host_Client* create_host_client(Transport_Factory& transports = Transport_Factory::get_enet());
 		void destroy_client(Host_Client* client);
 
 	private:
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+namespace bs {
+	// Fixed size log-linear histogram of unsigned values. Values below 16 get
+	// a bucket each, above that every power of two is split in to 8 buckets so
+	// any recorded value is known to within 12.5%. Recording is a couple of
+	// instructions and never allocates, cheap enough for per tick timings.
+	class Histogram {
+	public:
+		static constexpr size_t LINEAR_BUCKETS = 16;
+		static constexpr size_t SUB_BUCKET_BITS = 3;
+		static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		static constexpr size_t BUCKET_COUNT = LINEAR_BUCKETS + (64 - 4) * SUB_BUCKETS;
+
+		void record(uint64_t value) {
+			m_buckets[get_bucket(value)]++;
+			m_count++;
+			m_sum += value;
+			m_min = std::min(m_min, value);
+			m_max = std::max(m_max, value);
+		}
+
+		uint64_t get_count() const { return m_count; }
+		uint64_t get_min() const { return m_count ? m_min : 0; }
+		uint64_t get_max() const { return m_max; }
+		double get_mean() const { return m_count ? (double)m_sum / (double)m_count : 0.0; }
+
+		// Upper bound of the bucket holding the given percentile, in [0, 100].
+		// Clamped to the largest value recorded.
+		uint64_t get_percentile(double percentile) const {
+			if (m_count == 0) {
+				return 0;
+			}
+
+			const double clamped = std::clamp(percentile, 0.0, 100.0);
+			const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(clamped / 100.0 * (double)m_count + 0.5));
+
+			uint64_t seen = 0;
+			for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+				seen += m_buckets[i];
+				if (seen >= rank) {
+					return std::min(get_bucket_upper_bound(i), m_max);
+				}
+			}
+
+			return m_max;
+		}
+
+		void merge(const Histogram& other) {
+			for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+				m_buckets[i] += other.m_buckets[i];
+			}
+			m_count += other.m_count;
+			m_sum += other.m_sum;
+			m_min = std::min(m_min, other.m_min);
+			m_max = std::max(m_max, other.m_max);
+		}
+
+		void clear() { *this = Histogram(); }
+
+		static size_t get_bucket(uint64_t value) {
+			if (value < LINEAR_BUCKETS) {
+				return (size_t)value;
+			}
+
+			const size_t msb = (size_t)std::bit_width(value) - 1;
+			const size_t sub = (size_t)(value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+			return LINEAR_BUCKETS + (msb - 4) * SUB_BUCKETS + sub;
+		}
+
+		static uint64_t get_bucket_upper_bound(size_t bucket) {
+			if (bucket < LINEAR_BUCKETS) {
+				return bucket;
+			}
+
+			const size_t msb = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+			const uint64_t sub = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+			const uint64_t width = 1ull << (msb - SUB_BUCKET_BITS);
+			return ((SUB_BUCKETS + sub) << (msb - SUB_BUCKET_BITS)) + width - 1;
+		}
+
+	private:
+		std::array<uint64_t, BUCKET_COUNT> m_buckets{};
+		uint64_t m_count = 0;
+		uint64_t m_sum = 0;
+		uint64_t m_min = std::numeric_limits<uint64_t>::max();
+		uint64_t m_max = 0;
+	};
+}
@@ -1,24 +1,27 @@
 #pragma once
+#include <memory>
 #include <utility>
 
 #include <spdlog/spdlog.h>
 
 #include "base.h"
 #include "utils.h"
+#include "metrics.h"
 #include "packet.h"
+#include "packet_sender.h"
+#include "transport.h"
 
 #include "enet_fwd.h"
 
 namespace bs {
 	class Host_Client : public Base_Client {
 	public:
-		Host_Client(logger_t& logger);
-		~Host_Client();
+		Host_Client(logger_t& logger, Transport_Factory& transports = Transport_Factory::get_enet());
 
 		void on_connect();
 		void on_disconnect();
 
-		_ENetHost* get_host() const { return m_client; }
+		Transport& get_transport() { return *m_transport; }
 		void tick(uint32_t timeout);
 
 		const char* get_host_address() const { return m_host; }
@@ -30,15 +33,34 @@ namespace bs {
 
 		_ENetPeer* get_peer() const { return m_peer; }
 
-		void broadcast_to_server(const Packet& packet, bool reliable = true);
+		void broadcast_to_server(const Packet& packet, channel_id channel);
+		void broadcast_to_server(const Packet& packet, bool reliable = true) { broadcast_to_server(packet, get_default_channel(reliable)); }
+
+		// Holds sends back until flush() and packs them in to frames per
+		// channel. tick() flushes anything still pending.
+		void set_batching(bool enabled, size_t max_frame_size = DEFAULT_BATCH_FRAME_SIZE) { m_sender.set_batching(enabled, max_frame_size); }
+		void flush() { m_sender.flush(); }
+
+		// Declare any extra channels before start(), they must match the server's.
+		Channel_Set& get_channels() { return m_sender.get_channels(); }
+
+		// Refreshed at the end of every tick(). The server is the only peer,
+		// with an id of -1.
+		const Metrics& get_metrics() const { return m_metrics; }
+		Metrics& get_metrics() { return m_metrics; }
 
 	private:
-		_ENetHost* m_client = nullptr;
+		void push_packet(Packet&& packet);
+		void update_metrics(Metrics::clock::time_point tick_start);
+
+		std::unique_ptr<Transport> m_transport;
 		_ENetPeer* m_server = nullptr;
 		_ENetPeer* m_peer = nullptr;
 		int32_t m_port;
 		const char* m_host;
 
 		Ts_Packet_Queue m_packets;
+		Packet_Sender m_sender;
+		Metrics m_metrics;
 	};
 }
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+#include "utils.h"
+
+namespace bs {
+	enum Interpolation_Mode {
+		INTERPOLATE_LINEAR = 0,
+		// Cubic Hermite with Catmull-Rom tangents from the neighbouring
+		// snapshots, smooth through each snapshot rather than just reaching it.
+		INTERPOLATE_HERMITE,
+	};
+
+	struct Interpolation_Config {
+		// How far behind the newest snapshot to render, in seconds. A couple
+		// of send intervals plus the expected jitter rides out a late packet.
+		double delay = 0.1;
+		Interpolation_Mode mode = INTERPOLATE_LINEAR;
+
+		// How far past the newest snapshot to carry on along its last
+		// velocity when snapshots stop arriving, before holding still.
+		double max_extrapolation = 0.05;
+	};
+
+	// Jitter buffer for remote state. Snapshots are stored against the
+	// sender's clock and rendered a fixed delay behind the newest one, so
+	// there's nearly always a pair either side of the render time to blend
+	// between whatever the arrival times looked like. The render clock runs
+	// on local time and is steered gently towards the target delay.
+	//
+	// The state is Channels floats, e.g. the x and y of every entity.
+	template <size_t Channels, size_t Capacity>
+	class Interpolation_Buffer {
+		static_assert(Capacity >= 2, "An interpolation buffer needs room for two snapshots");
+
+	public:
+		using values_t = std::array<float, Channels>;
+
+		Interpolation_Buffer(const Interpolation_Config& config = {})
+			: m_config(config) {}
+
+		// Time is the sender's clock in seconds. Anything not newer than the
+		// newest snapshot is dropped. A discontinuity, e.g. a teleport, is
+		// jumped to rather than blended in to.
+		void push(double time, const values_t& values, bool discontinuity = false) {
+			if (m_count > 0 && time <= newest().time) {
+				return;
+			}
+
+			if (m_count == Capacity) {
+				m_first = (m_first + 1) % Capacity;
+				m_count--;
+			}
+
+			m_samples[(m_first + m_count) % Capacity] = { time, values, discontinuity };
+			m_count++;
+
+			if (m_count == 1) {
+				m_render_time = time - m_config.delay;
+			}
+		}
+
+		// Moves the render clock on by dt local seconds. Small errors are
+		// caught up a fraction at a time so motion doesn't visibly speed up,
+		// anything past a second (e.g. after a stall) jumps straight there.
+		void advance(double dt) {
+			if (m_count == 0) {
+				return;
+			}
+
+			const double error = newest().time - m_config.delay - m_render_time;
+			if (std::abs(error) > MAX_CLOCK_ERROR) {
+				m_render_time += error;
+				return;
+			}
+
+			// Never run the clock backwards, slow it to a stop instead.
+			m_render_time += std::max(0.0, dt + error * std::min(1.0, dt * CATCH_UP_RATE));
+		}
+
+		// Returns false until the first snapshot arrives.
+		bool sample(values_t& out) const {
+			if (m_count == 0) {
+				return false;
+			}
+
+			const double time = m_render_time;
+			if (time <= at(0).time) {
+				out = at(0).values;
+				return true;
+			}
+
+			if (time >= newest().time) {
+				extrapolate(time, out);
+				return true;
+			}
+
+			size_t index = m_count - 2;
+			while (at(index).time > time) {
+				index--;
+			}
+
+			interpolate(index, time, out);
+			return true;
+		}
+
+		void clear() {
+			m_first = 0;
+			m_count = 0;
+		}
+
+		size_t size() const { return m_count; }
+		double get_render_time() const { return m_render_time; }
+
+		const Interpolation_Config& get_config() const { return m_config; }
+		void set_config(const Interpolation_Config& config) { m_config = config; }
+
+	private:
+		// Fraction of the clock error corrected per second.
+		static constexpr double CATCH_UP_RATE = 2.0;
+		static constexpr double MAX_CLOCK_ERROR = 1.0;
+
+		struct Sample {
+			double time = 0.0;
+			values_t values{};
+			bool discontinuity = false;
+		};
+
+		const Sample& at(size_t index) const { return m_samples[(m_first + index) % Capacity]; }
+		const Sample& newest() const { return at(m_count - 1); }
+
+		void extrapolate(double time, values_t& out) const {
+			const Sample& last = newest();
+			out = last.values;
+
+			if (m_count < 2 || last.discontinuity) {
+				return;
+			}
+
+			const Sample& previous = at(m_count - 2);
+			const double ahead = std::min(time - last.time, m_config.max_extrapolation);
+			const double scale = ahead / (last.time - previous.time);
+			for (size_t i = 0; i < Channels; ++i) {
+				out[i] += (float)((last.values[i] - previous.values[i]) * scale);
+			}
+		}
+
+		// Blends between the snapshots at index and index + 1.
+		void interpolate(size_t index, double time, values_t& out) const {
+			const Sample& a = at(index);
+			const Sample& b = at(index + 1);
+
+			// Hold until the jump rather than sliding across it.
+			if (b.discontinuity) {
+				out = a.values;
+				return;
+			}
+
+			const double span = b.time - a.time;
+			const float t = (float)((time - a.time) / span);
+
+			if (m_config.mode == INTERPOLATE_LINEAR) {
+				for (size_t i = 0; i < Channels; ++i) {
+					out[i] = a.values[i] + (b.values[i] - a.values[i]) * t;
+				}
+				return;
+			}
+
+			// Neighbours on the far side of a discontinuity don't count, the
+			// tangent falls back to the segment's own slope.
+			const Sample& before = index > 0 && !a.discontinuity ? at(index - 1) : a;
+			const Sample& after = index + 2 < m_count && !at(index + 2).discontinuity ? at(index + 2) : b;
+			const float in_scale = (float)(span / (b.time - before.time));
+			const float out_scale = (float)(span / (after.time - a.time));
+
+			const float t2 = t * t;
+			const float t3 = t2 * t;
+			const float h00 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+			const float h10 = t3 - 2.0f * t2 + t;
+			const float h01 = -2.0f * t3 + 3.0f * t2;
+			const float h11 = t3 - t2;
+
+			for (size_t i = 0; i < Channels; ++i) {
+				const float m0 = (b.values[i] - before.values[i]) * in_scale;
+				const float m1 = (after.values[i] - a.values[i]) * out_scale;
+				out[i] = h00 * a.values[i] + h10 * m0 + h01 * b.values[i] + h11 * m1;
+			}
+		}
+
+		Interpolation_Config m_config;
+		std::array<Sample, Capacity> m_samples{};
+		size_t m_first = 0;
+		size_t m_count = 0;
+		double m_render_time = 0.0;
+	};
+}
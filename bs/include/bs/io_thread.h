@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "channel.h"
+#include "metrics.h"
+#include "packet.h"
+#include "ring_buffer.h"
+#include "transport.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// An outbound send submitted by the game thread.
+	struct Send_Command {
+		_ENetPeer* peer = nullptr;
+		Packet packet;
+		channel_id channel = CHANNEL_RELIABLE;
+		Delivery delivery = DELIVERY_RELIABLE;
+	};
+
+	// Dedicated thread that owns a host's transport while it is running. It
+	// services the transport continuously, publishes every received event on the ingress
+	// queue and flushes the sends the game thread submitted on the egress queue.
+	// Nothing else may use the transport between start() and stop().
+	//
+	// ENet's reference counting isn't atomic so packets shared with the game
+	// thread are never handed to ENet directly. The I/O thread wraps them in a
+	// NO_ALLOCATE packet pointing at the same bytes which keeps a reference on
+	// the original until ENet frees the wrapper.
+	class Io_Thread {
+	public:
+		NO_COPY_NO_MOVE(Io_Thread);
+
+		static constexpr size_t EGRESS_CAPACITY = 8192;
+
+		// How often the connected peers' link stats are copied out for the
+		// game thread, which can't read them off the peers itself.
+		static constexpr std::chrono::milliseconds LINK_SAMPLE_INTERVAL{ 100 };
+
+		Io_Thread(logger_t& logger)
+			: m_logger(logger) {}
+		~Io_Thread();
+
+		void start(Transport* transport);
+		void stop();
+
+		bool is_running() const { return m_running.load(std::memory_order_acquire); }
+
+		// Game thread only. Blocks while the egress queue is full.
+		void submit(_ENetPeer* peer, const Packet& packet, channel_id channel, Delivery delivery);
+
+		// Consumed by the game thread.
+		Ts_Packet_Queue& get_ingress() { return m_ingress; }
+
+		// Game thread. Replaces out with the last sampled link stats.
+		void copy_peer_links(std::vector<Peer_Link>& out);
+
+	private:
+		void run();
+		void flush_egress();
+		void sample_peer_links();
+
+		Transport* m_transport = nullptr;
+		std::thread m_thread;
+		std::atomic<bool> m_running = false;
+
+		Ts_Packet_Queue m_ingress;
+		Spsc_Ring_Buffer<Send_Command, EGRESS_CAPACITY> m_egress;
+
+		std::mutex m_links_mutex;
+		std::vector<Peer_Link> m_links;
+		std::vector<Peer_Link> m_links_sampling;
+		std::chrono::steady_clock::time_point m_next_link_sample;
+
+		logger_t m_logger;
+	};
+}
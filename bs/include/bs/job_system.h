@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "ring_buffer.h"
+#include "utils.h"
+
+namespace bs {
+	// Fork/join thread pool for splitting a tick's work over the cores, e.g.
+	// stepping every room of a server at once. Each worker has its own deque
+	// of jobs. A job covering a range bigger than its grain splits off its
+	// top half to its own deque and carries on with the bottom half, idle
+	// workers steal the oldest (biggest) pieces from the others' deques.
+	//
+	// parallel_for() only returns once the whole range is done, so a tick
+	// made of several parallel_for() calls runs as phases with a barrier
+	// between each, e.g. simulate every room, then send every room's
+	// snapshots from the one thread that owns the network.
+	//
+	// The thread calling parallel_for() works on the range too, as thread
+	// index 0. Only one outside thread should use a Job_System at a time,
+	// jobs may call parallel_for() themselves.
+	class Job_System {
+	public:
+		NO_COPY_NO_MOVE(Job_System);
+
+		// Workers on top of the calling thread, 0 runs everything inline.
+		explicit Job_System(size_t worker_count = get_default_worker_count());
+		~Job_System();
+
+		static size_t get_default_worker_count();
+
+		// Workers plus the calling thread.
+		size_t get_thread_count() const { return m_queues.size(); }
+
+		// 0 on the calling thread, 1 to get_thread_count() - 1 on the
+		// workers. Handy for indexing per thread scratch space.
+		static size_t get_thread_index();
+
+		// Calls fn(begin, end) over [0, count) in pieces of at most grain
+		// and returns when they've all run. fn must be safe to run on
+		// several threads at once.
+		template <typename Fn>
+		void parallel_for(size_t count, size_t grain, Fn&& fn) {
+			if (count == 0) {
+				return;
+			}
+
+			if (m_workers.empty() || count <= grain) {
+				fn((size_t)0, count);
+				return;
+			}
+
+			using fn_t = std::remove_reference_t<Fn>;
+			Job job;
+			job.run = [](void* context, size_t begin, size_t end) { (*(fn_t*)context)(begin, end); };
+			job.context = (void*)&fn;
+			job.begin = 0;
+			job.end = count;
+			job.grain = grain == 0 ? 1 : grain;
+
+			std::atomic<size_t> remaining = count;
+			job.remaining = &remaining;
+
+			run_and_wait(job);
+		}
+
+	private:
+		struct Job {
+			void (*run)(void* context, size_t begin, size_t end) = nullptr;
+			void* context = nullptr;
+			size_t begin = 0;
+			size_t end = 0;
+			size_t grain = 1;
+
+			// Items of the whole parallel_for still to run.
+			std::atomic<size_t>* remaining = nullptr;
+		};
+
+		// Owner pushes and pops at the back, thieves take from the front.
+		struct alignas(CACHE_LINE_SIZE) Queue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		void run_and_wait(Job job);
+		void execute(Job job, size_t thread_index);
+		void push(size_t thread_index, const Job& job);
+		bool pop(size_t thread_index, Job& out);
+		bool steal(size_t thread_index, Job& out);
+		bool try_run_one(size_t thread_index);
+		void worker_main(size_t thread_index);
+
+		std::vector<std::unique_ptr<Queue>> m_queues;
+		std::vector<std::thread> m_workers;
+
+		// Jobs sitting in any of the deques, lets idle workers sleep.
+		std::atomic<size_t> m_queued = 0;
+		std::atomic<size_t> m_sleeping = 0;
+		std::atomic<bool> m_running = true;
+
+		std::mutex m_sleep_mutex;
+		std::condition_variable m_wake;
+	};
+}
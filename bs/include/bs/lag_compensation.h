@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils.h"
+
+namespace bs {
+	// Server side lag compensation. A client only ever sees the world as it
+	// was a round trip and its interpolation delay ago, so an input that
+	// looked like a hit on its screen can be a miss against the server's
+	// current state. The server keeps what the world looked like on each of
+	// the last few ticks and judges the input against the tick the client
+	// says it was looking at instead.
+	//
+	// Ticks are the server's own, e.g. from the Tick_Scheduler. Tick 0
+	// means the client hasn't seen anything yet and is never found.
+	using server_tick = uint64_t;
+	inline constexpr server_tick NO_TICK = 0;
+
+	// Ring of per tick states tagged with their tick. Recording writes in
+	// to the slot in place and lookups hand back a pointer to it, so
+	// rewinding never copies anything. State should be just what queries
+	// need, e.g. positions and bounds rather than the whole game.
+	template <typename State, size_t Capacity>
+	class Rewind_Buffer {
+		static_assert(Capacity >= 2, "A rewind buffer needs room for at least two ticks");
+
+	public:
+		static constexpr size_t capacity() { return Capacity; }
+
+		// The slot for the tick's state, fill it in. Ticks must go forward,
+		// skipped ticks are simply never found.
+		State& record(server_tick tick) {
+			ASSERT_PANIC(tick != NO_TICK, "Tick 0 is reserved for no tick");
+			ASSERT_PANIC(tick > m_newest || m_newest == NO_TICK, "Rewind buffer ticks must go forward: {} after {}", tick, m_newest);
+
+			m_newest = tick;
+			auto& entry = m_entries[tick % Capacity];
+			entry.tick = tick;
+			return entry.state;
+		}
+
+		const State* find(server_tick tick) const {
+			if (tick == NO_TICK) {
+				return nullptr;
+			}
+
+			const auto& entry = m_entries[tick % Capacity];
+			return entry.tick == tick ? &entry.state : nullptr;
+		}
+
+		// The tick to judge an input seen at view_tick against: no further
+		// back than max_rewind ticks (or the history) from the newest, so a
+		// client can't claim arbitrarily old views, and never past it.
+		server_tick clamp(server_tick view_tick, server_tick max_rewind) const {
+			if (m_newest == NO_TICK || view_tick == NO_TICK) {
+				return NO_TICK;
+			}
+
+			const server_tick depth = std::min<server_tick>(max_rewind, Capacity - 1);
+			const server_tick oldest = m_newest > depth ? m_newest - depth : 1;
+			return std::clamp(view_tick, oldest, m_newest);
+		}
+
+		// The state a client looking at view_tick saw, within the bounds of
+		// clamp(). nullptr if it doesn't know what it saw or that tick was
+		// never recorded.
+		const State* rewind(server_tick view_tick, server_tick max_rewind) const {
+			return find(clamp(view_tick, max_rewind));
+		}
+
+		server_tick get_newest_tick() const { return m_newest; }
+
+		void clear() {
+			m_entries = {};
+			m_newest = NO_TICK;
+		}
+
+	private:
+		struct Entry {
+			server_tick tick = NO_TICK;
+			State state{};
+		};
+
+		std::array<Entry, Capacity> m_entries{};
+		server_tick m_newest = NO_TICK;
+	};
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "channel.h"
+#include "timer_wheel.h"
+#include "transport.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// How one direction of a link behaves. The default is a perfect link.
+	struct Link_Profile {
+		// One way delay, each packet also gets up to +/- jitter_ms on top.
+		uint32_t delay_ms = 0;
+		uint32_t jitter_ms = 0;
+
+		// Chance a packet starts a loss burst, which then takes loss_burst
+		// packets in a row.
+		float loss = 0.0f;
+		uint32_t loss_burst = 1;
+
+		// Chance a packet arrives twice.
+		float duplicate = 0.0f;
+
+		// Chance a packet is held back an extra reorder_ms, letting the
+		// packets behind it overtake.
+		float reorder = 0.0f;
+		uint32_t reorder_ms = 30;
+
+		// Link rate in kilobits per second, 0 for no cap. Packets queue behind
+		// each other at that rate and unreliable ones are dropped once the
+		// queue is more than queue_ms deep.
+		uint32_t bandwidth_kbps = 0;
+		uint32_t queue_ms = 250;
+
+		// Parses a preset name (perfect, lan, wifi, broadband, mobile, bad)
+		// and/or comma separated key=value overrides, e.g. "mobile,loss=0.1"
+		// or "delay=80,jitter=20,loss=0.02,burst=3,dup=0.01,reorder=0.05,kbps=512".
+		static bool parse(std::string_view spec, Link_Profile& out, std::string& error);
+	};
+
+	// Profiles over time, measured from when a transport is created. The
+	// first step always starts at zero.
+	struct Link_Script {
+		struct Step {
+			uint64_t at_ms = 0;
+			Link_Profile profile;
+		};
+
+		std::vector<Step> steps;
+
+		bool empty() const { return steps.empty(); }
+		const Link_Profile& get_profile(uint64_t elapsed_ms) const;
+
+		// Either a single profile or ';' separated steps of
+		// "<seconds>s:<profile>", e.g. "wifi;10s:mobile;30s:bad". A spec
+		// starting with '@' names a file with one step per line instead,
+		// '#' starts a comment.
+		static bool parse(std::string_view spec, Link_Script& out, std::string& error);
+	};
+
+	// A Transport_Factory that puts a conditioned link between the hosts and
+	// another factory's transports, e.g. the real UDP one or a
+	// Loopback_Network. Every packet sent or received by the hosts is
+	// delayed, dropped, duplicated, reordered and rate limited according to
+	// the script, per peer and per direction.
+	//
+	//   bs::Link_Script script;
+	//   bs::Link_Script::parse("mobile;20s:bad", script, error);
+	//   bs::Link_Conditioner conditioner(bs::Transport_Factory::get_enet(), script);
+	//   auto* server = enet.create_server("127.0.0.1", 1234, 32, conditioner);
+	//
+	// This works on whole ENet packets above ENet's reliability layer, so it
+	// keeps ENet's guarantees: a lost reliable packet turns in to a resend a
+	// round trip later, reliable packets stay in order, a sequenced packet
+	// that gets overtaken is dropped like ENet's receiver would drop it, and
+	// only unsequenced packets can be duplicated. ENet's own round trip
+	// stats don't see the delay.
+	//
+	// An empty script leaves the inner transports as they are. The
+	// conditioner has to outlive every transport created from it.
+	class Link_Conditioner : public Transport_Factory {
+	public:
+		NO_COPY_NO_MOVE(Link_Conditioner);
+
+		Link_Conditioner(Transport_Factory& inner, Link_Script script, uint32_t seed = 0x5eed);
+
+		std::unique_ptr<Transport> create_server(const char* host, int32_t port, size_t max_peers, size_t channel_count) override;
+		std::unique_ptr<Transport> create_client() override;
+
+		// Gives one peer its own script in place of the default, timed from
+		// when it's set. It stays with the peer slot until cleared, so clear
+		// it when the client disconnects. Safe to call from any thread.
+		void set_peer_script(const _ENetPeer* peer, Link_Script script);
+		void clear_peer_script(const _ENetPeer* peer);
+
+		const Link_Script& get_script() const { return m_script; }
+
+	private:
+		friend class Conditioned_Transport;
+
+		struct Peer_Script {
+			Link_Script script;
+			std::chrono::steady_clock::time_point start;
+		};
+
+		using peer_scripts_t = std::unordered_map<const _ENetPeer*, Peer_Script>;
+
+		// Copies the per peer scripts if they changed since version.
+		bool get_peer_scripts(uint64_t& version, peer_scripts_t& out);
+
+		Transport_Factory& m_inner;
+		const Link_Script m_script;
+		const uint32_t m_seed;
+		std::atomic<uint32_t> m_transports_created = 0;
+
+		std::mutex m_mutex;
+		peer_scripts_t m_peer_scripts;
+		std::atomic<uint64_t> m_peer_scripts_version = 0;
+	};
+
+	// A transport with a Link_Conditioner's link in front of another one.
+	// Packets wait on a millisecond timer wheel until they're due, outgoing
+	// ones are then handed to the inner transport and incoming ones to the
+	// host. Like any transport it's only used from one thread at a time.
+	class Conditioned_Transport : public Transport {
+	public:
+		NO_COPY_NO_MOVE(Conditioned_Transport);
+
+		Conditioned_Transport(std::unique_ptr<Transport> inner, Link_Conditioner& conditioner, uint32_t seed);
+		~Conditioned_Transport() override;
+
+		_ENetPeer* connect(const char* host, int32_t port, size_t channel_count) override;
+		int service(_ENetEvent* event, uint32_t timeout_ms) override;
+		int check_events(_ENetEvent* event) override;
+		bool send(_ENetPeer* peer, channel_id channel, _ENetPacket* packet) override;
+		void flush() override;
+
+		size_t get_peer_count() const override;
+		_ENetPeer* get_peer(size_t index) override;
+		void claim(const char* owner) override { m_inner->claim(owner); }
+		void release(const char* owner) override { m_inner->release(owner); }
+
+		// Packets waiting on the link in either direction.
+		size_t get_held_count() const { return m_wheel.size(); }
+
+	private:
+		using clock = std::chrono::steady_clock;
+
+		enum Direction {
+			OUTGOING = 0,
+			INCOMING,
+		};
+
+		struct Held {
+			_ENetPeer* peer = nullptr;
+			_ENetPacket* packet = nullptr;
+			uint32_t generation = 0;
+			uint32_t flags = 0;
+
+			// Send order on a sequenced channel, 0 for other deliveries.
+			uint32_t sequence = 0;
+
+			uint8_t channel = 0;
+			Direction direction = OUTGOING;
+		};
+
+		struct Channel_Order {
+			// Reliable packets never arrive before the one sent ahead of them.
+			uint64_t last_reliable_ms = 0;
+
+			uint32_t next_sequence = 0;
+			uint32_t delivered_sequence = 0;
+		};
+
+		struct Link_State {
+			uint32_t burst_left = 0;
+
+			// When the link is next free to start sending, for the rate cap.
+			double free_at_ms = 0.0;
+
+			std::vector<Channel_Order> channels;
+		};
+
+		struct Peer_State {
+			// Bumped on connect and disconnect, held packets from an older
+			// connection are thrown away.
+			uint32_t generation = 0;
+			Link_State links[2];
+		};
+
+		uint64_t get_now_ms() const;
+		const Link_Profile& get_profile(const _ENetPeer* peer, uint64_t now_ms);
+		Peer_State& get_peer_state(_ENetPeer* peer);
+		void reset_peer(_ENetPeer* peer);
+
+		// Puts a packet on the link, working out when (and whether) it
+		// arrives. Takes over the packet either way.
+		void submit(Held held);
+
+		// Returns true if the event should go straight to the host.
+		bool hold_incoming(_ENetEvent* event);
+		void release_due();
+		bool pop_ready(_ENetEvent* event);
+		void discard(Held& held);
+
+		bool chance(float probability);
+
+		std::unique_ptr<Transport> m_inner;
+		Link_Conditioner& m_conditioner;
+		const clock::time_point m_start;
+
+		Timer_Wheel<Held> m_wheel;
+		std::unordered_map<_ENetPeer*, Peer_State> m_peers;
+
+		// Incoming events that are due, handed out one per call.
+		std::deque<_ENetEvent> m_ready;
+
+		uint64_t m_peer_scripts_version = 0;
+		Link_Conditioner::peer_scripts_t m_peer_scripts;
+
+		std::mt19937 m_rng;
+	};
+}
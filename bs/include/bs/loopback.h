@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ring_buffer.h"
+#include "transport.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	class Loopback_Transport;
+
+	struct Loopback_Datagram {
+		_ENetPacket* packet = nullptr;
+		uint8_t channel = 0;
+	};
+
+	// Both directions of one connection. Each side only pushes to the other
+	// side's queue and pops its own, so each queue has a single producer and
+	// a single consumer.
+	struct Loopback_Connection {
+		NO_COPY_NO_MOVE(Loopback_Connection);
+
+		// Per direction. Reliable sends that don't fit wait on the sender's
+		// side, unreliable ones are dropped like a full socket buffer would.
+		static constexpr size_t QUEUE_CAPACITY = 256;
+
+		enum State {
+			PENDING = 0,
+			ACCEPTED,
+			REJECTED,
+		};
+
+		enum Side {
+			CONNECTOR = 0,
+			LISTENER,
+		};
+
+		Loopback_Connection(size_t channel_count)
+			: channel_count(channel_count) {}
+		~Loopback_Connection();
+
+		const size_t channel_count;
+		std::atomic<int> state = PENDING;
+		std::atomic<bool> closed[2] = { false, false };
+
+		// Indexed by the receiving side.
+		Spsc_Ring_Buffer<Loopback_Datagram, QUEUE_CAPACITY> queues[2];
+	};
+
+	// An in-process network for hosts that live in the same process, e.g. a
+	// server and a swarm of clients in a test or benchmark. Datagrams go
+	// through a pair of lock free SPSC queues per connection, there are no
+	// sockets or syscalls and nothing is lost or reordered.
+	//
+	//   bs::Loopback_Network network;
+	//   auto* server = enet.create_server("loopback", 1234, 32, network);
+	//   auto* client = enet.create_host_client(network);
+	//   client->start("loopback", 1234);
+	//
+	// Addresses are only names here, they never touch the real network. The
+	// network has to outlive every transport created from it.
+	class Loopback_Network : public Transport_Factory {
+	public:
+		NO_COPY_NO_MOVE(Loopback_Network);
+
+		Loopback_Network() = default;
+
+		std::unique_ptr<Transport> create_server(const char* host, int32_t port, size_t max_peers, size_t channel_count) override;
+		std::unique_ptr<Transport> create_client() override;
+
+	private:
+		friend class Loopback_Transport;
+
+		bool bind(const std::string& address, Loopback_Transport* listener);
+		void unbind(const std::string& address);
+
+		// Hands a new connection to whoever is listening on the address.
+		bool connect(const std::string& address, std::shared_ptr<Loopback_Connection> connection);
+
+		std::mutex m_mutex;
+		std::unordered_map<std::string, Loopback_Transport*> m_listeners;
+	};
+
+	// One end of the loopback network, the stand in for an ENet host.
+	class Loopback_Transport : public Transport {
+	public:
+		NO_COPY_NO_MOVE(Loopback_Transport);
+
+		Loopback_Transport(Loopback_Network& network, size_t max_peers);
+		~Loopback_Transport() override;
+
+		bool listen(const char* host, int32_t port);
+
+		_ENetPeer* connect(const char* host, int32_t port, size_t channel_count) override;
+		int service(_ENetEvent* event, uint32_t timeout_ms) override;
+		int check_events(_ENetEvent* event) override;
+		bool send(_ENetPeer* peer, channel_id channel, _ENetPacket* packet) override;
+		void flush() override;
+
+		size_t get_peer_count() const override;
+		_ENetPeer* get_peer(size_t index) override;
+
+	private:
+		friend class Loopback_Network;
+
+		struct Slot {
+			std::shared_ptr<Loopback_Connection> connection;
+			Loopback_Connection::Side side = Loopback_Connection::CONNECTOR;
+			bool connected = false;
+
+			// Position in m_open_slots.
+			size_t open_index = 0;
+
+			// Reliable datagrams waiting for room in the remote queue.
+			std::deque<Loopback_Datagram> backlog;
+		};
+
+		// Called by a connecting transport, from any thread.
+		void add_pending(std::shared_ptr<Loopback_Connection> connection);
+
+		void poll();
+		void accept_pending();
+		void poll_slot(size_t index);
+		bool pop_event(_ENetEvent* event);
+
+		void open_slot(size_t index, std::shared_ptr<Loopback_Connection> connection, Loopback_Connection::Side side);
+		void close_slot(size_t index);
+
+		Loopback_Network& m_network;
+		std::string m_address;
+
+		std::vector<_ENetPeer> m_peers;
+		std::vector<Slot> m_slots;
+		std::vector<size_t> m_open_slots;
+		std::vector<size_t> m_free_slots;
+		std::vector<size_t> m_closed_slots;
+		size_t m_backlog_size = 0;
+
+		// Events found by the last poll, handed out one per call.
+		std::vector<_ENetEvent> m_events;
+		size_t m_next_event = 0;
+
+		std::mutex m_pending_mutex;
+		std::vector<std::shared_ptr<Loopback_Connection>> m_pending;
+		std::vector<std::shared_ptr<Loopback_Connection>> m_accepting;
+	};
+}
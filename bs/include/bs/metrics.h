@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base.h"
+#include "channel.h"
+#include "histogram.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// Link quality ENet tracks for a peer, copied out so it can be read
+	// without touching the peer again.
+	struct Peer_Link {
+		_ENetPeer* peer = nullptr;
+
+		uint32_t rtt_ms = 0;
+		uint32_t rtt_variance_ms = 0;
+		uint32_t last_rtt_ms = 0;
+
+		// Fraction of reliable packets lost over ENet's last loss interval.
+		float packet_loss = 0.0f;
+		float packet_loss_variance = 0.0f;
+
+		// Fraction of unreliable packets ENet currently lets through.
+		float packet_throttle = 1.0f;
+
+		uint32_t reliable_in_transit = 0;
+		uint32_t mtu = 0;
+	};
+
+	// Reads the link fields from a peer. Only call this from the thread that
+	// services the peer's host.
+	void sample_peer_link(_ENetPeer* peer, Peer_Link& out);
+
+	struct Peer_Metrics {
+		// -1 for the server peer of a Host_Client.
+		client_id id = -1;
+		Peer_Link link;
+
+		// Counted per ENet packet, like the channel stats.
+		Channel_Stats traffic;
+	};
+
+	struct Traffic_Rates {
+		double packets_sent = 0.0;
+		double bytes_sent = 0.0;
+		double packets_received = 0.0;
+		double bytes_received = 0.0;
+	};
+
+	// Link and traffic metrics for one host. The host refreshes them at the
+	// end of every tick: peers are copied in to a vector that is reused from
+	// tick to tick, the tick duration and queue depth go in to histograms and
+	// the channel stats are summed for the totals. Rates are worked out over
+	// RATE_WINDOW so they don't jump around with the tick length.
+	//
+	// The exports format whatever was last refreshed, call them from the
+	// thread that ticks the host.
+	class Metrics {
+	public:
+		NO_COPY_NO_MOVE(Metrics);
+
+		using clock = std::chrono::steady_clock;
+
+		static constexpr clock::duration RATE_WINDOW = std::chrono::seconds(1);
+
+		enum Format {
+			FORMAT_PROMETHEUS = 0,
+			FORMAT_JSON,
+		};
+
+		Metrics(const Channel_Set& channels)
+			: m_channels(channels), m_rate_start(clock::now()) {}
+
+		// Host side, called once per tick.
+		void on_tick(clock::duration tick_duration, size_t queue_depth);
+
+		// Host side, cleared and refilled each tick.
+		std::vector<Peer_Metrics>& get_peers() { return m_peers; }
+		const std::vector<Peer_Metrics>& get_peers() const { return m_peers; }
+
+		uint64_t get_tick_count() const { return m_tick_count; }
+
+		// Microseconds spent inside the host's tick().
+		const Histogram& get_tick_duration() const { return m_tick_duration; }
+
+		// Received packets waiting for the game at the end of each tick.
+		const Histogram& get_queue_depth() const { return m_queue_depth; }
+
+		const Channel_Stats& get_totals() const { return m_totals; }
+		const Traffic_Rates& get_rates() const { return m_rates; }
+
+		// Drops the histograms, the counters keep counting.
+		void clear_histograms();
+
+		// Prometheus text exposition format, every name starts with prefix.
+		std::string to_prometheus(std::string_view prefix = "bs") const;
+		std::string to_json() const;
+
+		// Writes to a temporary file and renames it over path so a scraper
+		// (e.g. node_exporter's textfile collector) never reads half a file.
+		bool write_file(const char* path, Format format) const;
+
+	private:
+		const Channel_Set& m_channels;
+
+		std::vector<Peer_Metrics> m_peers;
+
+		uint64_t m_tick_count = 0;
+		Histogram m_tick_duration;
+		Histogram m_queue_depth;
+
+		Channel_Stats m_totals;
+		Traffic_Rates m_rates;
+
+		Channel_Stats m_rate_totals;
+		clock::time_point m_rate_start;
+	};
+}
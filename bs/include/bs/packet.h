@@ -1,15 +1,22 @@
 #pragma once
 
 #include <string>
+#include <span>
 #include <vector>
-#include <deque>
 #include <utility>
 
+#include "channel.h"
+#include "ring_buffer.h"
 #include "utils.h"
 
 #include "enet_fwd.h"
 
 namespace bs {
+	// A packet shares ownership of the underlying ENet packet rather than
+	// copying its payload. Copies bump the ENet reference count and the
+	// packet is destroyed once the last owner (us or ENet) lets go of it.
+	// Our reference counting is atomic so packets can cross to the I/O
+	// thread, see Io_Thread for how ENet's own counting is kept apart.
 	class Packet {
 	public:
 		enum Type {
@@ -21,10 +28,17 @@ namespace bs {
 
 		Packet(const _ENetEvent* event);
 		Packet(_ENetPeer* peer);
-		Packet(_ENetPeer* peer, void* data, size_t data_length);
+		Packet(_ENetPeer* peer, const void* data, size_t data_length);
+		// Takes the first reference on a packet nothing else owns yet.
+		Packet(_ENetPeer* peer, _ENetPacket* packet);
 		Packet() = default;
 		~Packet();
 
+		Packet(const Packet& other);
+		Packet& operator=(const Packet& other);
+		Packet(Packet&& other) noexcept;
+		Packet& operator=(Packet&& other) noexcept;
+
 		_ENetPeer* get_peer() const { return m_peer; }
 		void set_peer(_ENetPeer* peer) { m_peer = peer; }
 
@@ -33,87 +47,84 @@ namespace bs {
 		Type get_type() const { return m_type; }
 		int32_t get_client_id() const { return m_client_id; }
 
+		// The channel a received packet arrived on.
+		channel_id get_channel() const { return m_channel; }
+
+		_ENetPacket* get_enet_packet() const { return m_packet; }
+
 		std::string get_string() const;
-		std::vector<uint8_t> get_bytes() const;
+		std::span<const uint8_t> get_bytes() const;
 
-		void set_bytes(void* data, size_t length) {
-			m_bytes.clear();
-			m_bytes.assign(reinterpret_cast<uint8_t*>(data), reinterpret_cast<uint8_t*>(data) + length);
-		}
+		// A view shares the ENet packet but only exposes length bytes from
+		// offset, it's how messages unpacked from a batch frame avoid a copy.
+		// Sending a view sends a copy of just those bytes.
+		Packet make_view(size_t offset, size_t length) const;
+		bool is_view() const { return m_view_length != 0; }
 
-		void set_bytes(const std::vector<uint8_t>& data) { m_bytes = data; }
-		void set_string(const std::string& str) { m_bytes.assign(str.begin(), str.end()); }
+		void set_bytes(const void* data, size_t length);
+		void set_bytes(std::span<const uint8_t> data) { set_bytes(data.data(), data.size()); }
+		void set_string(const std::string& str) { set_bytes(str.data(), str.size()); }
 		void set_type(Type type) { m_type = type; }
 
+		// Sends straight through ENet on the default reliable or unreliable
+		// channel. Hosts send through their Packet_Sender instead.
 		void send(bool reliable);
+		void send_to(_ENetPeer* peer, channel_id channel, Delivery delivery) const;
+
+		// Sets the flags ENet reads when the packet is queued. Only whole
+		// packets can be handed to a transport, copy views first.
+		void set_delivery(Delivery delivery) const;
+
+		static void retain(_ENetPacket* packet);
+		static void release(_ENetPacket* packet);
 
 	private:
+		void reset(_ENetPacket* packet);
+
 		int32_t m_client_id = -1;
 		Type m_type = NONE;
+		channel_id m_channel = CHANNEL_RELIABLE;
 		_ENetPeer* m_peer = nullptr;
-		std::vector<uint8_t> m_bytes;
+		_ENetPacket* m_packet = nullptr;
+		uint32_t m_view_offset = 0;
+		uint32_t m_view_length = 0;
 	};
 
-	struct Ts_Packet_Queue {
+	// FIFO of packets handed from the host's service loop (producer) to the
+	// game (consumer). It is a lock-free single producer single consumer
+	// ring so the two sides can live on different threads. When the ring is
+	// full the host stops servicing ENet until the game catches up.
+	class Ts_Packet_Queue {
 	public:
+		static constexpr size_t CAPACITY = 4096;
+
 		Ts_Packet_Queue() = default;
 		NO_COPY_NO_MOVE(Ts_Packet_Queue);
-		virtual ~Ts_Packet_Queue() {
-			clear();
-		}
-
-		Packet& front() {
-			std::scoped_lock lock(m_mutex);
-			return m_packets.front();
-		}
 
-		Packet& back() {
-			std::scoped_lock lock(m_mutex);
-			return m_packets.back();
-		}
+		bool push(Packet&& packet) { return m_packets.push(std::move(packet)); }
+		bool pop(Packet& packet) { return m_packets.pop(packet); }
 
 		Packet pop_front() {
-			std::scoped_lock lock(m_mutex);
-
-			auto result = std::move(m_packets.front());
-			m_packets.pop_front();
+			Packet result;
+			const bool popped = m_packets.pop(result);
+			ASSERT_PANIC(popped, "Trying to pop from an empty packet queue");
 			return result;
 		}
 
-		Packet pop_back() {
-			std::scoped_lock lock(m_mutex);
+		// Processes every queued packet in arrival order as one batch.
+		template <typename Fn>
+		size_t drain(Fn&& fn) { return m_packets.drain(std::forward<Fn>(fn)); }
 
-			auto result = std::move(m_packets.front());
-			m_packets.pop_back();
-			return result;
-		}
+		size_t pop_bulk(std::span<Packet> out) { return m_packets.pop_bulk(out); }
 
-		void push_back(Packet& packet) {
-			std::scoped_lock lock(m_mutex);
-			m_packets.push_back(packet);
-		}
-		void push_front(Packet& packet) {
-			std::scoped_lock lock(m_mutex);
-			m_packets.push_front(packet);
-		}
+		void clear() { m_packets.clear(); }
 
-		void clear() {
-			std::scoped_lock lock(m_mutex);
-			m_packets.clear();
-		}
-
-		size_t size() {
-			std::scoped_lock lock(m_mutex);
-			return m_packets.size();
-		}
-
-		bool empty() {
-			std::scoped_lock lock(m_mutex);
-			return m_packets.empty();
-		}
+		size_t size() const { return m_packets.size(); }
+		bool empty() const { return m_packets.empty(); }
+		bool full() const { return m_packets.full(); }
+		bool has_room_for(size_t count) const { return m_packets.size() + count <= CAPACITY; }
 
 	private:
-		std::mutex m_mutex;
-		std::deque<Packet> m_packets;
+		Spsc_Ring_Buffer<Packet, CAPACITY> m_packets;
 	};
 }
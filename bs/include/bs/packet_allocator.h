@@ -0,0 +1,41 @@
+#pragma once
+
+#include <flatbuffers/flatbuffers.h>
+
+#include "packet.h"
+#include "packet_pool.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// flatbuffers allocator that builds straight in to Packet_Pool blocks. A
+	// builder using it hands its finished buffer over as the packet payload
+	// instead of it being copied in to a new ENet packet:
+	//
+	//   flatbuffers::FlatBufferBuilder builder(Packet_Pool::BLOCK_SIZE, &allocator);
+	//   ...
+	//   builder.Finish(message);
+	//   Packet packet = allocator.release_packet(builder, peer);
+	//
+	// The builder starts the next message in a fresh block.
+	class Packet_Allocator : public flatbuffers::Allocator {
+	public:
+		Packet_Allocator(Packet_Pool& pool = Packet_Pool::get())
+			: m_pool(pool) {}
+
+		uint8_t* allocate(size_t size) override { return m_pool.allocate(size); }
+		void deallocate(uint8_t* block, size_t) override { m_pool.deallocate(block); }
+
+		// The builder must be finished and using this allocator.
+		Packet release_packet(flatbuffers::FlatBufferBuilder& builder, _ENetPeer* peer) {
+			// flatbuffers builds back to front, the message is the tail of the block.
+			size_t block_size = 0;
+			size_t offset = 0;
+			uint8_t* block = builder.ReleaseRaw(block_size, offset);
+			return m_pool.adopt(peer, block, offset, block_size - offset);
+		}
+
+	private:
+		Packet_Pool& m_pool;
+	};
+}
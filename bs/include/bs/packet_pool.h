@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "packet.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// Recycles payload blocks for packets that are serialized in place, see
+	// Packet_Allocator. A block becomes a packet's payload as it is, ENet is
+	// told not to copy it and hands the block back here when it destroys the
+	// packet. That can happen on the I/O thread so the free list is locked.
+	//
+	// Requests up to BLOCK_SIZE share recycled blocks, anything larger gets a
+	// block of its own which is freed rather than pooled.
+	class Packet_Pool {
+	public:
+		NO_COPY_NO_MOVE(Packet_Pool);
+
+		static constexpr size_t BLOCK_SIZE = 1024;
+		static constexpr size_t MAX_FREE_BLOCKS = 4096;
+
+		Packet_Pool() = default;
+		~Packet_Pool();
+
+		// Shared by the whole process. It is never destroyed so packets still
+		// queued in ENet at exit can always return their blocks.
+		static Packet_Pool& get();
+
+		uint8_t* allocate(size_t size);
+		void deallocate(uint8_t* block);
+
+		// Wraps length bytes at offset into a block from allocate() as a packet
+		// without copying them. The packet owns the block from then on.
+		Packet adopt(_ENetPeer* peer, uint8_t* block, size_t offset, size_t length);
+
+		size_t get_free_count();
+
+	private:
+		std::mutex m_mutex;
+		std::vector<uint8_t*> m_free;
+	};
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "channel.h"
+#include "packet.h"
+#include "transport.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// Packet capture for reproducing what a server went through. A
+	// Packet_Recorder attached to a Host_Server (set_recorder()) appends
+	// every message the game receives and every send it makes to a file,
+	// each tagged with the host's tick, the client and the time. The file
+	// is memory mapped so recording is a copy in to the page cache, and
+	// whatever was written survives the process dying.
+	//
+	// Packet_Recording reads one back and Packet_Replayer plays its inbound
+	// side at a host again, tick by tick, as fast as the host can take it.
+	enum Record_Direction : uint8_t {
+		// Marks the end of a recording that wasn't closed cleanly.
+		RECORD_NONE = 0,
+		RECORD_INBOUND,
+		RECORD_OUTBOUND,
+	};
+
+	// Who an outbound record was sent to, the record's id says which
+	// client or group.
+	enum Record_Target : uint8_t {
+		RECORD_TO_CLIENT = 0,
+		RECORD_TO_ALL,
+		RECORD_TO_GROUP,
+	};
+
+	// Precedes each record's payload, which is padded out to 8 bytes.
+	struct Record_Header {
+		// Since the recording started.
+		uint64_t time_ns = 0;
+		uint32_t tick = 0;
+
+		// Client id, or group id for RECORD_TO_GROUP.
+		int32_t id = -1;
+		uint32_t size = 0;
+
+		Record_Direction direction = RECORD_NONE;
+
+		// Packet::Type for inbound records.
+		uint8_t type = 0;
+		uint8_t channel = 0;
+		Record_Target target = RECORD_TO_CLIENT;
+	};
+	static_assert(sizeof(Record_Header) == 24, "Record_Header is written to disk as it is");
+
+	struct Packet_Record {
+		const Record_Header* header = nullptr;
+		std::span<const uint8_t> payload;
+	};
+
+	// Appends records to a memory mapped file, growing it as needed. The
+	// file is cut to its used size on close(). Only use it from the thread
+	// that ticks and sends through the host.
+	class Packet_Recorder {
+	public:
+		NO_COPY_NO_MOVE(Packet_Recorder);
+
+		Packet_Recorder(logger_t& logger);
+		~Packet_Recorder();
+
+		// Creates (or truncates) the file. False if it can't be mapped.
+		bool open(const char* path);
+		void close();
+		bool is_open() const { return m_data != nullptr; }
+
+		void record_inbound(uint32_t tick, const Packet& packet);
+		void record_outbound(uint32_t tick, const Packet& packet, channel_id channel, Record_Target target, int32_t id);
+
+		size_t get_record_count() const { return m_records; }
+
+		// Bytes used, headers included.
+		size_t get_size() const { return m_size; }
+
+	private:
+		void append(const Record_Header& header, std::span<const uint8_t> payload);
+		bool reserve(size_t size);
+		bool map(size_t capacity);
+		void unmap();
+
+		logger_t m_logger;
+		std::string m_path;
+
+		uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_capacity = 0;
+		size_t m_records = 0;
+
+		std::chrono::steady_clock::time_point m_start;
+
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#else
+		int m_file = -1;
+#endif
+	};
+
+	// A recording mapped read only.
+	class Packet_Recording {
+	public:
+		NO_COPY_NO_MOVE(Packet_Recording);
+
+		Packet_Recording() = default;
+		~Packet_Recording();
+
+		bool open(const char* path);
+		void close();
+		bool is_open() const { return m_data != nullptr; }
+
+		// Reads the record at offset and moves offset past it. Returns false
+		// at the end, or at a record cut short by a crash.
+		bool read(size_t& offset, Packet_Record& out) const;
+
+		// The offset of the first record.
+		size_t begin() const;
+
+		// From a scan on open().
+		size_t get_record_count() const { return m_records; }
+		uint32_t get_first_tick() const { return m_first_tick; }
+		uint32_t get_last_tick() const { return m_last_tick; }
+		uint64_t get_duration_ns() const { return m_duration_ns; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_records = 0;
+		uint32_t m_first_tick = 0;
+		uint32_t m_last_tick = 0;
+		uint64_t m_duration_ns = 0;
+
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
+
+	// Plays a recording's inbound records at a listening host. Every client
+	// in the recording gets a stand in transport of its own that connects,
+	// sends what the client sent on the tick it arrived and goes away when
+	// it disconnected. What the host sends back is received and dropped.
+	class Packet_Replayer {
+	public:
+		NO_COPY_NO_MOVE(Packet_Replayer);
+
+		// The channels have to match the host's.
+		Packet_Replayer(const Packet_Recording& recording, Transport_Factory& transports, const char* host, int32_t port, const Channel_Set& channels, logger_t& logger);
+		~Packet_Replayer();
+
+		// Plays every inbound record up to and including the recorded tick,
+		// call it before ticking the host. Returns false once everything
+		// has been played.
+		bool play_until(uint32_t tick);
+
+		bool is_done() const;
+
+		size_t get_played_count() const { return m_played; }
+		size_t get_dropped_count() const { return m_dropped; }
+		size_t get_received_count() const { return m_received; }
+
+	private:
+		struct Client {
+			std::unique_ptr<Transport> transport;
+			_ENetPeer* peer = nullptr;
+			bool connected = false;
+
+			// Sent once the connection is accepted.
+			std::deque<Packet_Record> pending;
+		};
+
+		void service(Client& client);
+		void send(Client& client, const Packet_Record& record);
+
+		const Packet_Recording& m_recording;
+		Transport_Factory& m_transports;
+		std::string m_host;
+		int32_t m_port = 0;
+		const Channel_Set& m_channels;
+		logger_t m_logger;
+
+		size_t m_offset = 0;
+		std::unordered_map<int32_t, Client> m_clients;
+
+		size_t m_played = 0;
+		size_t m_dropped = 0;
+		size_t m_received = 0;
+	};
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "batch.h"
+#include "channel.h"
+#include "io_thread.h"
+#include "packet.h"
+#include "transport.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// Every send a host makes goes through here. It owns the host's channels,
+	// looks up how each channel delivers, keeps the per channel stats and
+	// either hands the packet to ENet or queues it for the I/O thread.
+	//
+	// With batching on, sends are held back per peer and channel until flush()
+	// which packs them in to batch frames of up to max_frame_size bytes. A
+	// message on its own, or one too big for a frame, is sent as it is.
+	class Packet_Sender {
+	public:
+		NO_COPY_NO_MOVE(Packet_Sender);
+
+		Packet_Sender(logger_t& logger)
+			: m_logger(logger) {}
+
+		void send(_ENetPeer* peer, const Packet& packet, channel_id channel);
+
+		void set_batching(bool enabled, size_t max_frame_size = DEFAULT_BATCH_FRAME_SIZE);
+		bool is_batching() const { return m_batching; }
+
+		// Sends everything batched since the last flush.
+		void flush();
+
+		// Forgets anything batched for a peer that has gone away.
+		void drop(_ENetPeer* peer) { m_batches.erase(peer); }
+
+		Channel_Set& get_channels() { return m_channels; }
+		const Channel_Set& get_channels() const { return m_channels; }
+
+		// The server's peers carry their Server_Client as user data (see
+		// Server_Client_Manager), when enabled sends are counted on it too.
+		void set_client_traffic(bool enabled) { m_client_traffic = enabled; }
+
+		// The transport sends go out on, set by the host when it starts.
+		void set_transport(Transport* transport) { m_transport = transport; }
+
+		// When set, sends are queued for the I/O thread instead of going to the transport.
+		void set_io_thread(Io_Thread* io_thread) { m_io_thread = io_thread; }
+
+	private:
+		void send_now(_ENetPeer* peer, const Packet& packet, channel_id channel);
+		void flush_batch(_ENetPeer* peer, channel_id channel, std::vector<Packet>& messages);
+
+		Channel_Set m_channels;
+
+		// Pending messages for each peer, indexed by channel. The vectors are
+		// kept between flushes so they don't reallocate every tick.
+		std::unordered_map<_ENetPeer*, std::vector<std::vector<Packet>>> m_batches;
+		std::vector<uint8_t> m_frame;
+		size_t m_max_frame_size = DEFAULT_BATCH_FRAME_SIZE;
+		bool m_batching = false;
+		bool m_client_traffic = false;
+
+		Transport* m_transport = nullptr;
+		Io_Thread* m_io_thread = nullptr;
+
+		logger_t m_logger;
+	};
+}
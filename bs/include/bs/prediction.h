@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils.h"
+
+namespace bs {
+	// Client side prediction helpers. Every input the client sends is
+	// numbered and applied locally straight away instead of waiting a round
+	// trip for the server. The server echoes the last input it applied with
+	// each state update, the client then rebuilds its predicted state by
+	// replaying the inputs the server hasn't seen yet on top of the
+	// authoritative one. Sequence zero means no input.
+	using input_seq = uint32_t;
+	inline constexpr input_seq NO_INPUT = 0;
+
+	// Ring of the inputs sent but not yet acknowledged, oldest first. With
+	// more than Capacity in flight the oldest are forgotten, their effect
+	// then only shows up once the server's state includes them.
+	template <typename Input, size_t Capacity>
+	class Input_History {
+	public:
+		static constexpr size_t capacity() { return Capacity; }
+
+		// Numbers and stores an input, returns the sequence to send it with.
+		input_seq push(const Input& input) {
+			const input_seq sequence = m_next++;
+			m_entries[sequence % Capacity] = input;
+			return sequence;
+		}
+
+		// Forgets every input up to and including the sequence. Acks that
+		// arrive late or out of order are ignored.
+		void acknowledge(input_seq sequence) {
+			if (sequence > m_acknowledged && sequence < m_next) {
+				m_acknowledged = sequence;
+			}
+		}
+
+		// Calls fn(input) for every unacknowledged input, oldest first.
+		template <typename Fn>
+		void replay(Fn&& fn) const {
+			for (input_seq sequence = get_first_pending(); sequence < m_next; ++sequence) {
+				fn(m_entries[sequence % Capacity]);
+			}
+		}
+
+		// Calls fn(sequence, input) for at most the newest max_count
+		// unacknowledged inputs, oldest first. Sending these every frame
+		// unreliably gets each input through a lost packet or two.
+		template <typename Fn>
+		void replay_recent(size_t max_count, Fn&& fn) const {
+			const input_seq first = std::max(get_first_pending(), m_next - (input_seq)std::min<size_t>(max_count, m_next - 1));
+			for (input_seq sequence = first; sequence < m_next; ++sequence) {
+				fn(sequence, m_entries[sequence % Capacity]);
+			}
+		}
+
+		// Acknowledges up to the server's last applied input and returns the
+		// authoritative state with the remaining inputs applied on top, using
+		// apply(state, input) for each.
+		template <typename State, typename Fn>
+		State reconcile(const State& authoritative, input_seq last_applied, Fn&& apply) {
+			acknowledge(last_applied);
+
+			State state = authoritative;
+			replay([&](const Input& input) { apply(state, input); });
+			return state;
+		}
+
+		size_t get_pending_count() const { return m_next - get_first_pending(); }
+		input_seq get_last_sent() const { return m_next - 1; }
+		input_seq get_acknowledged() const { return m_acknowledged; }
+
+		void clear() {
+			m_acknowledged = m_next - 1;
+		}
+
+	private:
+		input_seq get_first_pending() const {
+			const input_seq oldest_kept = m_next > Capacity ? m_next - (input_seq)Capacity : 1;
+			return std::max(m_acknowledged + 1, oldest_kept);
+		}
+
+		std::array<Input, Capacity> m_entries{};
+		input_seq m_next = 1;
+		input_seq m_acknowledged = NO_INPUT;
+	};
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+
+#include "utils.h"
+
+namespace bs {
+	// Size of a cache line used to pad the producer and consumer indices
+	// away from each other so they don't false share.
+	inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+	// Bounded, lock-free, single producer single consumer FIFO. One thread
+	// may push while another pops. Indices grow without bound and are masked
+	// into the slot array, so the capacity must be a power of two. Each side
+	// keeps a cached copy of the other side's index and only touches the
+	// shared atomic when the cache says the ring is full/empty.
+	template <typename T, size_t Capacity>
+	class Spsc_Ring_Buffer {
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Ring buffer capacity must be a power of two");
+
+	public:
+		NO_COPY_NO_MOVE(Spsc_Ring_Buffer);
+
+		Spsc_Ring_Buffer()
+			: m_slots(std::make_unique<T[]>(Capacity)) {}
+
+		static constexpr size_t capacity() { return Capacity; }
+
+		// Producer side. Returns false if the ring is full.
+		template <typename U>
+		bool push(U&& value) {
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_cached_head == Capacity) {
+				m_cached_head = m_head.load(std::memory_order_acquire);
+				if (tail - m_cached_head == Capacity) {
+					return false;
+				}
+			}
+
+			m_slots[tail & MASK] = std::forward<U>(value);
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer side. Returns false if the ring is empty.
+		bool pop(T& out) {
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_cached_tail) {
+				m_cached_tail = m_tail.load(std::memory_order_acquire);
+				if (head == m_cached_tail) {
+					return false;
+				}
+			}
+
+			out = std::move(m_slots[head & MASK]);
+			m_slots[head & MASK] = T{};
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer side. Moves up to out.size() items in one go and publishes
+		// the new head once for the whole batch.
+		size_t pop_bulk(std::span<T> out) {
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			m_cached_tail = m_tail.load(std::memory_order_acquire);
+
+			const size_t count = std::min(out.size(), m_cached_tail - head);
+			for (size_t i = 0; i < count; ++i) {
+				auto& slot = m_slots[(head + i) & MASK];
+				out[i] = std::move(slot);
+				slot = T{};
+			}
+
+			m_head.store(head + count, std::memory_order_release);
+			return count;
+		}
+
+		// Consumer side. Hands every item that was available on entry to the
+		// callback in FIFO order, then releases the slots back to the producer.
+		// Items pushed while draining are left for the next call.
+		template <typename Fn>
+		size_t drain(Fn&& fn) {
+			const size_t head = m_head.load(std::memory_order_relaxed);
+			m_cached_tail = m_tail.load(std::memory_order_acquire);
+
+			for (size_t i = head; i != m_cached_tail; ++i) {
+				auto& slot = m_slots[i & MASK];
+				fn(slot);
+				slot = T{};
+			}
+
+			m_head.store(m_cached_tail, std::memory_order_release);
+			return m_cached_tail - head;
+		}
+
+		// Consumer side. Drops everything currently queued.
+		void clear() {
+			drain([](T&) {});
+		}
+
+		// These are only a snapshot when called from the other side.
+		size_t size() const {
+			// Read the head first, the tail can only have moved further ahead.
+			const size_t head = m_head.load(std::memory_order_acquire);
+			return m_tail.load(std::memory_order_acquire) - head;
+		}
+
+		bool empty() const { return size() == 0; }
+		bool full() const { return size() == Capacity; }
+
+	private:
+		static constexpr size_t MASK = Capacity - 1;
+
+		// Consumer owned.
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head = 0;
+		size_t m_cached_tail = 0;
+
+		// Producer owned.
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail = 0;
+		size_t m_cached_head = 0;
+
+		alignas(CACHE_LINE_SIZE) std::unique_ptr<T[]> m_slots;
+	};
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "utils.h"
+
+namespace bs {
+	// Rollback netcode for two players running the same deterministic
+	// simulation, GGPO style. Each side steps the game straight away with
+	// its own input and a guess at the other's (their last known input),
+	// keeps the state from the start of every frame it hasn't had the real
+	// remote input for yet, and when that input turns up different from
+	// the guess it restores the state from that frame and runs the frames
+	// since again. Local input is never delayed.
+	//
+	// Frames count up from 1, 0 means none.
+	using rollback_frame = uint32_t;
+	inline constexpr rollback_frame NO_FRAME = 0;
+
+	// FNV-1a over the value's bytes. Only meaningful for types without
+	// padding, whose bytes are all set by their fields.
+	template <typename T>
+	uint32_t checksum_bytes(const T& value) {
+		static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be checksummed by their bytes");
+
+		uint8_t bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+
+		uint32_t hash = 2166136261u;
+		for (const uint8_t byte : bytes) {
+			hash = (hash ^ byte) * 16777619u;
+		}
+		return hash;
+	}
+
+	// One side of a match. State is the whole game state, small and
+	// trivially copyable as it's saved every frame and checksummed by its
+	// bytes. Input must be comparable with ==.
+	//
+	// The local side runs at most max_prediction frames past the newest
+	// frame it has every remote input up to, then advance() stalls until
+	// more arrive. Every checksum_interval frames, once both inputs are
+	// known, the state is checksummed to exchange with the other side, see
+	// get_checksum() and add_remote_checksum().
+	template <typename State, typename Input, size_t Capacity>
+	class Rollback_Session {
+		static_assert(std::is_trivially_copyable_v<State>, "Rollback state is saved and checksummed by its bytes");
+
+	public:
+		static constexpr size_t capacity() { return Capacity; }
+
+		Rollback_Session(size_t max_prediction, rollback_frame checksum_interval)
+			: m_max_prediction(max_prediction)
+			, m_checksum_interval(checksum_interval)
+		{
+			// Each side's unacknowledged inputs and the other's frames in
+			// the future all have to fit.
+			ASSERT_PANIC(max_prediction > 0 && 2 * max_prediction + 2 < Capacity, "Rollback history of {} frames is too small to predict {} frames", Capacity, max_prediction);
+			ASSERT_PANIC(checksum_interval > 0, "Checksum interval must be at least a frame");
+		}
+
+		// Starts again from frame 1 with the given state.
+		void reset(const State& initial, const Input& remote_initial = {}) {
+			m_frames = {};
+			m_checksums = {};
+			m_remote_checksums = {};
+			m_state = initial;
+			m_frame = 1;
+			m_confirmed = NO_FRAME;
+			m_acknowledged = NO_FRAME;
+			m_checksummed = NO_FRAME;
+			m_rollback_to = NO_FRAME;
+			m_desync = NO_FRAME;
+			m_last_remote = remote_initial;
+			m_rollbacks = 0;
+			m_resimulated = 0;
+		}
+
+		// Whether advance() would run a frame rather than stall.
+		bool can_advance() const { return m_frame <= m_confirmed + m_max_prediction; }
+
+		// Runs the next frame with the local input and step(state, local,
+		// remote), after rolling back and running again from the oldest
+		// frame that was guessed wrong. Returns false without running it if
+		// that would be too far past the remote inputs, the local input is
+		// then dropped.
+		template <typename Fn>
+		bool advance(const Input& local, Fn&& step) {
+			resimulate(step);
+
+			if (!can_advance()) {
+				update_checksums();
+				return false;
+			}
+
+			auto& entry = m_frames[m_frame % Capacity];
+			entry.state = m_state;
+			entry.local = local;
+			if (entry.remote_frame != m_frame) {
+				entry.remote = m_last_remote;
+			}
+
+			step(m_state, entry.local, entry.remote);
+			m_frame++;
+
+			update_checksums();
+			return true;
+		}
+
+		// A real remote input. Frames already known are ignored, one that
+		// was run with a different guess is rolled back to on the next
+		// advance().
+		void add_remote_input(rollback_frame frame, const Input& input) {
+			if (frame <= m_confirmed || frame >= m_confirmed + Capacity) {
+				return;
+			}
+
+			auto& entry = m_frames[frame % Capacity];
+			if (entry.remote_frame == frame) {
+				return;
+			}
+
+			if (frame < m_frame && !(entry.remote == input)) {
+				m_rollback_to = m_rollback_to == NO_FRAME ? frame : std::min(m_rollback_to, frame);
+			}
+
+			entry.remote = input;
+			entry.remote_frame = frame;
+
+			// Guesses follow the newest input with none missing before it.
+			while (m_frames[(m_confirmed + 1) % Capacity].remote_frame == m_confirmed + 1) {
+				m_confirmed++;
+				m_last_remote = m_frames[m_confirmed % Capacity].remote;
+			}
+		}
+
+		// The other side has every local input up to the frame.
+		void acknowledge(rollback_frame frame) {
+			if (frame > m_acknowledged && frame < m_frame) {
+				m_acknowledged = frame;
+			}
+		}
+
+		// Calls fn(frame, input) for every local input the other side
+		// hasn't acknowledged, oldest first.
+		template <typename Fn>
+		void for_each_unacknowledged(Fn&& fn) const {
+			for (rollback_frame frame = m_acknowledged + 1; frame < m_frame; ++frame) {
+				fn(frame, m_frames[frame % Capacity].local);
+			}
+		}
+
+		// The checksum of the state after a frame, if it's one of the
+		// checksummed ones and both inputs for it are in.
+		bool get_checksum(rollback_frame frame, uint32_t& out) const {
+			const auto& entry = m_checksums[(frame / m_checksum_interval) % CHECKSUM_HISTORY];
+			if (frame == NO_FRAME || entry.frame != frame) {
+				return false;
+			}
+			out = entry.checksum;
+			return true;
+		}
+
+		// The other side's checksum for a frame, compared with ours as soon
+		// as both are known.
+		void add_remote_checksum(rollback_frame frame, uint32_t checksum) {
+			if (frame == NO_FRAME || frame % m_checksum_interval != 0) {
+				return;
+			}
+
+			m_remote_checksums[(frame / m_checksum_interval) % CHECKSUM_HISTORY] = { frame, checksum };
+			compare_checksums(frame);
+		}
+
+		// The first frame the two sides disagreed on, NO_FRAME if they
+		// haven't.
+		rollback_frame get_desync_frame() const { return m_desync; }
+
+		const State& get_state() const { return m_state; }
+
+		// The frame advance() runs next.
+		rollback_frame get_frame() const { return m_frame; }
+
+		// The newest frame with every remote input up to it.
+		rollback_frame get_confirmed_frame() const { return m_confirmed; }
+
+		rollback_frame get_acknowledged_frame() const { return m_acknowledged; }
+
+		size_t get_rollback_count() const { return m_rollbacks; }
+		size_t get_resimulated_count() const { return m_resimulated; }
+
+	private:
+		// Checksums each side remembers, a late one from the other side
+		// older than this is never compared.
+		static constexpr size_t CHECKSUM_HISTORY = 16;
+
+		struct Frame {
+			// At the start of the frame.
+			State state{};
+			Input local{};
+
+			// The real input once remote_frame matches, a guess until then.
+			Input remote{};
+			rollback_frame remote_frame = NO_FRAME;
+		};
+
+		struct Checksum {
+			rollback_frame frame = NO_FRAME;
+			uint32_t checksum = 0;
+		};
+
+		template <typename Fn>
+		void resimulate(Fn&& step) {
+			if (m_rollback_to == NO_FRAME) {
+				return;
+			}
+
+			m_rollbacks++;
+			m_state = m_frames[m_rollback_to % Capacity].state;
+			for (rollback_frame frame = m_rollback_to; frame < m_frame; ++frame) {
+				auto& entry = m_frames[frame % Capacity];
+				entry.state = m_state;
+				if (entry.remote_frame != frame) {
+					entry.remote = m_last_remote;
+				}
+
+				step(m_state, entry.local, entry.remote);
+				m_resimulated++;
+			}
+
+			m_rollback_to = NO_FRAME;
+		}
+
+		// Checksums every interval frame that has become final, its state
+		// is the one saved at the start of the frame after.
+		void update_checksums() {
+			const rollback_frame final_frame = std::min(m_confirmed, m_frame - 1);
+			rollback_frame frame = (m_checksummed / m_checksum_interval + 1) * m_checksum_interval;
+			for (; frame <= final_frame; frame += m_checksum_interval) {
+				const State& after = frame + 1 == m_frame ? m_state : m_frames[(frame + 1) % Capacity].state;
+				m_checksums[(frame / m_checksum_interval) % CHECKSUM_HISTORY] = { frame, checksum_bytes(after) };
+				m_checksummed = frame;
+				compare_checksums(frame);
+			}
+		}
+
+		void compare_checksums(rollback_frame frame) {
+			const auto& local = m_checksums[(frame / m_checksum_interval) % CHECKSUM_HISTORY];
+			const auto& remote = m_remote_checksums[(frame / m_checksum_interval) % CHECKSUM_HISTORY];
+			if (local.frame == frame && remote.frame == frame && local.checksum != remote.checksum && m_desync == NO_FRAME) {
+				m_desync = frame;
+			}
+		}
+
+		const size_t m_max_prediction;
+		const rollback_frame m_checksum_interval;
+
+		std::array<Frame, Capacity> m_frames{};
+		std::array<Checksum, CHECKSUM_HISTORY> m_checksums{};
+		std::array<Checksum, CHECKSUM_HISTORY> m_remote_checksums{};
+
+		State m_state{};
+		rollback_frame m_frame = 1;
+		rollback_frame m_confirmed = NO_FRAME;
+		rollback_frame m_acknowledged = NO_FRAME;
+		rollback_frame m_checksummed = NO_FRAME;
+
+		// Oldest frame run with a wrong guess, NO_FRAME if none.
+		rollback_frame m_rollback_to = NO_FRAME;
+		rollback_frame m_desync = NO_FRAME;
+
+		Input m_last_remote{};
+
+		size_t m_rollbacks = 0;
+		size_t m_resimulated = 0;
+	};
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "base.h"
+#include "channel.h"
+#include "packet.h"
+#include "server.h"
+#include "server_client_manager.h"
+#include "utils.h"
+
+namespace bs {
+	// A room's slot index packed with the slot's generation, the same way
+	// as a client_id, so a stale id never resolves to a reused slot.
+	using room_id = int32_t;
+	inline constexpr room_id INVALID_ROOM_ID = -1;
+
+	// Hosts many matches in one server. Each room has its own Room state, a
+	// fixed number of seats and a client group to broadcast to, and each
+	// client is routed to at most one room by its client_id.
+	//
+	// Rooms come and go with their members: join() seats a client in the
+	// oldest open room with a free seat, creating a room if there isn't one.
+	// close() stops a room taking anyone else once its match starts, and a
+	// room is torn down by destroy() or when its last member leaves. Room
+	// state is created fresh for every room.
+	//
+	// Clients that disconnect drop out of the room's group straight away but
+	// keep their seat until leave(), so call it from the disconnect handler.
+	template <typename Room>
+	class Room_Manager {
+	public:
+		NO_COPY_NO_MOVE(Room_Manager);
+
+		static constexpr size_t NO_SEAT = (size_t)-1;
+
+		static constexpr room_id make_id(uint32_t index, uint32_t generation) {
+			return (room_id)(((generation & GENERATION_MASK) << INDEX_BITS) | (index & INDEX_MASK));
+		}
+		static constexpr uint32_t get_index(room_id id) { return (uint32_t)id & INDEX_MASK; }
+		static constexpr uint32_t get_generation(room_id id) { return ((uint32_t)id >> INDEX_BITS) & GENERATION_MASK; }
+
+		Room_Manager(Host_Server& server, size_t seats_per_room)
+			: m_server(server)
+			, m_seats_per_room(seats_per_room)
+			, m_routes(server.get_client_manager().capacity())
+		{
+			ASSERT_PANIC(seats_per_room > 0, "A room needs at least one seat");
+		}
+
+		~Room_Manager() {
+			while (!m_live.empty()) {
+				destroy(make_id(m_live.back(), m_slots[m_live.back()].generation));
+			}
+		}
+
+		// Seats the client and returns its room, or the room it's already
+		// in. Returns INVALID_ROOM_ID if the client isn't connected.
+		room_id join(client_id id) {
+			if (const room_id current = get_room_id(id); current != INVALID_ROOM_ID) {
+				return current;
+			}
+
+			if (!m_server.get_client_manager().get_client(id)) {
+				return INVALID_ROOM_ID;
+			}
+
+			const uint32_t index = find_open_slot();
+			auto& slot = m_slots[index];
+
+			size_t seat = 0;
+			while (slot.seats[seat] != INVALID_CLIENT) {
+				seat++;
+			}
+
+			slot.seats[seat] = id;
+			slot.seated++;
+			m_server.get_client_manager().add_to_group(slot.group, id);
+			m_routes[Server_Client_Manager::get_index(id)] = { id, make_id(index, slot.generation), seat };
+
+			return make_id(index, slot.generation);
+		}
+
+		// Frees the client's seat and returns the room it was in. The room
+		// is destroyed if that was its last member.
+		room_id leave(client_id id) {
+			const room_id room = get_room_id(id);
+			if (room == INVALID_ROOM_ID) {
+				return INVALID_ROOM_ID;
+			}
+
+			auto& route = m_routes[Server_Client_Manager::get_index(id)];
+			auto& slot = m_slots[get_index(room)];
+
+			slot.seats[route.seat] = INVALID_CLIENT;
+			slot.seated--;
+			m_server.get_client_manager().remove_from_group(slot.group, id);
+			route = {};
+
+			if (slot.seated == 0) {
+				destroy(room);
+			}
+			else if (slot.open && !slot.queued) {
+				slot.queued = true;
+				m_open.push_back(get_index(room));
+			}
+
+			return room;
+		}
+
+		// Nobody else is seated in the room, even when a seat frees up.
+		void close(room_id room) {
+			if (auto* slot = get_slot(room)) {
+				slot->open = false;
+			}
+		}
+
+		// Tears the room down. Its members are left without a room.
+		void destroy(room_id room) {
+			auto* slot = get_slot(room);
+			if (!slot) {
+				return;
+			}
+
+			for (auto& seated : slot->seats) {
+				if (seated != INVALID_CLIENT) {
+					m_routes[Server_Client_Manager::get_index(seated)] = {};
+					seated = INVALID_CLIENT;
+				}
+			}
+
+			m_server.get_client_manager().destroy_group(slot->group);
+			slot->group = INVALID_GROUP_ID;
+			slot->room.reset();
+			slot->alive = false;
+			slot->open = false;
+			slot->seated = 0;
+
+			// Drop its place in the open queue so a reuse of the slot can't
+			// be handed out through the old entry as well as its own.
+			const uint32_t index = get_index(room);
+			if (slot->queued) {
+				m_open.erase(std::remove(m_open.begin(), m_open.end(), index), m_open.end());
+				slot->queued = false;
+			}
+			slot->generation = (slot->generation + 1) & GENERATION_MASK;
+
+			// Swap the last live room in to the gap.
+			m_live[slot->live_index] = m_live.back();
+			m_slots[m_live.back()].live_index = slot->live_index;
+			m_live.pop_back();
+
+			m_free_slots.push_back(index);
+		}
+
+		Room* get(room_id room) {
+			auto* slot = get_slot(room);
+			return slot ? slot->room.get() : nullptr;
+		}
+
+		room_id get_room_id(client_id id) const {
+			const auto* route = get_route(id);
+			return route ? route->room : INVALID_ROOM_ID;
+		}
+
+		size_t get_seat(client_id id) const {
+			const auto* route = get_route(id);
+			return route ? route->seat : NO_SEAT;
+		}
+
+		// The client in the seat, INVALID_CLIENT if it's empty.
+		client_id get_seated(room_id room, size_t seat) const {
+			const auto* slot = get_slot(room);
+			return slot && seat < m_seats_per_room ? slot->seats[seat] : INVALID_CLIENT;
+		}
+
+		size_t get_seated_count(room_id room) const {
+			const auto* slot = get_slot(room);
+			return slot ? slot->seated : 0;
+		}
+
+		bool is_open(room_id room) const {
+			const auto* slot = get_slot(room);
+			return slot && slot->open;
+		}
+
+		std::span<Server_Client* const> get_members(room_id room) const {
+			const auto* slot = get_slot(room);
+			return slot ? m_server.get_client_manager().get_group_members(slot->group) : std::span<Server_Client* const>{};
+		}
+
+		// Shares the one packet between the room's connected members.
+		void broadcast(room_id room, const Packet& packet, channel_id channel) {
+			if (const auto* slot = get_slot(room)) {
+				m_server.broadcast_to_group(slot->group, packet, channel);
+			}
+		}
+
+		void broadcast(room_id room, const Packet& packet, bool reliable) { broadcast(room, packet, get_default_channel(reliable)); }
+
+		// Calls fn(room_id, Room&) for every room. fn must not create or
+		// destroy rooms.
+		template <typename Fn>
+		void for_each(Fn&& fn) {
+			for (const uint32_t index : m_live) {
+				auto& slot = m_slots[index];
+				fn(make_id(index, slot.generation), *slot.room);
+			}
+		}
+
+		// Live rooms by position, 0 to size() - 1, e.g. to split them over
+		// a Job_System. Positions change as rooms are destroyed.
+		Room& get_at(size_t position) { return *m_slots[m_live[position]].room; }
+
+		size_t size() const { return m_live.size(); }
+		bool empty() const { return m_live.empty(); }
+		size_t get_seats_per_room() const { return m_seats_per_room; }
+
+	private:
+		static constexpr client_id INVALID_CLIENT = -1;
+
+		static constexpr uint32_t INDEX_BITS = 20;
+		static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+		// One bit short so ids are never negative.
+		static constexpr uint32_t GENERATION_MASK = (1u << (31 - INDEX_BITS)) - 1;
+
+		struct Slot {
+			std::unique_ptr<Room> room;
+			group_id group = INVALID_GROUP_ID;
+			uint32_t generation = 0;
+
+			std::vector<client_id> seats;
+			size_t seated = 0;
+
+			// Position in m_live.
+			uint32_t live_index = 0;
+
+			bool alive = false;
+			bool open = false;
+
+			// Already waiting in m_open.
+			bool queued = false;
+		};
+
+		struct Route {
+			client_id client = INVALID_CLIENT;
+			room_id room = INVALID_ROOM_ID;
+			size_t seat = NO_SEAT;
+		};
+
+		Slot* get_slot(room_id room) {
+			const uint32_t index = get_index(room);
+			if (room < 0 || index >= m_slots.size() || !m_slots[index].alive || m_slots[index].generation != get_generation(room)) {
+				return nullptr;
+			}
+			return &m_slots[index];
+		}
+
+		const Slot* get_slot(room_id room) const {
+			return const_cast<Room_Manager*>(this)->get_slot(room);
+		}
+
+		const Route* get_route(client_id id) const {
+			const uint32_t index = Server_Client_Manager::get_index(id);
+			if (id < 0 || index >= m_routes.size() || m_routes[index].client != id) {
+				return nullptr;
+			}
+			return &m_routes[index];
+		}
+
+		// The oldest open room with a free seat, otherwise a new room. Rooms
+		// that filled up or closed since they were queued are skipped.
+		uint32_t find_open_slot() {
+			while (!m_open.empty()) {
+				const uint32_t index = m_open.front();
+				auto& slot = m_slots[index];
+				if (slot.alive && slot.open && slot.seated < m_seats_per_room) {
+					return index;
+				}
+
+				slot.queued = false;
+				m_open.pop_front();
+			}
+
+			uint32_t index = 0;
+			if (!m_free_slots.empty()) {
+				index = m_free_slots.back();
+				m_free_slots.pop_back();
+			}
+			else {
+				ASSERT_PANIC(m_slots.size() <= INDEX_MASK, "Too many rooms for the room id index: {}", m_slots.size());
+				index = (uint32_t)m_slots.size();
+				m_slots.emplace_back();
+			}
+
+			auto& slot = m_slots[index];
+			slot.room = std::make_unique<Room>();
+			slot.group = m_server.get_client_manager().create_group();
+			slot.seats.assign(m_seats_per_room, INVALID_CLIENT);
+			slot.seated = 0;
+			slot.alive = true;
+			slot.open = true;
+			slot.live_index = (uint32_t)m_live.size();
+			m_live.push_back(index);
+
+			// Nothing else is open, the queue was emptied above.
+			if (!slot.queued) {
+				slot.queued = true;
+				m_open.push_back(index);
+			}
+
+			return index;
+		}
+
+		Host_Server& m_server;
+		const size_t m_seats_per_room;
+
+		std::vector<Slot> m_slots;
+		std::vector<uint32_t> m_free_slots;
+
+		// Live rooms densely packed for iteration.
+		std::vector<uint32_t> m_live;
+
+		// Rooms that had a free seat when they were queued, oldest first.
+		std::deque<uint32_t> m_open;
+
+		// Indexed by the client_id's slot index, the same as the clients.
+		std::vector<Route> m_routes;
+	};
+}
@@ -3,9 +3,15 @@
 
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <string>
 
 #include "server_client_manager.h"
+#include "io_thread.h"
+#include "metrics.h"
+#include "packet_recording.h"
+#include "packet_sender.h"
+#include "transport.h"
 #include "base.h"
 #include "packet.h"
 #include "utils.h"
@@ -17,7 +23,16 @@ namespace bs {
 	public:
 		NO_COPY_NO_MOVE(Host_Server);
 
-		Host_Server(const char* host, int32_t port, int32_t max_clients, logger_t& logger);
+		// IO_INLINE services ENet from tick() on the calling thread. IO_THREADED
+		// hands the ENet host to a dedicated I/O thread, tick() then only drains
+		// what that thread received and sends are queued for it to flush.
+		enum Io_Mode {
+			IO_INLINE = 0,
+			IO_THREADED,
+		};
+
+		// The transport is created on start(), by default a real UDP socket.
+		Host_Server(const char* host, int32_t port, int32_t max_clients, logger_t& logger, Transport_Factory& transports = Transport_Factory::get_enet());
 		~Host_Server();
 
 		void set_logger(logger_t& logger) {
@@ -28,28 +43,71 @@ namespace bs {
 			return m_logger;
 		}
 
-		void start();
+		void start(Io_Mode io_mode = IO_INLINE);
 		void tick(uint32_t timeout_ms);
 
-		void broadcast_to_clients(const Packet& packet, bool reliable);
+		Io_Mode get_io_mode() const { return m_io_mode; }
+
+		// Counts calls to tick(), it's what recorded packets are tagged with.
+		uint32_t get_tick() const { return m_tick; }
+
+		// Records every packet handed to the game and every send from here on,
+		// null stops. The recorder has to outlive the server or be unset.
+		void set_recorder(Packet_Recorder* recorder) { m_recorder = recorder; }
+
+		// Use these rather than Packet::send so sends work in either I/O mode.
+		void send(const Packet& packet, channel_id channel);
+		void broadcast_to_clients(const Packet& packet, channel_id channel);
+		void broadcast_to_group(group_id group, const Packet& packet, channel_id channel);
+
+		void send(const Packet& packet, bool reliable) { send(packet, get_default_channel(reliable)); }
+		void broadcast_to_clients(const Packet& packet, bool reliable) { broadcast_to_clients(packet, get_default_channel(reliable)); }
+		void broadcast_to_group(group_id group, const Packet& packet, bool reliable) { broadcast_to_group(group, packet, get_default_channel(reliable)); }
+
+		// Holds sends back until flush() and packs them in to a frame per
+		// client and channel. tick() flushes anything still pending, call
+		// flush() once the tick's sends are done to get them out sooner.
+		void set_batching(bool enabled, size_t max_frame_size = DEFAULT_BATCH_FRAME_SIZE) { m_sender.set_batching(enabled, max_frame_size); }
+		void flush() { m_sender.flush(); }
+
+		// Declare any extra channels before start(), clients must match them.
+		Channel_Set& get_channels() { return m_sender.get_channels(); }
 
 		Ts_Packet_Queue& get_packets() { return m_packets; }
 
 		Server_Client_Manager& get_client_manager() { return m_client_manager; }
 
+		// Refreshed at the end of every tick(), one peer per connected client.
+		const Metrics& get_metrics() const { return m_metrics; }
+		Metrics& get_metrics() { return m_metrics; }
+
 	private:
 		void on_client_connect(Packet& packet);
 		void on_client_disconnect(Packet& packet);
+		void on_packet(Packet&& packet);
+		void push_packet(Packet&& packet);
+		void update_metrics(Metrics::clock::time_point tick_start);
 
-		_ENetHost* m_server = nullptr;
+		Transport_Factory& m_transports;
+		std::unique_ptr<Transport> m_transport;
 		logger_t m_logger;
 
 		const char* m_host;
 		int32_t m_port = 0;
 		int32_t m_max_clients = 0;
 
+		Packet_Sender m_sender;
 		Server_Client_Manager m_client_manager;
 
 		Ts_Packet_Queue m_packets;
+
+		Io_Mode m_io_mode = IO_INLINE;
+		Io_Thread m_io_thread;
+
+		Metrics m_metrics;
+		std::vector<Peer_Link> m_links;
+
+		uint32_t m_tick = 0;
+		Packet_Recorder* m_recorder = nullptr;
 	};
 }
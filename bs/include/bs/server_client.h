@@ -1,6 +1,7 @@
 #pragma once
 
 #include "base.h"
+#include "channel.h"
 #include "utils.h"
 
 #include <spdlog/spdlog.h>
@@ -20,9 +21,24 @@ namespace bs {
 
 		_ENetPeer* get_peer() const { return m_peer; }
 
+		// Traffic with this client across every channel, per ENet packet.
+		const Channel_Stats& get_traffic() const { return m_traffic; }
+
+		void on_sent(size_t bytes) {
+			m_traffic.packets_sent++;
+			m_traffic.bytes_sent += bytes;
+		}
+
+		void on_received(size_t bytes) {
+			m_traffic.packets_received++;
+			m_traffic.bytes_received += bytes;
+		}
+
 	private:
 		_ENetPeer* m_peer = nullptr;
+		Channel_Stats m_traffic;
 	};
 
-	using server_client_ptr = std::shared_ptr<Server_Client>;
+	// Clients are owned by the Server_Client_Manager's slot table.
+	using server_client_ptr = Server_Client*;
 }
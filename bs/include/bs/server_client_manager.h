@@ -2,53 +2,115 @@
 #include "server_client.h"
 #include "utils.h"
 #include "packet.h"
+#include "packet_sender.h"
 
 #include <spdlog/logger.h>
 
-#include <unordered_map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "enet_fwd.h"
 
 namespace bs {
+	// Index of a client group. Ids are reused once a group is destroyed.
+	using group_id = int32_t;
+	inline constexpr group_id INVALID_GROUP_ID = -1;
+
+	// Clients live in a fixed table of slots sized to the server's max clients.
+	// A client_id packs the slot index with the slot's generation, which is
+	// bumped every time the slot is freed, so a stale id never resolves to the
+	// client that reused its slot. The peer's user data points straight at its
+	// client so lookups from incoming packets don't hash anything, and the
+	// connected clients are also kept densely packed for iteration.
 	class Server_Client_Manager {
 	public:
 		NO_COPY_NO_MOVE(Server_Client_Manager);
 
-		Server_Client_Manager(logger_t& logger)
-			: m_logger(logger) {}
+		Server_Client_Manager(size_t max_clients, Packet_Sender& sender, logger_t& logger);
+
+		static constexpr client_id make_id(uint32_t index, uint32_t generation) {
+			return (client_id)(((generation & GENERATION_MASK) << INDEX_BITS) | (index & INDEX_MASK));
+		}
+		static constexpr uint32_t get_index(client_id id) { return (uint32_t)id & INDEX_MASK; }
+		static constexpr uint32_t get_generation(client_id id) { return ((uint32_t)id >> INDEX_BITS) & GENERATION_MASK; }
 
 		server_client_ptr add_client(_ENetPeer* peer);
-		void disconnect_client(const _ENetPeer* peer);
+		void disconnect_client(_ENetPeer* peer);
 
-		server_client_ptr get_client(_ENetPeer* peer) {
-			if (m_clients.find(peer) != m_clients.end()) {
-				return m_clients[peer];
-			}
+		server_client_ptr get_client(const _ENetPeer* peer) const;
+		server_client_ptr get_client(client_id id) const;
 
-			return nullptr;
-		}
+		std::span<Server_Client* const> get_connected_clients() const { return m_connected; }
 
-		auto get_connected_clients() const {
-			std::vector<server_client_ptr> clients;
-			for (auto& [_, client] : m_clients) {
-				if (client->get_state() == Base_Client::CONNECTED) {
-					clients.push_back(client);
-				}
-			}
-			return clients;
-		}
+		bool empty() const { return m_connected.empty(); }
+		size_t size() const { return m_connected.size(); }
+		size_t capacity() const { return m_capacity; }
+
+		// Groups are recipient sets such as a match, a team or its spectators.
+		// A client can be in any number of groups and leaves all of them when
+		// it disconnects, so groups only ever hold connected clients.
+		group_id create_group(std::string_view name = {});
+		void destroy_group(group_id group);
+		group_id find_group(std::string_view name) const;
+
+		bool add_to_group(group_id group, client_id id);
+		bool remove_from_group(group_id group, client_id id);
+
+		std::span<Server_Client* const> get_group_members(group_id group) const;
+
+		// Every broadcast shares the one ENet packet held by the bs::Packet
+		// between all of its recipients, nothing is copied per client.
+		void broadcast_to_clients(const Packet& packet, channel_id channel);
+		void broadcast_to_group(group_id group, const Packet& packet, channel_id channel);
+		void broadcast_to_client(server_client_ptr& client, const Packet& packet, channel_id channel);
+		void broadcast_to_client(client_id id, const Packet& packet, channel_id channel);
 
-		bool empty() const { return m_clients.empty(); }
-		bool size() const { return m_clients.size(); }
+		void broadcast_to_clients(const Packet& packet, bool reliable) { broadcast_to_clients(packet, get_default_channel(reliable)); }
+		void broadcast_to_group(group_id group, const Packet& packet, bool reliable) { broadcast_to_group(group, packet, get_default_channel(reliable)); }
+		void broadcast_to_client(server_client_ptr& client, const Packet& packet, bool reliable) { broadcast_to_client(client, packet, get_default_channel(reliable)); }
+		void broadcast_to_client(client_id id, const Packet& packet, bool reliable) { broadcast_to_client(id, packet, get_default_channel(reliable)); }
 
-		void broadcast_to_clients(const Packet& packet, bool reliable);
-		void broadcast_to_client(server_client_ptr& client, const Packet& packet, bool reliable);
-		void broadcast_to_client(client_id& id, const Packet& packet, bool reliable);
 	private:
-		void send(server_client_ptr client, _ENetPacket* packet);
-		_ENetPacket* create_enet_packet(const Packet& packet, bool reliable);
+		static constexpr uint32_t INDEX_BITS = 16;
+		static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+		// One bit short so ids are never negative.
+		static constexpr uint32_t GENERATION_MASK = (1u << (31 - INDEX_BITS)) - 1;
+
+		struct Slot {
+			std::optional<Server_Client> client;
+			uint32_t generation = 0;
+			uint32_t connected_index = 0;
+
+			// Groups this client is a member of.
+			std::vector<group_id> groups;
+		};
+
+		struct Group {
+			std::string name;
+			std::vector<Server_Client*> members;
+			bool alive = false;
+		};
+
+		Group* get_group(group_id group);
+		const Group* get_group(group_id group) const;
+		void erase_member(Group& group, Server_Client* client);
+
+		void send(const server_client_ptr& client, const Packet& packet, channel_id channel);
+
+		std::unique_ptr<Slot[]> m_slots;
+		size_t m_capacity = 0;
+
+		std::vector<uint32_t> m_free_slots;
+		std::vector<Server_Client*> m_connected;
+
+		std::vector<Group> m_groups;
+		std::vector<group_id> m_free_groups;
 
-		std::unordered_map<_ENetPeer*, server_client_ptr> m_clients;
+		Packet_Sender& m_sender;
 		logger_t m_logger;
 	};
 }
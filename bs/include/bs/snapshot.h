@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "utils.h"
+
+namespace bs {
+	// Snapshot replication helpers. Game state is quantized into integers,
+	// each snapshot is stored by sequence number on both ends and sent as a
+	// delta against the last snapshot the client acknowledged. A baseline of
+	// zero means "no baseline", the snapshot is then encoded against a
+	// default constructed one which is the full state.
+	using snapshot_seq = uint32_t;
+	inline constexpr snapshot_seq NO_BASELINE = 0;
+
+	// Maps a float in [min, max] on to an unsigned integer of the given bit
+	// width. Values outside the range are clamped.
+	inline uint32_t quantize(float value, float min, float max, uint32_t bits) {
+		const uint32_t steps = (1u << bits) - 1;
+		const float t = (std::clamp(value, min, max) - min) / (max - min);
+		return (uint32_t)std::lround(t * (float)steps);
+	}
+
+	inline float dequantize(uint32_t value, float min, float max, uint32_t bits) {
+		const uint32_t steps = (1u << bits) - 1;
+		return min + (float)value / (float)steps * (max - min);
+	}
+
+	// Packs values of arbitrary bit widths, least significant bit first.
+	class Bit_Writer {
+	public:
+		void write(uint32_t value, uint32_t bits) {
+			ASSERT_PANIC(bits <= 32, "Can't write more than 32 bits at once: {}", bits);
+
+			m_scratch |= (uint64_t)(value & mask(bits)) << m_scratch_bits;
+			m_scratch_bits += bits;
+
+			while (m_scratch_bits >= 8) {
+				m_bytes.push_back((uint8_t)m_scratch);
+				m_scratch >>= 8;
+				m_scratch_bits -= 8;
+			}
+		}
+
+		void write_bool(bool value) { write(value ? 1 : 0, 1); }
+
+		// Writes a changed bit, followed by the value only if it differs from
+		// the baseline.
+		void write_delta(uint32_t baseline, uint32_t value, uint32_t bits) {
+			write_bool(baseline != value);
+			if (baseline != value) {
+				write(value, bits);
+			}
+		}
+
+		// Flushes the partial byte and returns the packed bytes.
+		std::span<const uint8_t> finish() {
+			if (m_scratch_bits > 0) {
+				m_bytes.push_back((uint8_t)m_scratch);
+				m_scratch = 0;
+				m_scratch_bits = 0;
+			}
+			return m_bytes;
+		}
+
+		void clear() {
+			m_bytes.clear();
+			m_scratch = 0;
+			m_scratch_bits = 0;
+		}
+
+	private:
+		static uint64_t mask(uint32_t bits) { return bits == 32 ? 0xFFFFFFFFull : ((1ull << bits) - 1); }
+
+		std::vector<uint8_t> m_bytes;
+		uint64_t m_scratch = 0;
+		uint32_t m_scratch_bits = 0;
+	};
+
+	class Bit_Reader {
+	public:
+		Bit_Reader(std::span<const uint8_t> bytes)
+			: m_bytes(bytes) {}
+
+		// Reading past the end yields zeroes and marks the reader as overflowed.
+		uint32_t read(uint32_t bits) {
+			while (m_scratch_bits < bits) {
+				uint64_t next = 0;
+				if (m_position < m_bytes.size()) {
+					next = m_bytes[m_position++];
+				}
+				else {
+					m_overflowed = true;
+				}
+				m_scratch |= next << m_scratch_bits;
+				m_scratch_bits += 8;
+			}
+
+			const uint32_t value = (uint32_t)(m_scratch & (bits == 32 ? 0xFFFFFFFFull : ((1ull << bits) - 1)));
+			m_scratch >>= bits;
+			m_scratch_bits -= bits;
+			return value;
+		}
+
+		bool read_bool() { return read(1) != 0; }
+
+		uint32_t read_delta(uint32_t baseline, uint32_t bits) {
+			return read_bool() ? read(bits) : baseline;
+		}
+
+		bool overflowed() const { return m_overflowed; }
+
+	private:
+		std::span<const uint8_t> m_bytes;
+		size_t m_position = 0;
+		uint64_t m_scratch = 0;
+		uint32_t m_scratch_bits = 0;
+		bool m_overflowed = false;
+	};
+
+	// Ring of the last Capacity snapshots indexed by sequence. A lookup only
+	// succeeds while the slot still holds that exact sequence.
+	template <typename Snapshot, size_t Capacity>
+	class Snapshot_Buffer {
+	public:
+		static constexpr size_t capacity() { return Capacity; }
+
+		void insert(snapshot_seq sequence, const Snapshot& snapshot) {
+			ASSERT_PANIC(sequence != NO_BASELINE, "Snapshot sequence 0 is reserved for no baseline");
+
+			auto& entry = m_entries[sequence % Capacity];
+			entry.sequence = sequence;
+			entry.snapshot = snapshot;
+		}
+
+		const Snapshot* find(snapshot_seq sequence) const {
+			if (sequence == NO_BASELINE) {
+				return &m_empty;
+			}
+
+			const auto& entry = m_entries[sequence % Capacity];
+			return entry.sequence == sequence ? &entry.snapshot : nullptr;
+		}
+
+		// Whether a baseline is still recent enough that the other end is
+		// guaranteed to have it, given both ends keep Capacity snapshots.
+		static bool in_window(snapshot_seq current, snapshot_seq baseline) {
+			return baseline != NO_BASELINE && baseline < current && current - baseline < Capacity;
+		}
+
+		void clear() { m_entries = {}; }
+
+	private:
+		struct Entry {
+			snapshot_seq sequence = NO_BASELINE;
+			Snapshot snapshot{};
+		};
+
+		std::array<Entry, Capacity> m_entries{};
+		Snapshot m_empty{};
+	};
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "histogram.h"
+#include "utils.h"
+
+namespace bs {
+	// Runs a fixed simulation step at a set rate on the monotonic clock, so a
+	// server doesn't need a window's frame limiter to pace itself. Waiting
+	// sleeps until just before the deadline and spins the rest of the way,
+	// which keeps idle CPU low without inheriting the OS sleep granularity.
+	//
+	// If the step falls behind it runs the missed ticks back to back, up to
+	// max_catch_up_steps per wake. Past that the missed ticks are dropped and
+	// the schedule restarts from now instead of spiralling.
+	class Tick_Scheduler {
+	public:
+		NO_COPY_NO_MOVE(Tick_Scheduler);
+
+		using clock = std::chrono::steady_clock;
+
+		struct Config {
+			uint32_t tick_rate = 60;
+			uint32_t max_catch_up_steps = 5;
+
+			// How long before a deadline to stop sleeping and start spinning.
+			std::chrono::microseconds spin_threshold = std::chrono::microseconds(1000);
+		};
+
+		Tick_Scheduler(const Config& config, logger_t& logger);
+
+		// Calls step(tick) at the configured rate until stop() is called.
+		template <typename Fn>
+		void run(Fn&& step) {
+			m_running.store(true, std::memory_order_release);
+			while (is_running()) {
+				advance(step);
+			}
+		}
+
+		// Waits for the next deadline then runs every step that is due.
+		// Returns how many ran. Use this to interleave other work, such as
+		// rendering, between ticks.
+		template <typename Fn>
+		uint32_t advance(Fn&& step) {
+			wait();
+
+			const uint32_t due = get_due_steps();
+			for (uint32_t i = 0; i < due; ++i) {
+				const auto start = clock::now();
+				step(m_tick++);
+				record_step(clock::now() - start);
+			}
+
+			return due;
+		}
+
+		// Safe to call from another thread or from inside the step.
+		void stop() { m_running.store(false, std::memory_order_release); }
+		bool is_running() const { return m_running.load(std::memory_order_acquire); }
+
+		// Restarts the schedule from now, e.g. after a long pause.
+		void reset();
+
+		uint64_t get_tick() const { return m_tick; }
+		clock::duration get_step_duration() const { return m_step; }
+		float get_step_seconds() const { return std::chrono::duration<float>(m_step).count(); }
+		const Config& get_config() const { return m_config; }
+
+		// Microseconds each wake happened after its deadline. Only recorded
+		// when the scheduler actually had to wait.
+		const Histogram& get_drift() const { return m_drift; }
+
+		// Microseconds a step overran the tick length by, only recorded for
+		// steps that did overrun.
+		const Histogram& get_overrun() const { return m_overrun; }
+
+		uint64_t get_dropped_ticks() const { return m_dropped_ticks; }
+
+		void log_stats();
+		void clear_stats();
+
+	private:
+		void wait();
+		uint32_t get_due_steps();
+		void record_step(clock::duration elapsed);
+
+		Config m_config;
+		clock::duration m_step;
+		clock::time_point m_next_tick;
+		uint64_t m_tick = 0;
+
+		Histogram m_drift;
+		Histogram m_overrun;
+		uint64_t m_dropped_ticks = 0;
+
+		std::atomic<bool> m_running = false;
+
+		logger_t m_logger;
+	};
+}
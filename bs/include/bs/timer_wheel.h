@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+namespace bs {
+	// Hashed timing wheel. Time is counted in whole ticks (whatever unit the
+	// owner picks) and each tick hashes to one slot, so scheduling is O(1)
+	// and advancing only visits the slots for the ticks that passed.
+	// Deadlines more than a turn of the wheel away share a slot with nearer
+	// ones and are skipped until their own turn comes round.
+	//
+	// Entries fire in deadline order, entries with the same deadline in the
+	// order they were scheduled.
+	template <typename T, size_t Slot_Count = 1024>
+	class Timer_Wheel {
+		static_assert(Slot_Count >= 2 && (Slot_Count & (Slot_Count - 1)) == 0, "Timer wheel slot count must be a power of two");
+
+	public:
+		NO_COPY_NO_MOVE(Timer_Wheel);
+
+		using tick_t = uint64_t;
+
+		Timer_Wheel(tick_t now = 0)
+			: m_now(now) {}
+
+		// Deadlines in the past fire on the next advance().
+		void schedule(tick_t deadline, T value) {
+			deadline = std::max(deadline, m_now);
+			m_slots[deadline & MASK].push_back({ deadline, std::move(value) });
+			m_size++;
+		}
+
+		// Fires everything due up to and including now. fn must not schedule
+		// in to the wheel. After a stall of more than a turn the ticks older
+		// than a turn are folded in to the first slot visited.
+		template <typename Fn>
+		void advance(tick_t now, Fn&& fn) {
+			if (now < m_now) {
+				return;
+			}
+
+			tick_t tick = (now - m_now >= Slot_Count) ? now - Slot_Count + 1 : m_now;
+			for (; tick <= now && m_size > 0; ++tick) {
+				fire_slot(tick, fn);
+			}
+
+			// The current tick is visited again next time, anything scheduled
+			// for it after this still fires promptly.
+			m_now = now;
+		}
+
+		// Hands every entry to fn without waiting for its deadline, e.g. to
+		// free what's still scheduled on shutdown.
+		template <typename Fn>
+		void drain(Fn&& fn) {
+			for (auto& slot : m_slots) {
+				for (auto& entry : slot) {
+					fn(entry.value);
+				}
+				slot.clear();
+			}
+
+			m_size = 0;
+		}
+
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		// The tick the wheel has advanced to.
+		tick_t get_now() const { return m_now; }
+
+	private:
+		static constexpr size_t MASK = Slot_Count - 1;
+
+		struct Entry {
+			tick_t deadline;
+			T value;
+		};
+
+		template <typename Fn>
+		void fire_slot(tick_t tick, Fn& fn) {
+			auto& slot = m_slots[tick & MASK];
+
+			// Fire in place and close the gaps behind, keeping the order of
+			// whatever waits for a later turn.
+			size_t kept = 0;
+			for (size_t i = 0; i < slot.size(); ++i) {
+				if (slot[i].deadline <= tick) {
+					fn(slot[i].value);
+					m_size--;
+				}
+				else {
+					if (kept != i) {
+						slot[kept] = std::move(slot[i]);
+					}
+					kept++;
+				}
+			}
+
+			slot.erase(slot.begin() + kept, slot.end());
+		}
+
+		std::array<std::vector<Entry>, Slot_Count> m_slots;
+		size_t m_size = 0;
+		tick_t m_now = 0;
+	};
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "channel.h"
+#include "utils.h"
+
+#include "enet_fwd.h"
+
+namespace bs {
+	// What a host sits on: the subset of an ENet host that Host_Server,
+	// Host_Client and Io_Thread use. The calls keep ENet's semantics so the
+	// hosts read the same whichever transport is underneath:
+	//   - peers are ENetPeers owned by the transport, their user data is ours;
+	//   - received packets are handed over with no references, like ENet's;
+	//   - send() takes its own reference on the packet and the packet's flags
+	//     pick the delivery.
+	// A transport is only ever used from one thread at a time.
+	class Transport {
+	public:
+		virtual ~Transport() = default;
+
+		// Starts connecting to a listening transport, a CONNECT event follows.
+		virtual _ENetPeer* connect(const char* host, int32_t port, size_t channel_count) = 0;
+
+		// Sends anything queued then waits up to timeout_ms for an event. Like
+		// enet_host_service it returns 1 for an event, 0 for none, < 0 on error.
+		virtual int service(_ENetEvent* event, uint32_t timeout_ms) = 0;
+
+		// Returns events that have already arrived without waiting or sending.
+		virtual int check_events(_ENetEvent* event) = 0;
+
+		virtual bool send(_ENetPeer* peer, channel_id channel, _ENetPacket* packet) = 0;
+		virtual void flush() = 0;
+
+		// Every peer slot, connected or not, so link stats can be sampled.
+		virtual size_t get_peer_count() const = 0;
+		virtual _ENetPeer* get_peer(size_t index) = 0;
+
+		// Packet::send and send_to go straight to ENet, which is only right for
+		// the peers of an ENet host nothing else stands in front of. Whatever
+		// does (a Link_Conditioner, an I/O thread servicing the host) claims
+		// the transport while it's there. Claims nest and are released in
+		// reverse, a transport with no ENet host underneath ignores them.
+		virtual void claim(const char*) {}
+		virtual void release(const char*) {}
+	};
+
+	// The last claim on the Enet_Transport that owns the host, null if there
+	// is none. Only debug builds keep track of which transport owns a host,
+	// so a direct send to a claimed host's peer panics there rather than
+	// going around the owner. Release builds always return null.
+	const char* get_enet_host_owner(const _ENetHost* host);
+
+	// Creates the transports hosts sit on. Hosts default to get_enet(), the
+	// real UDP one, see Loopback_Network for the in-process one.
+	class Transport_Factory {
+	public:
+		virtual ~Transport_Factory() = default;
+
+		// Returns null if the address can't be bound.
+		virtual std::unique_ptr<Transport> create_server(const char* host, int32_t port, size_t max_peers, size_t channel_count) = 0;
+		virtual std::unique_ptr<Transport> create_client() = 0;
+
+		static Transport_Factory& get_enet();
+	};
+
+	// An ENet host on a UDP socket.
+	class Enet_Transport : public Transport {
+	public:
+		NO_COPY_NO_MOVE(Enet_Transport);
+
+		// Takes ownership of the host.
+		Enet_Transport(_ENetHost* host);
+		~Enet_Transport() override;
+
+		_ENetPeer* connect(const char* host, int32_t port, size_t channel_count) override;
+		int service(_ENetEvent* event, uint32_t timeout_ms) override;
+		int check_events(_ENetEvent* event) override;
+		bool send(_ENetPeer* peer, channel_id channel, _ENetPacket* packet) override;
+		void flush() override;
+
+		size_t get_peer_count() const override;
+		_ENetPeer* get_peer(size_t index) override;
+		void claim(const char* owner) override;
+		void release(const char* owner) override;
+
+		_ENetHost* get_host() const { return m_host; }
+
+		// The last claim still held, null if there are none.
+		const char* get_owner() const;
+
+	private:
+		_ENetHost* m_host = nullptr;
+
+		// Claimed from the host's thread but checked by sends from any.
+		mutable std::mutex m_claims_mutex;
+		std::vector<const char*> m_claims;
+	};
+}
@@ -0,0 +1,75 @@
+#include "bs/batch.h"
+
+#include <cstring>
+
+namespace bs {
+	static void write_u16(uint8_t* out, uint32_t value) {
+		out[0] = (uint8_t)value;
+		out[1] = (uint8_t)(value >> 8);
+	}
+
+	static void write_u32(uint8_t* out, uint32_t value) {
+		out[0] = (uint8_t)value;
+		out[1] = (uint8_t)(value >> 8);
+		out[2] = (uint8_t)(value >> 16);
+		out[3] = (uint8_t)(value >> 24);
+	}
+
+	static uint32_t read_u16(const uint8_t* in) {
+		return (uint32_t)in[0] | (uint32_t)in[1] << 8;
+	}
+
+	bool is_batch_frame(std::span<const uint8_t> bytes) {
+		return bytes.size() >= BATCH_HEADER_SIZE && read_batch_u32(bytes, 0) == BATCH_MAGIC;
+	}
+
+	void write_batch_frame(std::span<const Packet> messages, std::vector<uint8_t>& out) {
+		ASSERT_PANIC(!messages.empty() && messages.size() <= MAX_BATCH_MESSAGES, "Invalid batch size: {}", messages.size());
+
+		size_t size = BATCH_HEADER_SIZE;
+		for (const auto& message : messages) {
+			size += get_batch_entry_size(message.get_bytes().size());
+		}
+
+		// Zeroed so the reserved fields and padding don't leak old bytes.
+		out.assign(size, 0);
+
+		write_u32(out.data(), BATCH_MAGIC);
+		write_u16(out.data() + 4, (uint32_t)messages.size());
+
+		size_t offset = BATCH_HEADER_SIZE;
+		for (const auto& message : messages) {
+			const auto bytes = message.get_bytes();
+			write_u32(out.data() + offset, (uint32_t)bytes.size());
+			std::memcpy(out.data() + offset + BATCH_MESSAGE_HEADER_SIZE, bytes.data(), bytes.size());
+			offset += get_batch_entry_size(bytes.size());
+		}
+	}
+
+	size_t validate_batch_frame(std::span<const uint8_t> bytes) {
+		if (!is_batch_frame(bytes)) {
+			return 0;
+		}
+
+		const size_t count = read_u16(bytes.data() + 4);
+		if (count == 0 || count > MAX_BATCH_MESSAGES) {
+			return 0;
+		}
+
+		size_t offset = BATCH_HEADER_SIZE;
+		for (size_t i = 0; i < count; ++i) {
+			if (bytes.size() - offset < BATCH_MESSAGE_HEADER_SIZE) {
+				return 0;
+			}
+
+			const size_t length = read_batch_u32(bytes, offset);
+			if (length == 0 || get_batch_entry_size(length) > bytes.size() - offset) {
+				return 0;
+			}
+
+			offset += get_batch_entry_size(length);
+		}
+
+		return count;
+	}
+}
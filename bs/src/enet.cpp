@@ -31,12 +31,12 @@ namespace bs {
 		}
 	}
 
-	Host_Server* ENet::create_server(const char* host, int port, int max_clients) {
+	Host_Server* ENet::create_server(const char* host, int port, int max_clients, Transport_Factory& transports) {
 		ASSERT_PANIC(m_server == nullptr, "Trying to create a new server when one is already created.");
 
 		m_logger->info("Creating new server: host => {} port => {} max_clients => {}", host, port, max_clients);
 
-		auto* result = new Host_Server(host, port, max_clients, m_logger);
+		auto* result = new Host_Server(host, port, max_clients, m_logger, transports);
 
 		if (result == nullptr) {
 			PANIC("Failed trying to create a new server");
@@ -52,8 +52,8 @@ namespace bs {
 		SAFE_DELETE(server);
 	}
 
-	Host_Client* ENet::create_host_client() {
-		auto* result = new Host_Client(m_logger);
+	Host_Client* ENet::create_host_client(Transport_Factory& transports) {
+		auto* result = new Host_Client(m_logger, transports);
 
 		m_clients.push_back(result);
 
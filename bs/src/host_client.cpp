@@ -3,28 +3,23 @@
 #include <enet/enet.h>
 
 namespace bs {
-	Host_Client::Host_Client(logger_t& logger)
-		: Base_Client(-1, logger)
+	Host_Client::Host_Client(logger_t& logger, Transport_Factory& transports)
+		: Base_Client(-1, logger), m_sender(logger), m_metrics(m_sender.get_channels())
 	{
-		m_client = enet_host_create(NULL, 1, 2, 0, 0);
+		m_transport = transports.create_client();
 
-		if (!m_client) {
+		if (!m_transport) {
 			PANIC("An error occurred while trying to create an Host client");
 		}
-	}
 
-	Host_Client::~Host_Client() {
-		enet_host_destroy(m_client);
+		m_sender.set_transport(m_transport.get());
 	}
 
 	bool Host_Client::start(const char* host, int32_t port) {
 		m_host = host;
 		m_port = port;
 
-		ENetAddress address;
-		enet_address_set_host(&address, m_host);
-		address.port = m_port;
-		m_server = enet_host_connect(m_client, &address, 2, 0);
+		m_server = m_transport->connect(m_host, m_port, get_channels().size());
 		if (!m_server) {
 			PANIC("An error occurred while trying to create an Host peer");
 			return false;
@@ -44,36 +39,72 @@ namespace bs {
 	}
 
 	void Host_Client::tick(uint32_t timeout_ms) {
+		const auto tick_start = Metrics::clock::now();
+
+		m_sender.flush();
+
 		ENetEvent enet_event{};
-		while (enet_host_service(m_client, &enet_event, timeout_ms) > 0) {
+
+		// Leave events inside ENet while the game hasn't drained the queue.
+		// Any event could be a batch frame so keep room for a full one.
+		while (m_packets.has_room_for(MAX_BATCH_MESSAGES) && m_transport->service(&enet_event, timeout_ms) > 0) {
 			Packet packet(&enet_event);
 			m_peer = enet_event.peer;
 
-			m_packets.push_front(packet);
-
 			switch (packet.get_type()) {
+			case Packet::EVENT_RECIEVED: {
+				get_channels().on_received(packet.get_channel(), packet.get_bytes().size());
+
+				if (is_batch_frame(packet.get_bytes())) {
+					const bool unpacked = unpack_batch_frame(packet, [this](Packet&& message) {
+						push_packet(std::move(message));
+						});
+
+					if (!unpacked) {
+						m_logger->warn("Dropping malformed batch frame from server");
+					}
+					continue;
+				}
+			} break;
+
 			case Packet::CONNECT: {
 				on_connect();
 			} break;
 
 			case Packet::DISCONNECT: {
 				on_disconnect();
+				m_sender.drop(m_peer);
 			} break;
 
 			}
+
+			push_packet(std::move(packet));
 		}
+
+		update_metrics(tick_start);
 	}
 
-	void Host_Client::broadcast_to_server(const Packet& packet, bool reliable) {
-		enet_uint32 flags = 0;
-		if (reliable) {
-			flags |= ENET_PACKET_FLAG_RELIABLE;
+	void Host_Client::update_metrics(Metrics::clock::time_point tick_start) {
+		m_metrics.on_tick(Metrics::clock::now() - tick_start, m_packets.size());
+
+		auto& peers = m_metrics.get_peers();
+		peers.clear();
+
+		if (m_state == CONNECTED && m_peer) {
+			auto& peer = peers.emplace_back();
+			sample_peer_link(m_peer, peer.link);
+			peer.traffic = m_metrics.get_totals();
 		}
+	}
+
+	void Host_Client::push_packet(Packet&& packet) {
+		// tick() keeps room for a whole batch frame so this can't fail.
+		const bool pushed = m_packets.push(std::move(packet));
+		ASSERT_PANIC(pushed, "Client packet queue overflowed");
+	}
 
-		auto bytes = packet.get_bytes();
-		ASSERT_PANIC(!bytes.empty(), "Trying to broadcast to server but the data is empty");
-		ENetPacket* enet_packet = enet_packet_create(bytes.data(), bytes.size(), flags);
-		ASSERT_PANIC(enet_packet != nullptr, "Error creating packet");
-		enet_peer_send(m_peer, 0, enet_packet);
+	void Host_Client::broadcast_to_server(const Packet& packet, channel_id channel) {
+		ASSERT_PANIC(m_peer != nullptr, "Trying to broadcast to server before connecting");
+		m_sender.send(m_peer, packet, channel);
 	}
 }
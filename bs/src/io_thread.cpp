@@ -0,0 +1,164 @@
+#include "bs/io_thread.h"
+
+#include <enet/enet.h>
+
+namespace bs {
+	// How long a single service call may block waiting for traffic. This is
+	// also the worst case delay before a submitted send is flushed.
+	static constexpr enet_uint32 SERVICE_TIMEOUT_MS = 1;
+
+	// What direct sends from the game thread are told is in the way.
+	static const char* const CLAIM_OWNER = "the I/O thread";
+
+	static void release_wrapped_packet(ENetPacket* wrapper) {
+		Packet::release(static_cast<ENetPacket*>(wrapper->userData));
+	}
+
+	Io_Thread::~Io_Thread() {
+		stop();
+	}
+
+	void Io_Thread::start(Transport* transport) {
+		ASSERT_PANIC(!is_running(), "Trying to start the I/O thread when it is already running");
+		ASSERT_PANIC(transport != nullptr, "Trying to start the I/O thread without a transport");
+
+		m_transport = transport;
+
+		// ENet isn't thread safe, a Packet::send to one of the host's peers
+		// from the game thread would race this thread servicing it.
+		m_transport->claim(CLAIM_OWNER);
+
+		m_running.store(true, std::memory_order_release);
+		m_thread = std::thread([this] { run(); });
+
+		m_logger->info("Network I/O thread started");
+	}
+
+	void Io_Thread::stop() {
+		if (!is_running()) {
+			return;
+		}
+
+		m_running.store(false, std::memory_order_release);
+		m_thread.join();
+		m_transport->release(CLAIM_OWNER);
+
+		// Anything still queued is dropped, the host is about to go away.
+		m_egress.clear();
+		m_ingress.clear();
+
+		m_logger->info("Network I/O thread stopped");
+	}
+
+	void Io_Thread::submit(_ENetPeer* peer, const Packet& packet, channel_id channel, Delivery delivery) {
+		ASSERT_PANIC(peer != nullptr, "Trying to submit a send without a peer");
+		ASSERT_PANIC(!packet.get_bytes().empty(), "Trying to submit a send but the data is empty");
+
+		Send_Command command{ peer, packet, channel, delivery };
+		while (!m_egress.push(std::move(command))) {
+			std::this_thread::yield();
+		}
+	}
+
+	void Io_Thread::flush_egress() {
+		// Consecutive sends of the same packet (a broadcast) share one wrapper.
+		ENetPacket* wrapper = nullptr;
+		const ENetPacket* wrapped = nullptr;
+		Delivery wrapped_delivery = DELIVERY_RELIABLE;
+
+		// We hold a reference on the wrapper while it's in use, the transport
+		// takes its own for every peer it's queued on.
+		auto finish_wrapper = [&] {
+			if (wrapper) {
+				Packet::release(wrapper);
+			}
+			wrapper = nullptr;
+		};
+
+		m_egress.drain([&](Send_Command& command) {
+			ENetPacket* original = command.packet.get_enet_packet();
+
+			if (!wrapper || wrapped != original || wrapped_delivery != command.delivery) {
+				finish_wrapper();
+
+				const enet_uint32 flags = ENET_PACKET_FLAG_NO_ALLOCATE | get_enet_packet_flags(command.delivery);
+				wrapper = enet_packet_create(original->data, original->dataLength, flags);
+				ASSERT_PANIC(wrapper != nullptr, "Error creating packet");
+
+				Packet::retain(original);
+				wrapper->userData = original;
+				wrapper->freeCallback = release_wrapped_packet;
+				Packet::retain(wrapper);
+
+				wrapped = original;
+				wrapped_delivery = command.delivery;
+			}
+
+			if (!m_transport->send(command.peer, command.channel, wrapper)) {
+				m_logger->warn("Failed to send packet to peer: {}", (size_t)command.peer);
+			}
+			});
+
+		finish_wrapper();
+	}
+
+	void Io_Thread::copy_peer_links(std::vector<Peer_Link>& out) {
+		std::lock_guard lock(m_links_mutex);
+		out.assign(m_links.begin(), m_links.end());
+	}
+
+	void Io_Thread::sample_peer_links() {
+		const auto now = std::chrono::steady_clock::now();
+		if (now < m_next_link_sample) {
+			return;
+		}
+		m_next_link_sample = now + LINK_SAMPLE_INTERVAL;
+
+		// Sample outside the lock, the game thread only waits for the swap.
+		m_links_sampling.clear();
+		for (size_t i = 0; i < m_transport->get_peer_count(); ++i) {
+			ENetPeer* peer = m_transport->get_peer(i);
+			if (peer->state == ENET_PEER_STATE_CONNECTED) {
+				sample_peer_link(peer, m_links_sampling.emplace_back());
+			}
+		}
+
+		std::lock_guard lock(m_links_mutex);
+		m_links.swap(m_links_sampling);
+	}
+
+	void Io_Thread::run() {
+		ENetEvent enet_event{};
+
+		while (m_running.load(std::memory_order_acquire)) {
+			flush_egress();
+			sample_peer_links();
+
+			// While the game is behind only push out what we have, received
+			// events stay inside the transport until there's room for them.
+			if (m_ingress.full()) {
+				m_transport->flush();
+				std::this_thread::yield();
+				continue;
+			}
+
+			int result = m_transport->service(&enet_event, SERVICE_TIMEOUT_MS);
+			while (result > 0) {
+				m_ingress.push(Packet(&enet_event));
+
+				if (m_ingress.full()) {
+					break;
+				}
+
+				result = m_transport->check_events(&enet_event);
+			}
+
+			if (result < 0) {
+				m_logger->error("Error while servicing the transport");
+			}
+		}
+
+		flush_egress();
+		m_transport->flush();
+	}
+}
@@ -0,0 +1,160 @@
+#include "bs/job_system.h"
+
+#include <algorithm>
+
+namespace bs {
+	namespace {
+		// Index of the Job_System thread this is, 0 for anything that isn't
+		// a worker.
+		thread_local size_t t_thread_index = 0;
+
+		// Polls before a worker goes to sleep, ticks come in bursts so work
+		// usually turns up again quickly.
+		constexpr int IDLE_SPINS = 2000;
+	}
+
+	Job_System::Job_System(size_t worker_count) {
+		m_queues.reserve(worker_count + 1);
+		for (size_t i = 0; i < worker_count + 1; ++i) {
+			m_queues.push_back(std::make_unique<Queue>());
+		}
+
+		m_workers.reserve(worker_count);
+		for (size_t i = 1; i <= worker_count; ++i) {
+			m_workers.emplace_back([this, i] { worker_main(i); });
+		}
+	}
+
+	Job_System::~Job_System() {
+		{
+			std::scoped_lock lock(m_sleep_mutex);
+			m_running = false;
+		}
+		m_wake.notify_all();
+
+		for (auto& worker : m_workers) {
+			worker.join();
+		}
+	}
+
+	size_t Job_System::get_default_worker_count() {
+		const size_t cores = std::thread::hardware_concurrency();
+		return cores > 1 ? cores - 1 : 0;
+	}
+
+	size_t Job_System::get_thread_index() {
+		return t_thread_index;
+	}
+
+	void Job_System::run_and_wait(Job job) {
+		const size_t thread_index = t_thread_index;
+		auto& remaining = *job.remaining;
+
+		execute(job, thread_index);
+
+		// Help out with whatever is queued, ours or not, until every piece
+		// of this range has run.
+		while (remaining.load(std::memory_order_acquire) > 0) {
+			if (!try_run_one(thread_index)) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void Job_System::execute(Job job, size_t thread_index) {
+		// Leave the top halves for others to steal, oldest and biggest first.
+		while (job.end - job.begin > job.grain) {
+			const size_t middle = job.begin + (job.end - job.begin) / 2;
+
+			Job top = job;
+			top.begin = middle;
+			push(thread_index, top);
+
+			job.end = middle;
+		}
+
+		job.run(job.context, job.begin, job.end);
+		job.remaining->fetch_sub(job.end - job.begin, std::memory_order_acq_rel);
+	}
+
+	void Job_System::push(size_t thread_index, const Job& job) {
+		{
+			auto& queue = *m_queues[thread_index];
+			std::scoped_lock lock(queue.mutex);
+			queue.jobs.push_back(job);
+		}
+
+		// Either this sees the sleeper or the sleeper sees the job, both
+		// sides go through sequentially consistent atomics.
+		m_queued.fetch_add(1);
+		if (m_sleeping.load() > 0) {
+			std::scoped_lock lock(m_sleep_mutex);
+			m_wake.notify_one();
+		}
+	}
+
+	bool Job_System::pop(size_t thread_index, Job& out) {
+		auto& queue = *m_queues[thread_index];
+		std::scoped_lock lock(queue.mutex);
+		if (queue.jobs.empty()) {
+			return false;
+		}
+
+		out = queue.jobs.back();
+		queue.jobs.pop_back();
+		m_queued.fetch_sub(1);
+		return true;
+	}
+
+	bool Job_System::steal(size_t thread_index, Job& out) {
+		const size_t count = m_queues.size();
+		for (size_t i = 1; i < count; ++i) {
+			auto& queue = *m_queues[(thread_index + i) % count];
+			std::scoped_lock lock(queue.mutex);
+			if (queue.jobs.empty()) {
+				continue;
+			}
+
+			out = queue.jobs.front();
+			queue.jobs.pop_front();
+			m_queued.fetch_sub(1);
+			return true;
+		}
+
+		return false;
+	}
+
+	bool Job_System::try_run_one(size_t thread_index) {
+		Job job;
+		if (!pop(thread_index, job) && !steal(thread_index, job)) {
+			return false;
+		}
+
+		execute(job, thread_index);
+		return true;
+	}
+
+	void Job_System::worker_main(size_t thread_index) {
+		t_thread_index = thread_index;
+
+		while (m_running.load(std::memory_order_relaxed)) {
+			if (try_run_one(thread_index)) {
+				continue;
+			}
+
+			bool found = false;
+			for (int i = 0; i < IDLE_SPINS && !found; ++i) {
+				found = m_queued.load(std::memory_order_relaxed) > 0;
+			}
+
+			if (found) {
+				continue;
+			}
+
+			std::unique_lock lock(m_sleep_mutex);
+			m_sleeping.fetch_add(1);
+			m_wake.wait(lock, [this] { return m_queued.load() > 0 || !m_running; });
+			m_sleeping.fetch_sub(1);
+		}
+	}
+}
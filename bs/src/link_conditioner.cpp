@@ -0,0 +1,569 @@
+#include "bs/link_conditioner.h"
+#include "bs/packet.h"
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+namespace bs {
+	static constexpr enet_uint32 DELIVERY_FLAGS = ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+
+	// What direct sends to a conditioned ENet host are told is in the way.
+	static const char* const CLAIM_OWNER = "the Link_Conditioner";
+
+	static std::string_view trim(std::string_view text) {
+		const auto first = text.find_first_not_of(" \t\r\n");
+		if (first == std::string_view::npos) {
+			return {};
+		}
+
+		const auto last = text.find_last_not_of(" \t\r\n");
+		return text.substr(first, last - first + 1);
+	}
+
+	template <typename T>
+	static bool parse_number(std::string_view text, T& out) {
+		const auto* end = text.data() + text.size();
+		auto [ptr, ec] = std::from_chars(text.data(), end, out);
+		return ec == std::errc() && ptr == end;
+	}
+
+	static bool get_preset(std::string_view name, Link_Profile& out) {
+		Link_Profile profile;
+
+		if (name == "perfect") {
+		}
+		else if (name == "lan") {
+			profile.delay_ms = 1;
+		}
+		else if (name == "wifi") {
+			profile.delay_ms = 5;
+			profile.jitter_ms = 4;
+			profile.loss = 0.005f;
+			profile.loss_burst = 2;
+		}
+		else if (name == "broadband") {
+			profile.delay_ms = 20;
+			profile.jitter_ms = 5;
+			profile.loss = 0.005f;
+		}
+		else if (name == "mobile") {
+			profile.delay_ms = 60;
+			profile.jitter_ms = 30;
+			profile.loss = 0.02f;
+			profile.loss_burst = 3;
+			profile.reorder = 0.01f;
+			profile.bandwidth_kbps = 4000;
+		}
+		else if (name == "bad") {
+			profile.delay_ms = 150;
+			profile.jitter_ms = 60;
+			profile.loss = 0.08f;
+			profile.loss_burst = 4;
+			profile.duplicate = 0.02f;
+			profile.reorder = 0.05f;
+			profile.bandwidth_kbps = 512;
+		}
+		else {
+			return false;
+		}
+
+		out = profile;
+		return true;
+	}
+
+	bool Link_Profile::parse(std::string_view spec, Link_Profile& out, std::string& error) {
+		Link_Profile profile;
+
+		size_t index = 0;
+		while (!spec.empty()) {
+			const auto comma = spec.find(',');
+			const auto item = trim(spec.substr(0, comma));
+			spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+
+			const auto equals = item.find('=');
+			if (equals == std::string_view::npos) {
+				// Presets only make sense as the base the rest override.
+				if (index != 0 || !get_preset(item, profile)) {
+					error = fmt::format("Unknown link profile '{}'", item);
+					return false;
+				}
+
+				index++;
+				continue;
+			}
+
+			const auto key = trim(item.substr(0, equals));
+			const auto value = trim(item.substr(equals + 1));
+
+			bool parsed = false;
+			if (key == "delay") parsed = parse_number(value, profile.delay_ms);
+			else if (key == "jitter") parsed = parse_number(value, profile.jitter_ms);
+			else if (key == "loss") parsed = parse_number(value, profile.loss) && profile.loss >= 0.0f && profile.loss <= 1.0f;
+			else if (key == "burst") parsed = parse_number(value, profile.loss_burst) && profile.loss_burst > 0;
+			else if (key == "dup") parsed = parse_number(value, profile.duplicate) && profile.duplicate >= 0.0f && profile.duplicate <= 1.0f;
+			else if (key == "reorder") parsed = parse_number(value, profile.reorder) && profile.reorder >= 0.0f && profile.reorder <= 1.0f;
+			else if (key == "reorder_ms") parsed = parse_number(value, profile.reorder_ms);
+			else if (key == "kbps") parsed = parse_number(value, profile.bandwidth_kbps);
+			else if (key == "queue") parsed = parse_number(value, profile.queue_ms);
+			else {
+				error = fmt::format("Unknown link setting '{}'", key);
+				return false;
+			}
+
+			if (!parsed) {
+				error = fmt::format("Invalid value '{}' for link setting '{}'", value, key);
+				return false;
+			}
+
+			index++;
+		}
+
+		out = profile;
+		return true;
+	}
+
+	const Link_Profile& Link_Script::get_profile(uint64_t elapsed_ms) const {
+		ASSERT_PANIC(!steps.empty(), "Trying to get a profile from an empty link script");
+
+		// Scripts are a handful of steps, a linear scan is plenty.
+		size_t current = 0;
+		while (current + 1 < steps.size() && steps[current + 1].at_ms <= elapsed_ms) {
+			current++;
+		}
+
+		return steps[current].profile;
+	}
+
+	bool Link_Script::parse(std::string_view spec, Link_Script& out, std::string& error) {
+		spec = trim(spec);
+
+		std::string file_steps;
+		if (spec.starts_with('@')) {
+			const std::string path(spec.substr(1));
+			std::ifstream file(path);
+			if (!file) {
+				error = fmt::format("Failed to open link script {}", path);
+				return false;
+			}
+
+			std::string line;
+			while (std::getline(file, line)) {
+				const auto step = trim(std::string_view(line).substr(0, line.find('#')));
+				if (!step.empty()) {
+					file_steps.append(step).push_back(';');
+				}
+			}
+
+			spec = file_steps;
+		}
+
+		Link_Script script;
+		while (!spec.empty()) {
+			const auto semicolon = spec.find(';');
+			auto item = trim(spec.substr(0, semicolon));
+			spec = semicolon == std::string_view::npos ? std::string_view() : spec.substr(semicolon + 1);
+
+			if (item.empty()) {
+				continue;
+			}
+
+			Step step;
+
+			// "<seconds>s:" starts the step later on, without it the step
+			// has to be the first.
+			const auto colon = item.find(':');
+			if (colon != std::string_view::npos) {
+				const auto at = trim(item.substr(0, colon));
+				double seconds = 0.0;
+				if (!at.ends_with('s') || !parse_number(at.substr(0, at.size() - 1), seconds) || seconds < 0.0) {
+					error = fmt::format("Invalid link script time '{}', expected e.g. '10s'", at);
+					return false;
+				}
+
+				step.at_ms = (uint64_t)(seconds * 1000.0);
+				item = item.substr(colon + 1);
+			}
+			else if (!script.steps.empty()) {
+				error = fmt::format("Link script step '{}' needs a start time", item);
+				return false;
+			}
+
+			if (!script.steps.empty() && step.at_ms <= script.steps.back().at_ms) {
+				error = fmt::format("Link script steps must be in order, '{}' isn't", item);
+				return false;
+			}
+
+			if (!Link_Profile::parse(item, step.profile, error)) {
+				return false;
+			}
+
+			// A perfect link until the first step starts.
+			if (script.steps.empty() && step.at_ms > 0) {
+				script.steps.push_back({});
+			}
+
+			script.steps.push_back(step);
+		}
+
+		out = std::move(script);
+		return true;
+	}
+
+	Link_Conditioner::Link_Conditioner(Transport_Factory& inner, Link_Script script, uint32_t seed)
+		: m_inner(inner), m_script(std::move(script)), m_seed(seed) {}
+
+	std::unique_ptr<Transport> Link_Conditioner::create_server(const char* host, int32_t port, size_t max_peers, size_t channel_count) {
+		auto inner = m_inner.create_server(host, port, max_peers, channel_count);
+		if (!inner || m_script.empty()) {
+			return inner;
+		}
+
+		// Each transport rolls its own dice so they don't drop in lockstep.
+		return std::make_unique<Conditioned_Transport>(std::move(inner), *this, m_seed + m_transports_created++);
+	}
+
+	std::unique_ptr<Transport> Link_Conditioner::create_client() {
+		auto inner = m_inner.create_client();
+		if (!inner || m_script.empty()) {
+			return inner;
+		}
+
+		return std::make_unique<Conditioned_Transport>(std::move(inner), *this, m_seed + m_transports_created++);
+	}
+
+	void Link_Conditioner::set_peer_script(const _ENetPeer* peer, Link_Script script) {
+		ASSERT_PANIC(!script.empty(), "Trying to give a peer an empty link script");
+
+		std::lock_guard lock(m_mutex);
+		m_peer_scripts[peer] = { std::move(script), std::chrono::steady_clock::now() };
+		m_peer_scripts_version.fetch_add(1, std::memory_order_release);
+	}
+
+	void Link_Conditioner::clear_peer_script(const _ENetPeer* peer) {
+		std::lock_guard lock(m_mutex);
+		if (m_peer_scripts.erase(peer) > 0) {
+			m_peer_scripts_version.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	bool Link_Conditioner::get_peer_scripts(uint64_t& version, peer_scripts_t& out) {
+		// Checked on every packet, only lock once something has changed.
+		if (m_peer_scripts_version.load(std::memory_order_acquire) == version) {
+			return false;
+		}
+
+		std::lock_guard lock(m_mutex);
+		out = m_peer_scripts;
+		version = m_peer_scripts_version.load(std::memory_order_relaxed);
+		return true;
+	}
+
+	Conditioned_Transport::Conditioned_Transport(std::unique_ptr<Transport> inner, Link_Conditioner& conditioner, uint32_t seed)
+		: m_inner(std::move(inner)), m_conditioner(conditioner), m_start(clock::now()), m_rng(seed)
+	{
+		ASSERT_PANIC(m_inner != nullptr, "Trying to condition a transport that doesn't exist");
+
+		// Sends straight to ENet would skip the link.
+		m_inner->claim(CLAIM_OWNER);
+	}
+
+	Conditioned_Transport::~Conditioned_Transport() {
+		m_inner->release(CLAIM_OWNER);
+
+		m_wheel.drain([&](Held& held) {
+			discard(held);
+			});
+
+		for (auto& event : m_ready) {
+			enet_packet_destroy(event.packet);
+		}
+	}
+
+	_ENetPeer* Conditioned_Transport::connect(const char* host, int32_t port, size_t channel_count) {
+		ENetPeer* peer = m_inner->connect(host, port, channel_count);
+		if (peer) {
+			reset_peer(peer);
+		}
+
+		return peer;
+	}
+
+	int Conditioned_Transport::service(_ENetEvent* event, uint32_t timeout_ms) {
+		const uint64_t deadline_ms = get_now_ms() + timeout_ms;
+
+		for (;;) {
+			release_due();
+			if (pop_ready(event)) {
+				return 1;
+			}
+
+			// Don't block on the inner transport past the next release.
+			const uint64_t now_ms = get_now_ms();
+			uint32_t wait_ms = now_ms < deadline_ms ? (uint32_t)(deadline_ms - now_ms) : 0;
+			if (!m_wheel.empty()) {
+				wait_ms = std::min(wait_ms, 1u);
+			}
+
+			const int result = m_inner->service(event, wait_ms);
+			if (result < 0) {
+				return result;
+			}
+
+			if (result > 0) {
+				if (hold_incoming(event)) {
+					return 1;
+				}
+				continue;
+			}
+
+			if (get_now_ms() >= deadline_ms) {
+				release_due();
+				return pop_ready(event) ? 1 : 0;
+			}
+		}
+	}
+
+	int Conditioned_Transport::check_events(_ENetEvent* event) {
+		if (pop_ready(event)) {
+			return 1;
+		}
+
+		int result = m_inner->check_events(event);
+		while (result > 0) {
+			if (hold_incoming(event)) {
+				return 1;
+			}
+
+			result = m_inner->check_events(event);
+		}
+
+		return result;
+	}
+
+	bool Conditioned_Transport::send(_ENetPeer* peer, channel_id channel, _ENetPacket* packet) {
+		Held held;
+		held.peer = peer;
+		held.packet = packet;
+		held.flags = packet->flags;
+		held.channel = (uint8_t)channel;
+		held.direction = OUTGOING;
+
+		// Our reference until the link hands it on, or loses it.
+		Packet::retain(packet);
+		submit(held);
+
+		// Like a real link a lost packet was still sent.
+		return true;
+	}
+
+	void Conditioned_Transport::flush() {
+		release_due();
+		m_inner->flush();
+	}
+
+	size_t Conditioned_Transport::get_peer_count() const {
+		return m_inner->get_peer_count();
+	}
+
+	_ENetPeer* Conditioned_Transport::get_peer(size_t index) {
+		return m_inner->get_peer(index);
+	}
+
+	uint64_t Conditioned_Transport::get_now_ms() const {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - m_start).count();
+	}
+
+	const Link_Profile& Conditioned_Transport::get_profile(const _ENetPeer* peer, uint64_t now_ms) {
+		m_conditioner.get_peer_scripts(m_peer_scripts_version, m_peer_scripts);
+
+		if (auto it = m_peer_scripts.find(peer); it != m_peer_scripts.end()) {
+			const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - it->second.start);
+			return it->second.script.get_profile((uint64_t)elapsed.count());
+		}
+
+		return m_conditioner.get_script().get_profile(now_ms);
+	}
+
+	Conditioned_Transport::Peer_State& Conditioned_Transport::get_peer_state(_ENetPeer* peer) {
+		return m_peers[peer];
+	}
+
+	void Conditioned_Transport::reset_peer(_ENetPeer* peer) {
+		auto& state = get_peer_state(peer);
+		const uint32_t generation = state.generation + 1;
+		state = {};
+		state.generation = generation;
+	}
+
+	void Conditioned_Transport::submit(Held held) {
+		auto& state = get_peer_state(held.peer);
+		auto& link = state.links[held.direction];
+		const uint64_t now_ms = get_now_ms();
+		const Link_Profile& profile = get_profile(held.peer, now_ms);
+		const Delivery delivery = get_delivery(held.flags);
+		const bool reliable = delivery == DELIVERY_RELIABLE;
+
+		held.generation = state.generation;
+
+		bool lost = false;
+		if (link.burst_left > 0) {
+			link.burst_left--;
+			lost = true;
+		}
+		else if (chance(profile.loss)) {
+			link.burst_left = profile.loss_burst - 1;
+			lost = true;
+		}
+
+		if (lost && !reliable) {
+			discard(held);
+			return;
+		}
+
+		double deliver_at = (double)now_ms + profile.delay_ms;
+		if (profile.jitter_ms > 0) {
+			deliver_at += std::uniform_real_distribution<double>(-(double)profile.jitter_ms, (double)profile.jitter_ms)(m_rng);
+		}
+
+		if (chance(profile.reorder)) {
+			deliver_at += profile.reorder_ms;
+		}
+
+		// ENet resends a reliable packet once it's gone a round trip without
+		// being acknowledged.
+		if (lost) {
+			deliver_at += 2.0 * profile.delay_ms;
+		}
+
+		if (profile.bandwidth_kbps > 0) {
+			// A kilobit per second is a bit per millisecond.
+			const double start = std::max((double)now_ms, link.free_at_ms);
+			if (!reliable && start - (double)now_ms > profile.queue_ms) {
+				discard(held);
+				return;
+			}
+
+			link.free_at_ms = start + (double)(held.packet->dataLength * 8) / profile.bandwidth_kbps;
+			deliver_at += link.free_at_ms - (double)now_ms;
+		}
+
+		uint64_t deliver_ms = (uint64_t)std::max(deliver_at, (double)now_ms);
+
+		if (link.channels.size() <= held.channel) {
+			link.channels.resize(held.channel + 1);
+		}
+		auto& order = link.channels[held.channel];
+
+		switch (delivery) {
+		case DELIVERY_RELIABLE: {
+			deliver_ms = std::max(deliver_ms, order.last_reliable_ms);
+			order.last_reliable_ms = deliver_ms;
+		} break;
+
+		// Overtaken ones are dropped when they come due, see release_due().
+		case DELIVERY_UNRELIABLE_SEQUENCED: {
+			held.sequence = ++order.next_sequence;
+		} break;
+
+		default: break;
+		}
+
+		m_wheel.schedule(deliver_ms, held);
+
+		// ENet filters out duplicate reliable and sequenced packets by their
+		// sequence numbers, unsequenced ones are the only kind that can
+		// reach the host twice.
+		if (delivery == DELIVERY_UNSEQUENCED && chance(profile.duplicate)) {
+			Held copy = held;
+			if (held.direction == OUTGOING) {
+				Packet::retain(held.packet);
+			}
+			else {
+				copy.packet = enet_packet_create(held.packet->data, held.packet->dataLength, held.packet->flags & DELIVERY_FLAGS);
+				ASSERT_PANIC(copy.packet != nullptr, "Error creating packet");
+			}
+
+			const uint64_t extra_ms = std::uniform_int_distribution<uint64_t>(0, profile.jitter_ms)(m_rng);
+			m_wheel.schedule(deliver_ms + extra_ms, copy);
+		}
+	}
+
+	bool Conditioned_Transport::hold_incoming(_ENetEvent* event) {
+		switch (event->type) {
+		case ENET_EVENT_TYPE_RECEIVE: {
+			Held held;
+			held.peer = event->peer;
+			held.packet = event->packet;
+			held.flags = event->packet->flags;
+			held.channel = event->channelID;
+			held.direction = INCOMING;
+			submit(held);
+		} return false;
+
+		// Whatever is still on the link from the old connection is lost.
+		case ENET_EVENT_TYPE_CONNECT:
+		case ENET_EVENT_TYPE_DISCONNECT: {
+			reset_peer(event->peer);
+		} return true;
+
+		default: return true;
+		}
+	}
+
+	void Conditioned_Transport::release_due() {
+		m_wheel.advance(get_now_ms(), [&](Held& held) {
+			auto it = m_peers.find(held.peer);
+			if (it == m_peers.end() || it->second.generation != held.generation) {
+				discard(held);
+				return;
+			}
+
+			// A later sequenced packet already arrived, ENet would drop this one.
+			if (held.sequence != 0) {
+				auto& order = it->second.links[held.direction].channels[held.channel];
+				if (held.sequence <= order.delivered_sequence) {
+					discard(held);
+					return;
+				}
+				order.delivered_sequence = held.sequence;
+			}
+
+			if (held.direction == OUTGOING) {
+				// The packet may have been sent on with another delivery since.
+				held.packet->flags = (held.packet->flags & ~DELIVERY_FLAGS) | (held.flags & DELIVERY_FLAGS);
+				m_inner->send(held.peer, (channel_id)held.channel, held.packet);
+				Packet::release(held.packet);
+			}
+			else {
+				m_ready.push_back({ ENET_EVENT_TYPE_RECEIVE, held.peer, held.channel, 0, held.packet });
+			}
+			});
+	}
+
+	bool Conditioned_Transport::pop_ready(_ENetEvent* event) {
+		if (m_ready.empty()) {
+			return false;
+		}
+
+		*event = m_ready.front();
+		m_ready.pop_front();
+		return true;
+	}
+
+	void Conditioned_Transport::discard(Held& held) {
+		if (held.direction == OUTGOING) {
+			Packet::release(held.packet);
+		}
+		else {
+			enet_packet_destroy(held.packet);
+		}
+	}
+
+	bool Conditioned_Transport::chance(float probability) {
+		return probability > 0.0f && std::uniform_real_distribution<float>(0.0f, 1.0f)(m_rng) < probability;
+	}
+}
@@ -0,0 +1,374 @@
+#include "bs/loopback.h"
+#include "bs/packet.h"
+
+#include <enet/enet.h>
+#include <fmt/format.h>
+
+#include <chrono>
+#include <thread>
+
+namespace bs {
+	static constexpr enet_uint32 DELIVERY_FLAGS = ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+
+	static std::string make_address(const char* host, int32_t port) {
+		return fmt::format("{}:{}", host, port);
+	}
+
+	static void release_delivered_packet(ENetPacket* wrapper) {
+		Packet::release(static_cast<ENetPacket*>(wrapper->userData));
+	}
+
+	Loopback_Connection::~Loopback_Connection() {
+		// Both sides have let go, free whatever was never received.
+		for (auto& queue : queues) {
+			queue.drain([](Loopback_Datagram& datagram) {
+				enet_packet_destroy(datagram.packet);
+				});
+		}
+	}
+
+	std::unique_ptr<Transport> Loopback_Network::create_server(const char* host, int32_t port, size_t max_peers, size_t) {
+		// Channels aren't limited here, each connection uses the connector's.
+		auto transport = std::make_unique<Loopback_Transport>(*this, max_peers);
+		if (!transport->listen(host, port)) {
+			return nullptr;
+		}
+
+		return transport;
+	}
+
+	std::unique_ptr<Transport> Loopback_Network::create_client() {
+		return std::make_unique<Loopback_Transport>(*this, 1);
+	}
+
+	bool Loopback_Network::bind(const std::string& address, Loopback_Transport* listener) {
+		std::lock_guard lock(m_mutex);
+		return m_listeners.emplace(address, listener).second;
+	}
+
+	void Loopback_Network::unbind(const std::string& address) {
+		std::lock_guard lock(m_mutex);
+		m_listeners.erase(address);
+	}
+
+	bool Loopback_Network::connect(const std::string& address, std::shared_ptr<Loopback_Connection> connection) {
+		// Held while handing over so the listener can't unbind and go away.
+		std::lock_guard lock(m_mutex);
+
+		auto it = m_listeners.find(address);
+		if (it == m_listeners.end()) {
+			return false;
+		}
+
+		it->second->add_pending(std::move(connection));
+		return true;
+	}
+
+	Loopback_Transport::Loopback_Transport(Loopback_Network& network, size_t max_peers)
+		: m_network(network), m_peers(max_peers), m_slots(max_peers) {
+		ASSERT_PANIC(max_peers > 0, "A loopback transport needs at least one peer");
+
+		for (size_t i = 0; i < max_peers; ++i) {
+			m_peers[i].incomingPeerID = (enet_uint16)i;
+			m_peers[i].state = ENET_PEER_STATE_DISCONNECTED;
+		}
+
+		// Hand out the lowest slots first, like ENet does.
+		for (size_t i = max_peers; i-- > 0;) {
+			m_free_slots.push_back(i);
+		}
+	}
+
+	Loopback_Transport::~Loopback_Transport() {
+		if (!m_address.empty()) {
+			m_network.unbind(m_address);
+		}
+
+		{
+			std::lock_guard lock(m_pending_mutex);
+			for (auto& connection : m_pending) {
+				connection->state.store(Loopback_Connection::REJECTED, std::memory_order_release);
+			}
+		}
+
+		while (!m_open_slots.empty()) {
+			close_slot(m_open_slots.back());
+		}
+
+		for (size_t i = m_next_event; i < m_events.size(); ++i) {
+			if (m_events[i].packet) {
+				enet_packet_destroy(m_events[i].packet);
+			}
+		}
+	}
+
+	bool Loopback_Transport::listen(const char* host, int32_t port) {
+		ASSERT_PANIC(m_address.empty(), "Loopback transport is already listening on {}", m_address);
+
+		auto address = make_address(host, port);
+		if (!m_network.bind(address, this)) {
+			return false;
+		}
+
+		m_address = std::move(address);
+		return true;
+	}
+
+	_ENetPeer* Loopback_Transport::connect(const char* host, int32_t port, size_t channel_count) {
+		if (m_free_slots.empty()) {
+			return nullptr;
+		}
+
+		const size_t index = m_free_slots.back();
+		m_free_slots.pop_back();
+
+		auto connection = std::make_shared<Loopback_Connection>(channel_count);
+		open_slot(index, connection, Loopback_Connection::CONNECTOR);
+
+		// Nobody listening, the next poll reports the disconnect like ENet
+		// does once the connection attempt times out.
+		if (!m_network.connect(make_address(host, port), connection)) {
+			connection->state.store(Loopback_Connection::REJECTED, std::memory_order_release);
+		}
+
+		return &m_peers[index];
+	}
+
+	int Loopback_Transport::service(_ENetEvent* event, uint32_t timeout_ms) {
+		flush();
+
+		if (pop_event(event)) {
+			return 1;
+		}
+
+		poll();
+		if (pop_event(event)) {
+			return 1;
+		}
+
+		if (timeout_ms == 0) {
+			return 0;
+		}
+
+		// Nothing to block on, keep polling until the timeout runs out.
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		while (std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::yield();
+
+			flush();
+			poll();
+			if (pop_event(event)) {
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	int Loopback_Transport::check_events(_ENetEvent* event) {
+		if (pop_event(event)) {
+			return 1;
+		}
+
+		poll();
+		return pop_event(event) ? 1 : 0;
+	}
+
+	bool Loopback_Transport::send(_ENetPeer* peer, channel_id channel, _ENetPacket* packet) {
+		const size_t index = (size_t)(peer - m_peers.data());
+		ASSERT_PANIC(index < m_peers.size(), "Trying to send to a peer from another transport");
+
+		auto& slot = m_slots[index];
+		if (!slot.connected) {
+			return false;
+		}
+
+		// The receiver gets its own unreferenced packet over the same bytes,
+		// it keeps a reference on the original until it's freed.
+		ENetPacket* wrapper = enet_packet_create(packet->data, packet->dataLength, ENET_PACKET_FLAG_NO_ALLOCATE | (packet->flags & DELIVERY_FLAGS));
+		ASSERT_PANIC(wrapper != nullptr, "Error creating packet");
+
+		Packet::retain(packet);
+		wrapper->userData = packet;
+		wrapper->freeCallback = release_delivered_packet;
+
+		const Loopback_Datagram datagram{ wrapper, (uint8_t)channel };
+		auto& remote_queue = slot.connection->queues[1 - slot.side];
+
+		if (slot.backlog.empty() && remote_queue.push(datagram)) {
+			return true;
+		}
+
+		if (packet->flags & ENET_PACKET_FLAG_RELIABLE) {
+			slot.backlog.push_back(datagram);
+			m_backlog_size++;
+		}
+		else {
+			enet_packet_destroy(wrapper);
+		}
+
+		return true;
+	}
+
+	void Loopback_Transport::flush() {
+		if (m_backlog_size == 0) {
+			return;
+		}
+
+		for (size_t index : m_open_slots) {
+			auto& slot = m_slots[index];
+			auto& remote_queue = slot.connection->queues[1 - slot.side];
+
+			while (!slot.backlog.empty() && remote_queue.push(slot.backlog.front())) {
+				slot.backlog.pop_front();
+				m_backlog_size--;
+			}
+		}
+	}
+
+	size_t Loopback_Transport::get_peer_count() const {
+		return m_peers.size();
+	}
+
+	_ENetPeer* Loopback_Transport::get_peer(size_t index) {
+		return &m_peers[index];
+	}
+
+	void Loopback_Transport::add_pending(std::shared_ptr<Loopback_Connection> connection) {
+		std::lock_guard lock(m_pending_mutex);
+		m_pending.push_back(std::move(connection));
+	}
+
+	void Loopback_Transport::poll() {
+		m_events.clear();
+		m_next_event = 0;
+
+		// Every event naming these slots has been handed out now.
+		m_free_slots.insert(m_free_slots.end(), m_closed_slots.begin(), m_closed_slots.end());
+		m_closed_slots.clear();
+
+		accept_pending();
+
+		// Backwards so closing a slot only moves one that's been polled.
+		for (size_t i = m_open_slots.size(); i-- > 0;) {
+			poll_slot(m_open_slots[i]);
+		}
+	}
+
+	void Loopback_Transport::accept_pending() {
+		{
+			std::lock_guard lock(m_pending_mutex);
+			m_accepting.swap(m_pending);
+		}
+
+		for (auto& connection : m_accepting) {
+			if (m_free_slots.empty() || connection->closed[Loopback_Connection::CONNECTOR].load(std::memory_order_acquire)) {
+				connection->state.store(Loopback_Connection::REJECTED, std::memory_order_release);
+				continue;
+			}
+
+			const size_t index = m_free_slots.back();
+			m_free_slots.pop_back();
+
+			open_slot(index, connection, Loopback_Connection::LISTENER);
+			m_slots[index].connected = true;
+			m_peers[index].state = ENET_PEER_STATE_CONNECTED;
+			connection->state.store(Loopback_Connection::ACCEPTED, std::memory_order_release);
+
+			m_events.push_back({ ENET_EVENT_TYPE_CONNECT, &m_peers[index], 0, 0, nullptr });
+		}
+
+		m_accepting.clear();
+	}
+
+	void Loopback_Transport::poll_slot(size_t index) {
+		auto& slot = m_slots[index];
+		auto& connection = *slot.connection;
+		ENetPeer* peer = &m_peers[index];
+
+		if (!slot.connected) {
+			switch (connection.state.load(std::memory_order_acquire)) {
+			case Loopback_Connection::PENDING: return;
+
+			case Loopback_Connection::REJECTED: {
+				m_events.push_back({ ENET_EVENT_TYPE_DISCONNECT, peer, 0, 0, nullptr });
+				close_slot(index);
+			} return;
+
+			default: {
+				slot.connected = true;
+				peer->state = ENET_PEER_STATE_CONNECTED;
+				m_events.push_back({ ENET_EVENT_TYPE_CONNECT, peer, 0, 0, nullptr });
+			} break;
+			}
+		}
+
+		// Read the flag first, whatever was sent before the remote closed is
+		// then guaranteed to be in the queue.
+		const bool remote_closed = connection.closed[1 - slot.side].load(std::memory_order_acquire);
+
+		connection.queues[slot.side].drain([&](Loopback_Datagram& datagram) {
+			m_events.push_back({ ENET_EVENT_TYPE_RECEIVE, peer, datagram.channel, 0, datagram.packet });
+			});
+
+		if (remote_closed) {
+			m_events.push_back({ ENET_EVENT_TYPE_DISCONNECT, peer, 0, 0, nullptr });
+			close_slot(index);
+		}
+	}
+
+	bool Loopback_Transport::pop_event(_ENetEvent* event) {
+		if (m_next_event == m_events.size()) {
+			return false;
+		}
+
+		*event = m_events[m_next_event++];
+		return true;
+	}
+
+	void Loopback_Transport::open_slot(size_t index, std::shared_ptr<Loopback_Connection> connection, Loopback_Connection::Side side) {
+		auto& slot = m_slots[index];
+		const size_t channel_count = connection->channel_count;
+		slot.connection = std::move(connection);
+		slot.side = side;
+		slot.connected = false;
+		slot.open_index = m_open_slots.size();
+		m_open_slots.push_back(index);
+
+		// A perfect link as far as anything sampling the peer can tell.
+		ENetPeer& peer = m_peers[index];
+		peer.state = ENET_PEER_STATE_CONNECTING;
+		peer.channelCount = channel_count;
+		peer.mtu = ENET_HOST_DEFAULT_MTU;
+		peer.packetThrottle = ENET_PEER_PACKET_THROTTLE_SCALE;
+		peer.packetLoss = 0;
+		peer.roundTripTime = 0;
+		peer.roundTripTimeVariance = 0;
+		peer.reliableDataInTransit = 0;
+	}
+
+	void Loopback_Transport::close_slot(size_t index) {
+		auto& slot = m_slots[index];
+
+		slot.connection->closed[slot.side].store(true, std::memory_order_release);
+		slot.connection.reset();
+		slot.connected = false;
+
+		for (auto& datagram : slot.backlog) {
+			enet_packet_destroy(datagram.packet);
+		}
+		m_backlog_size -= slot.backlog.size();
+		slot.backlog.clear();
+
+		// Swap the last open slot in to this one's place.
+		const size_t moved = m_open_slots.back();
+		m_open_slots[slot.open_index] = moved;
+		m_slots[moved].open_index = slot.open_index;
+		m_open_slots.pop_back();
+
+		// Like ENet the user data is left alone, the disconnect event still
+		// needs it. The slot is reused once that event has been handed out.
+		m_peers[index].state = ENET_PEER_STATE_DISCONNECTED;
+		m_closed_slots.push_back(index);
+	}
+}
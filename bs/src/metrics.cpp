@@ -0,0 +1,211 @@
+#include "bs/metrics.h"
+
+#include <enet/enet.h>
+#include <fmt/format.h>
+
+#include <cstdio>
+#include <iterator>
+
+namespace bs {
+	void sample_peer_link(_ENetPeer* peer, Peer_Link& out) {
+		out.peer = peer;
+		out.rtt_ms = peer->roundTripTime;
+		out.rtt_variance_ms = peer->roundTripTimeVariance;
+		out.last_rtt_ms = peer->lastRoundTripTime;
+		out.packet_loss = (float)peer->packetLoss / (float)ENET_PEER_PACKET_LOSS_SCALE;
+		out.packet_loss_variance = (float)peer->packetLossVariance / (float)ENET_PEER_PACKET_LOSS_SCALE;
+		out.packet_throttle = (float)peer->packetThrottle / (float)ENET_PEER_PACKET_THROTTLE_SCALE;
+		out.reliable_in_transit = peer->reliableDataInTransit;
+		out.mtu = peer->mtu;
+	}
+
+	void Metrics::on_tick(clock::duration tick_duration, size_t queue_depth) {
+		m_tick_count++;
+		m_tick_duration.record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(tick_duration).count());
+		m_queue_depth.record(queue_depth);
+
+		m_totals = {};
+		for (size_t i = 0; i < m_channels.size(); ++i) {
+			const auto& stats = m_channels.get_stats(channel_id(i));
+			m_totals.packets_sent += stats.packets_sent;
+			m_totals.bytes_sent += stats.bytes_sent;
+			m_totals.packets_received += stats.packets_received;
+			m_totals.bytes_received += stats.bytes_received;
+		}
+
+		const auto now = clock::now();
+		const auto elapsed = now - m_rate_start;
+		if (elapsed < RATE_WINDOW) {
+			return;
+		}
+
+		const double seconds = std::chrono::duration<double>(elapsed).count();
+		m_rates.packets_sent = (double)(m_totals.packets_sent - m_rate_totals.packets_sent) / seconds;
+		m_rates.bytes_sent = (double)(m_totals.bytes_sent - m_rate_totals.bytes_sent) / seconds;
+		m_rates.packets_received = (double)(m_totals.packets_received - m_rate_totals.packets_received) / seconds;
+		m_rates.bytes_received = (double)(m_totals.bytes_received - m_rate_totals.bytes_received) / seconds;
+
+		m_rate_totals = m_totals;
+		m_rate_start = now;
+	}
+
+	void Metrics::clear_histograms() {
+		m_tick_duration.clear();
+		m_queue_depth.clear();
+	}
+
+	static void write_prometheus_histogram(std::string& out, std::string_view prefix, const char* name, const char* help, const Histogram& histogram) {
+		auto it = std::back_inserter(out);
+		fmt::format_to(it, "# HELP {}_{} {}\n# TYPE {}_{} summary\n", prefix, name, help, prefix, name);
+		for (double quantile : { 0.5, 0.9, 0.99, 0.999 }) {
+			fmt::format_to(it, "{}_{}{{quantile=\"{}\"}} {}\n", prefix, name, quantile, histogram.get_percentile(quantile * 100.0));
+		}
+		fmt::format_to(it, "{}_{}_sum {}\n", prefix, name, histogram.get_mean() * (double)histogram.get_count());
+		fmt::format_to(it, "{}_{}_count {}\n", prefix, name, histogram.get_count());
+	}
+
+	std::string Metrics::to_prometheus(std::string_view prefix) const {
+		std::string out;
+		auto it = std::back_inserter(out);
+
+		auto metric = [&](const char* name, const char* type, const char* help) {
+			fmt::format_to(it, "# HELP {}_{} {}\n# TYPE {}_{} {}\n", prefix, name, help, prefix, name, type);
+		};
+
+		metric("ticks_total", "counter", "Host ticks since start.");
+		fmt::format_to(it, "{}_ticks_total {}\n", prefix, m_tick_count);
+
+		metric("peers", "gauge", "Connected peers.");
+		fmt::format_to(it, "{}_peers {}\n", prefix, m_peers.size());
+
+		write_prometheus_histogram(out, prefix, "tick_duration_microseconds", "Time spent in the host's tick.", m_tick_duration);
+		write_prometheus_histogram(out, prefix, "queue_depth_packets", "Received packets waiting for the game after each tick.", m_queue_depth);
+
+		struct Counter {
+			const char* name;
+			const char* help;
+			uint64_t Channel_Stats::* total;
+			double Traffic_Rates::* rate;
+		};
+
+		static constexpr Counter COUNTERS[] = {
+			{ "packets_sent", "ENet packets sent", &Channel_Stats::packets_sent, &Traffic_Rates::packets_sent },
+			{ "bytes_sent", "Payload bytes sent", &Channel_Stats::bytes_sent, &Traffic_Rates::bytes_sent },
+			{ "packets_received", "ENet packets received", &Channel_Stats::packets_received, &Traffic_Rates::packets_received },
+			{ "bytes_received", "Payload bytes received", &Channel_Stats::bytes_received, &Traffic_Rates::bytes_received },
+		};
+
+		for (const auto& counter : COUNTERS) {
+			const auto total = fmt::format("{}_total", counter.name);
+			metric(total.c_str(), "counter", fmt::format("{}.", counter.help).c_str());
+			for (size_t i = 0; i < m_channels.size(); ++i) {
+				const auto channel = channel_id(i);
+				fmt::format_to(it, "{}_{}{{channel=\"{}\"}} {}\n", prefix, total, m_channels.get_config(channel).name, m_channels.get_stats(channel).*counter.total);
+			}
+
+			const auto rate = fmt::format("{}_per_second", counter.name);
+			metric(rate.c_str(), "gauge", fmt::format("{} per second over the last rate window.", counter.help).c_str());
+			fmt::format_to(it, "{}_{} {}\n", prefix, rate, m_rates.*counter.rate);
+		}
+
+		if (m_peers.empty()) {
+			return out;
+		}
+
+		struct Peer_Gauge {
+			const char* name;
+			const char* type;
+			const char* help;
+			double (*get)(const Peer_Metrics&);
+		};
+
+		static constexpr Peer_Gauge PEER_GAUGES[] = {
+			{ "peer_rtt_milliseconds", "gauge", "Smoothed round trip time.", [](const Peer_Metrics& p) { return (double)p.link.rtt_ms; } },
+			{ "peer_rtt_variance_milliseconds", "gauge", "Round trip time variance.", [](const Peer_Metrics& p) { return (double)p.link.rtt_variance_ms; } },
+			{ "peer_packet_loss_ratio", "gauge", "Reliable packet loss over the last loss interval.", [](const Peer_Metrics& p) { return (double)p.link.packet_loss; } },
+			{ "peer_packet_throttle_ratio", "gauge", "Fraction of unreliable packets ENet lets through.", [](const Peer_Metrics& p) { return (double)p.link.packet_throttle; } },
+			{ "peer_reliable_in_transit_bytes", "gauge", "Reliable bytes sent but not yet acknowledged.", [](const Peer_Metrics& p) { return (double)p.link.reliable_in_transit; } },
+			{ "peer_packets_sent_total", "counter", "ENet packets sent to the peer.", [](const Peer_Metrics& p) { return (double)p.traffic.packets_sent; } },
+			{ "peer_bytes_sent_total", "counter", "Payload bytes sent to the peer.", [](const Peer_Metrics& p) { return (double)p.traffic.bytes_sent; } },
+			{ "peer_packets_received_total", "counter", "ENet packets received from the peer.", [](const Peer_Metrics& p) { return (double)p.traffic.packets_received; } },
+			{ "peer_bytes_received_total", "counter", "Payload bytes received from the peer.", [](const Peer_Metrics& p) { return (double)p.traffic.bytes_received; } },
+		};
+
+		for (const auto& gauge : PEER_GAUGES) {
+			metric(gauge.name, gauge.type, gauge.help);
+			for (const auto& peer : m_peers) {
+				fmt::format_to(it, "{}_{}{{peer=\"{}\"}} {}\n", prefix, gauge.name, peer.id, gauge.get(peer));
+			}
+		}
+
+		return out;
+	}
+
+	static void write_json_histogram(std::string& out, const char* name, const Histogram& histogram) {
+		fmt::format_to(std::back_inserter(out), "\"{}\": {{\"count\": {}, \"min\": {}, \"mean\": {}, \"p50\": {}, \"p99\": {}, \"p999\": {}, \"max\": {}}}",
+			name, histogram.get_count(), histogram.get_min(), histogram.get_mean(),
+			histogram.get_percentile(50.0), histogram.get_percentile(99.0), histogram.get_percentile(99.9), histogram.get_max());
+	}
+
+	static void write_json_traffic(std::string& out, const char* name, const Channel_Stats& stats) {
+		fmt::format_to(std::back_inserter(out), "\"{}\": {{\"packets_sent\": {}, \"bytes_sent\": {}, \"packets_received\": {}, \"bytes_received\": {}}}",
+			name, stats.packets_sent, stats.bytes_sent, stats.packets_received, stats.bytes_received);
+	}
+
+	std::string Metrics::to_json() const {
+		std::string out;
+		auto it = std::back_inserter(out);
+
+		fmt::format_to(it, "{{\"ticks\": {}, ", m_tick_count);
+		write_json_histogram(out, "tick_duration_us", m_tick_duration);
+		out += ", ";
+		write_json_histogram(out, "queue_depth", m_queue_depth);
+		out += ", ";
+		write_json_traffic(out, "totals", m_totals);
+		fmt::format_to(it, ", \"per_second\": {{\"packets_sent\": {}, \"bytes_sent\": {}, \"packets_received\": {}, \"bytes_received\": {}}}",
+			m_rates.packets_sent, m_rates.bytes_sent, m_rates.packets_received, m_rates.bytes_received);
+
+		out += ", \"channels\": [";
+		for (size_t i = 0; i < m_channels.size(); ++i) {
+			const auto channel = channel_id(i);
+			fmt::format_to(it, "{}{{\"name\": \"{}\", ", i > 0 ? ", " : "", m_channels.get_config(channel).name);
+			write_json_traffic(out, "traffic", m_channels.get_stats(channel));
+			out += "}";
+		}
+
+		out += "], \"peers\": [";
+		for (size_t i = 0; i < m_peers.size(); ++i) {
+			const auto& peer = m_peers[i];
+			fmt::format_to(it, "{}{{\"id\": {}, \"rtt_ms\": {}, \"rtt_variance_ms\": {}, \"last_rtt_ms\": {}, \"packet_loss\": {}, \"packet_loss_variance\": {}, \"packet_throttle\": {}, \"reliable_in_transit\": {}, \"mtu\": {}, ",
+				i > 0 ? ", " : "", peer.id, peer.link.rtt_ms, peer.link.rtt_variance_ms, peer.link.last_rtt_ms,
+				peer.link.packet_loss, peer.link.packet_loss_variance, peer.link.packet_throttle, peer.link.reliable_in_transit, peer.link.mtu);
+			write_json_traffic(out, "traffic", peer.traffic);
+			out += "}";
+		}
+		out += "]}\n";
+
+		return out;
+	}
+
+	bool Metrics::write_file(const char* path, Format format) const {
+		const std::string contents = format == FORMAT_JSON ? to_json() : to_prometheus();
+		const std::string temp_path = fmt::format("{}.tmp", path);
+
+		std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+
+		const bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+		if (std::fclose(file) != 0 || !written) {
+			std::remove(temp_path.c_str());
+			return false;
+		}
+
+#ifdef _WIN32
+		// std::rename doesn't replace an existing file on Windows.
+		std::remove(path);
+#endif
+		return std::rename(temp_path.c_str(), path) == 0;
+	}
+}
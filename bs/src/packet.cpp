@@ -1,8 +1,11 @@
 #include "bs/packet.h"
+#include "bs/transport.h"
 #include "bs/utils.h"
 
 #include <enet/enet.h>
 
+#include <atomic>
+
 namespace bs {
 	static Packet::Type get_type_from_enet_type(ENetEventType type) {
 		switch (type) {
@@ -14,45 +17,166 @@ namespace bs {
 		}
 	}
 
-	Packet::Packet(_ENetPeer* peer, void* data, size_t data_length) : m_peer(peer) {
+	Packet::Packet(_ENetPeer* peer, const void* data, size_t data_length) : m_peer(peer) {
 		set_bytes(data, data_length);
 	}
 
+	Packet::Packet(_ENetPeer* peer, _ENetPacket* packet)
+		: m_peer(peer) {
+		reset(packet);
+	}
+
 	Packet::Packet(const _ENetEvent* event)
 		: m_peer(event->peer) {
-		if (event->packet && event->packet->dataLength > 0) {
-			m_bytes.assign(event->packet->data, event->packet->data + event->packet->dataLength);
-		}
+		// Adopt the received packet. ENet hands it over with no references
+		// so we take the first one here and destroy it when we drop it.
+		reset(event->packet);
 		m_type = get_type_from_enet_type(event->type);
+		m_channel = channel_id(event->channelID);
 	}
 
 	Packet::Packet(_ENetPeer* peer)
 		: m_peer(peer) {
 	}
 
-
 	Packet::~Packet() {
+		reset(nullptr);
 	}
 
-	std::string Packet::get_string() const {
-		std::string result = "";
+	Packet::Packet(const Packet& other)
+		: m_client_id(other.m_client_id), m_type(other.m_type), m_channel(other.m_channel), m_peer(other.m_peer),
+		m_view_offset(other.m_view_offset), m_view_length(other.m_view_length) {
+		reset(other.m_packet);
+	}
+
+	Packet& Packet::operator=(const Packet& other) {
+		if (this != &other) {
+			m_client_id = other.m_client_id;
+			m_type = other.m_type;
+			m_channel = other.m_channel;
+			m_peer = other.m_peer;
+			m_view_offset = other.m_view_offset;
+			m_view_length = other.m_view_length;
+			reset(other.m_packet);
+		}
+		return *this;
+	}
+
+	Packet::Packet(Packet&& other) noexcept
+		: m_client_id(other.m_client_id), m_type(other.m_type), m_channel(other.m_channel), m_peer(other.m_peer), m_packet(other.m_packet),
+		m_view_offset(other.m_view_offset), m_view_length(other.m_view_length) {
+		other.m_packet = nullptr;
+	}
+
+	Packet& Packet::operator=(Packet&& other) noexcept {
+		if (this != &other) {
+			reset(nullptr);
+			m_client_id = other.m_client_id;
+			m_type = other.m_type;
+			m_channel = other.m_channel;
+			m_peer = other.m_peer;
+			m_packet = other.m_packet;
+			m_view_offset = other.m_view_offset;
+			m_view_length = other.m_view_length;
+			other.m_packet = nullptr;
+		}
+		return *this;
+	}
+
+	void Packet::retain(_ENetPacket* packet) {
+		std::atomic_ref<size_t>(packet->referenceCount).fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void Packet::release(_ENetPacket* packet) {
+		if (std::atomic_ref<size_t>(packet->referenceCount).fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			enet_packet_destroy(packet);
+		}
+	}
+
+	void Packet::reset(_ENetPacket* packet) {
+		if (packet) {
+			retain(packet);
+		}
 
-		if (!m_bytes.empty()) {
-			result.assign(reinterpret_cast<const char*>(m_bytes.data()), m_bytes.size());
+		if (m_packet) {
+			release(m_packet);
 		}
 
-		return result;
+		m_packet = packet;
 	}
 
-	std::vector<uint8_t> Packet::get_bytes() const {
-		return m_bytes;
+	void Packet::set_bytes(const void* data, size_t length) {
+		ENetPacket* packet = enet_packet_create(data, length, 0);
+		ASSERT_PANIC(packet != nullptr, "Error creating packet");
+		reset(packet);
+		m_view_offset = 0;
+		m_view_length = 0;
+	}
+
+	Packet Packet::make_view(size_t offset, size_t length) const {
+		ASSERT_PANIC(length > 0, "Trying to make an empty packet view");
+		ASSERT_PANIC(offset + length <= get_bytes().size(), "Packet view is out of range: {} + {}", offset, length);
+
+		Packet view(*this);
+		view.m_view_offset = m_view_offset + (uint32_t)offset;
+		view.m_view_length = (uint32_t)length;
+		return view;
+	}
+
+	std::string Packet::get_string() const {
+		const auto bytes = get_bytes();
+		return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	}
+
+	std::span<const uint8_t> Packet::get_bytes() const {
+		if (!m_packet) {
+			return {};
+		}
+
+		if (is_view()) {
+			return { m_packet->data + m_view_offset, m_view_length };
+		}
+
+		return { m_packet->data, m_packet->dataLength };
 	}
 
 	void Packet::send(bool reliable) {
-		ASSERT_PANIC(m_peer, "Peer is null");
-		ASSERT_PANIC(!m_bytes.empty(), "Bytes are empty");
+		if (reliable) {
+			send_to(m_peer, CHANNEL_RELIABLE, DELIVERY_RELIABLE);
+		}
+		else {
+			send_to(m_peer, CHANNEL_UNRELIABLE, DELIVERY_UNRELIABLE_SEQUENCED);
+		}
+	}
+
+	void Packet::send_to(_ENetPeer* peer, channel_id channel, Delivery delivery) const {
+		ASSERT_PANIC(peer, "Peer is null");
+		ASSERT_PANIC(m_packet && m_packet->dataLength > 0, "Bytes are empty");
+
+		if (is_view()) {
+			const auto bytes = get_bytes();
+			Packet(peer, bytes.data(), bytes.size()).send_to(peer, channel, delivery);
+			return;
+		}
+
+		// Only a plain ENet host's peers can be sent to directly, anything
+		// else has to go through the host that owns the peer. Claims are
+		// only looked up in debug builds, sends shouldn't pay for them.
+		ASSERT_PANIC(peer->host, "Packet::send_to needs an ENet peer, send through the host on other transports");
+		if (const char* owner = get_enet_host_owner(peer->host)) {
+			PANIC("Packet::send_to would go around {} that owns the peer, send through the host instead", owner);
+		}
+
+		set_delivery(delivery);
+		enet_peer_send(peer, (enet_uint8)channel, m_packet);
+	}
+
+	void Packet::set_delivery(Delivery delivery) const {
+		ASSERT_PANIC(!is_view(), "Trying to set the delivery of a packet view");
 
-		enet_peer_send(m_peer, 0,
-			enet_packet_create(m_bytes.data(), m_bytes.size(), (reliable ? ENET_PACKET_FLAG_RELIABLE : 0)));
+		// The delivery flags are only read when the packet is queued so the
+		// same packet can be sent with a different mode to another peer.
+		constexpr enet_uint32 DELIVERY_FLAGS = ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+		m_packet->flags = (m_packet->flags & ~DELIVERY_FLAGS) | get_enet_packet_flags(delivery);
 	}
 }
@@ -0,0 +1,86 @@
+#include "bs/packet_pool.h"
+
+#include <enet/enet.h>
+
+#include <new>
+
+namespace bs {
+	// Sits in front of every block. The padding keeps the usable part of the
+	// block as aligned as operator new would have made it.
+	struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Block_Header {
+		Packet_Pool* pool = nullptr;
+		size_t capacity = 0;
+	};
+
+	static Block_Header* get_header(uint8_t* block) {
+		return reinterpret_cast<Block_Header*>(block - sizeof(Block_Header));
+	}
+
+	static void free_pooled_packet(ENetPacket* packet) {
+		auto* block = static_cast<uint8_t*>(packet->userData);
+		get_header(block)->pool->deallocate(block);
+	}
+
+	Packet_Pool::~Packet_Pool() {
+		for (auto* block : m_free) {
+			delete[] (block - sizeof(Block_Header));
+		}
+	}
+
+	Packet_Pool& Packet_Pool::get() {
+		static Packet_Pool* pool = new Packet_Pool();
+		return *pool;
+	}
+
+	uint8_t* Packet_Pool::allocate(size_t size) {
+		if (size <= BLOCK_SIZE) {
+			std::lock_guard lock(m_mutex);
+			if (!m_free.empty()) {
+				auto* block = m_free.back();
+				m_free.pop_back();
+				return block;
+			}
+		}
+
+		const size_t capacity = size <= BLOCK_SIZE ? BLOCK_SIZE : size;
+		auto* memory = new uint8_t[sizeof(Block_Header) + capacity];
+		new (memory) Block_Header{ this, capacity };
+		return memory + sizeof(Block_Header);
+	}
+
+	void Packet_Pool::deallocate(uint8_t* block) {
+		if (!block) {
+			return;
+		}
+
+		auto* header = get_header(block);
+		ASSERT_PANIC(header->pool == this, "Block returned to the wrong packet pool");
+
+		if (header->capacity == BLOCK_SIZE) {
+			std::lock_guard lock(m_mutex);
+			if (m_free.size() < MAX_FREE_BLOCKS) {
+				m_free.push_back(block);
+				return;
+			}
+		}
+
+		delete[] reinterpret_cast<uint8_t*>(header);
+	}
+
+	Packet Packet_Pool::adopt(_ENetPeer* peer, uint8_t* block, size_t offset, size_t length) {
+		ASSERT_PANIC(block != nullptr, "Trying to adopt a null block");
+		ASSERT_PANIC(offset + length <= get_header(block)->capacity, "Packet is out of the block's range: {} + {}", offset, length);
+
+		ENetPacket* packet = enet_packet_create(block + offset, length, ENET_PACKET_FLAG_NO_ALLOCATE);
+		ASSERT_PANIC(packet != nullptr, "Error creating packet");
+
+		packet->userData = block;
+		packet->freeCallback = free_pooled_packet;
+		return Packet(peer, packet);
+	}
+
+	size_t Packet_Pool::get_free_count() {
+		std::lock_guard lock(m_mutex);
+		return m_free.size();
+	}
+}
@@ -0,0 +1,468 @@
+#include "bs/packet_recording.h"
+
+#include <enet/enet.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bs {
+	namespace {
+		constexpr uint32_t RECORDING_MAGIC = 0x43525342; // "BSRC"
+		constexpr uint32_t RECORDING_VERSION = 1;
+
+		struct File_Header {
+			uint32_t magic = RECORDING_MAGIC;
+			uint32_t version = RECORDING_VERSION;
+			uint64_t reserved = 0;
+		};
+		static_assert(sizeof(File_Header) == 16, "File_Header is written to disk as it is");
+
+		// The file grows by at least this much at a time so remapping is rare.
+		constexpr size_t GROW_SIZE = 4 * 1024 * 1024;
+
+		constexpr size_t align_record(size_t size) {
+			return (size + 7) & ~(size_t)7;
+		}
+	}
+
+	Packet_Recorder::Packet_Recorder(logger_t& logger)
+		: m_logger(logger) {}
+
+	Packet_Recorder::~Packet_Recorder() {
+		close();
+	}
+
+	bool Packet_Recorder::open(const char* path) {
+		close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			m_logger->error("Failed to create recording {}", path);
+			return false;
+		}
+		m_file = file;
+#else
+		m_file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_file < 0) {
+			m_logger->error("Failed to create recording {}", path);
+			return false;
+		}
+#endif
+
+		m_path = path;
+		m_size = 0;
+		m_records = 0;
+		if (!map(GROW_SIZE)) {
+			close();
+			return false;
+		}
+
+		const File_Header header;
+		std::memcpy(m_data, &header, sizeof(header));
+		m_size = sizeof(header);
+		m_start = std::chrono::steady_clock::now();
+
+		m_logger->info("Recording packets to {}", path);
+		return true;
+	}
+
+	void Packet_Recorder::close() {
+		unmap();
+
+#ifdef _WIN32
+		if (m_file) {
+			// Cut off what was grown but never written.
+			LARGE_INTEGER size;
+			size.QuadPart = (LONGLONG)m_size;
+			SetFilePointerEx(m_file, size, nullptr, FILE_BEGIN);
+			SetEndOfFile(m_file);
+			CloseHandle(m_file);
+			m_file = nullptr;
+		}
+#else
+		if (m_file >= 0) {
+			if (ftruncate(m_file, (off_t)m_size) != 0) {
+				m_logger->warn("Failed to trim recording {}", m_path);
+			}
+			::close(m_file);
+			m_file = -1;
+		}
+#endif
+
+		if (!m_path.empty()) {
+			m_logger->info("Recorded {} packets ({} bytes) to {}", m_records, m_size, m_path);
+			m_path.clear();
+		}
+		m_capacity = 0;
+	}
+
+	void Packet_Recorder::record_inbound(uint32_t tick, const Packet& packet) {
+		Record_Header header;
+		header.tick = tick;
+		header.id = packet.get_client_id();
+		header.direction = RECORD_INBOUND;
+		header.type = (uint8_t)packet.get_type();
+		header.channel = (uint8_t)packet.get_channel();
+
+		// Connects and disconnects carry no data worth keeping.
+		append(header, packet.get_type() == Packet::EVENT_RECIEVED ? packet.get_bytes() : std::span<const uint8_t>{});
+	}
+
+	void Packet_Recorder::record_outbound(uint32_t tick, const Packet& packet, channel_id channel, Record_Target target, int32_t id) {
+		Record_Header header;
+		header.tick = tick;
+		header.id = id;
+		header.direction = RECORD_OUTBOUND;
+		header.channel = (uint8_t)channel;
+		header.target = target;
+		append(header, packet.get_bytes());
+	}
+
+	void Packet_Recorder::append(const Record_Header& record, std::span<const uint8_t> payload) {
+		if (!m_data) {
+			return;
+		}
+
+		const size_t size = sizeof(Record_Header) + align_record(payload.size());
+		if (!reserve(m_size + size)) {
+			return;
+		}
+
+		Record_Header header = record;
+		header.time_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+		header.size = (uint32_t)payload.size();
+
+		// Payload first, the header's direction is what marks the record as
+		// there if the process dies half way.
+		std::memcpy(m_data + m_size + sizeof(Record_Header), payload.data(), payload.size());
+		std::memcpy(m_data + m_size, &header, sizeof(header));
+		m_size += size;
+		m_records++;
+	}
+
+	bool Packet_Recorder::reserve(size_t size) {
+		if (size <= m_capacity) {
+			return true;
+		}
+
+		const size_t capacity = std::max(m_capacity * 2, (size + GROW_SIZE - 1) / GROW_SIZE * GROW_SIZE);
+		unmap();
+		if (!map(capacity)) {
+			// Nothing more can be written, keep what's there.
+			m_logger->error("Failed to grow recording {} to {} bytes, recording stopped", m_path, capacity);
+			return false;
+		}
+		return true;
+	}
+
+	bool Packet_Recorder::map(size_t capacity) {
+#ifdef _WIN32
+		LARGE_INTEGER size;
+		size.QuadPart = (LONGLONG)capacity;
+		if (!SetFilePointerEx(m_file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file)) {
+			return false;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		if (!m_mapping) {
+			return false;
+		}
+
+		m_data = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, capacity);
+		if (!m_data) {
+			CloseHandle(m_mapping);
+			m_mapping = nullptr;
+			return false;
+		}
+#else
+		if (ftruncate(m_file, (off_t)capacity) != 0) {
+			return false;
+		}
+
+		void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+		m_data = (uint8_t*)data;
+#endif
+
+		m_capacity = capacity;
+		return true;
+	}
+
+	void Packet_Recorder::unmap() {
+		if (!m_data) {
+			return;
+		}
+
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+#else
+		munmap(m_data, m_capacity);
+#endif
+		m_data = nullptr;
+	}
+
+	Packet_Recording::~Packet_Recording() {
+		close();
+	}
+
+	bool Packet_Recording::open(const char* path) {
+		close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size{};
+		GetFileSizeEx(file, &size);
+		m_file = file;
+		m_size = (size_t)size.QuadPart;
+		if (m_size < sizeof(File_Header)) {
+			close();
+			return false;
+		}
+
+		m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		m_data = m_mapping ? (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+		const int file = ::open(path, O_RDONLY);
+		if (file < 0) {
+			return false;
+		}
+
+		struct stat info {};
+		if (fstat(file, &info) != 0 || (size_t)info.st_size < sizeof(File_Header)) {
+			::close(file);
+			return false;
+		}
+
+		// The mapping keeps the file alive on its own.
+		m_size = (size_t)info.st_size;
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, file, 0);
+		::close(file);
+		m_data = data == MAP_FAILED ? nullptr : (const uint8_t*)data;
+#endif
+
+		File_Header header;
+		if (!m_data || (std::memcpy(&header, m_data, sizeof(header)), header.magic != RECORDING_MAGIC || header.version != RECORDING_VERSION)) {
+			close();
+			return false;
+		}
+
+		size_t offset = begin();
+		Packet_Record record;
+		while (read(offset, record)) {
+			if (m_records == 0) {
+				m_first_tick = record.header->tick;
+			}
+			m_last_tick = record.header->tick;
+			m_duration_ns = record.header->time_ns;
+			m_records++;
+		}
+
+		return true;
+	}
+
+	void Packet_Recording::close() {
+#ifdef _WIN32
+		if (m_data) {
+			UnmapViewOfFile(m_data);
+		}
+		if (m_mapping) {
+			CloseHandle(m_mapping);
+			m_mapping = nullptr;
+		}
+		if (m_file) {
+			CloseHandle(m_file);
+			m_file = nullptr;
+		}
+#else
+		if (m_data) {
+			munmap((void*)m_data, m_size);
+		}
+#endif
+
+		m_data = nullptr;
+		m_size = 0;
+		m_records = 0;
+		m_first_tick = 0;
+		m_last_tick = 0;
+		m_duration_ns = 0;
+	}
+
+	size_t Packet_Recording::begin() const {
+		return sizeof(File_Header);
+	}
+
+	bool Packet_Recording::read(size_t& offset, Packet_Record& out) const {
+		if (!m_data || offset + sizeof(Record_Header) > m_size) {
+			return false;
+		}
+
+		// The writer keeps records 8 byte aligned from the mapping's start.
+		const auto* header = (const Record_Header*)(m_data + offset);
+		if (header->direction == RECORD_NONE || offset + sizeof(Record_Header) + header->size > m_size) {
+			return false;
+		}
+
+		out.header = header;
+		out.payload = { m_data + offset + sizeof(Record_Header), header->size };
+		offset += sizeof(Record_Header) + align_record(header->size);
+		return true;
+	}
+
+	Packet_Replayer::Packet_Replayer(const Packet_Recording& recording, Transport_Factory& transports, const char* host, int32_t port, const Channel_Set& channels, logger_t& logger)
+		: m_recording(recording), m_transports(transports), m_host(host), m_port(port), m_channels(channels), m_logger(logger), m_offset(recording.begin()) {}
+
+	Packet_Replayer::~Packet_Replayer() = default;
+
+	bool Packet_Replayer::play_until(uint32_t tick) {
+		// Take whatever the host sent back and send anything held back for a
+		// connection that has since been accepted.
+		for (auto& [id, client] : m_clients) {
+			service(client);
+		}
+
+		Packet_Record record;
+		size_t next = m_offset;
+		while (m_recording.read(next, record) && record.header->tick <= tick) {
+			m_offset = next;
+			if (record.header->direction != RECORD_INBOUND) {
+				continue;
+			}
+
+			const int32_t id = record.header->id;
+			switch ((Packet::Type)record.header->type) {
+			case Packet::CONNECT: {
+				auto& client = m_clients[id];
+				client = {};
+				client.transport = m_transports.create_client();
+				client.peer = client.transport ? client.transport->connect(m_host.c_str(), m_port, m_channels.size()) : nullptr;
+				if (!client.peer) {
+					m_logger->error("Replayed client {} failed to connect to {}:{}", id, m_host, m_port);
+				}
+			} break;
+
+			case Packet::DISCONNECT: {
+				// Dropping the transport closes the connection, the host sees
+				// it on its next tick. Anything still waiting on the connection
+				// never gets sent.
+				if (auto it = m_clients.find(id); it != m_clients.end()) {
+					m_dropped += it->second.pending.size();
+					m_clients.erase(it);
+				}
+			} break;
+
+			case Packet::EVENT_RECIEVED: {
+				auto it = m_clients.find(id);
+				if (it == m_clients.end() || !it->second.peer) {
+					m_dropped++;
+					break;
+				}
+
+				if (it->second.connected) {
+					send(it->second, record);
+				}
+				else {
+					it->second.pending.push_back(record);
+				}
+			} break;
+
+			default: break;
+			}
+		}
+
+		for (auto& [id, client] : m_clients) {
+			if (client.transport) {
+				client.transport->flush();
+			}
+		}
+
+		return !is_done();
+	}
+
+	bool Packet_Replayer::is_done() const {
+		size_t offset = m_offset;
+		Packet_Record record;
+		if (m_recording.read(offset, record)) {
+			return false;
+		}
+
+		for (const auto& [id, client] : m_clients) {
+			if (!client.pending.empty()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Packet_Replayer::service(Client& client) {
+		if (!client.transport) {
+			return;
+		}
+
+		ENetEvent event{};
+		while (client.transport->service(&event, 0) > 0) {
+			switch (event.type) {
+			case ENET_EVENT_TYPE_CONNECT:
+				client.connected = true;
+				break;
+
+			case ENET_EVENT_TYPE_DISCONNECT:
+				client.connected = false;
+				client.peer = nullptr;
+				break;
+
+			case ENET_EVENT_TYPE_RECEIVE: {
+				// Adopting the packet frees it.
+				Packet packet(&event);
+				m_received++;
+			} break;
+
+			default: break;
+			}
+		}
+
+		while (client.connected && !client.pending.empty()) {
+			send(client, client.pending.front());
+			client.pending.pop_front();
+		}
+		m_dropped += client.peer ? 0 : client.pending.size();
+		if (!client.peer) {
+			client.pending.clear();
+		}
+	}
+
+	void Packet_Replayer::send(Client& client, const Packet_Record& record) {
+		const channel_id channel{ record.header->channel };
+		if (!m_channels.is_valid(channel) || record.payload.empty()) {
+			m_dropped++;
+			return;
+		}
+
+		Packet packet(client.peer, record.payload.data(), record.payload.size());
+		packet.set_delivery(m_channels.get_config(channel).delivery);
+		if (client.transport->send(client.peer, channel, packet.get_enet_packet())) {
+			m_played++;
+		}
+		else {
+			m_dropped++;
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#include "bs/packet_sender.h"
+#include "bs/server_client.h"
+
+#include <enet/enet.h>
+
+namespace bs {
+	uint32_t get_enet_packet_flags(Delivery delivery) {
+		switch (delivery) {
+		case DELIVERY_RELIABLE: return ENET_PACKET_FLAG_RELIABLE;
+		// Let large unreliable packets fragment unreliably too, otherwise ENet
+		// sends the fragments reliably.
+		case DELIVERY_UNRELIABLE_SEQUENCED: return ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+		case DELIVERY_UNSEQUENCED: return ENET_PACKET_FLAG_UNSEQUENCED | ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+		default: UNREACHABLE(); return 0;
+		}
+	}
+
+	Delivery get_delivery(uint32_t enet_flags) {
+		if (enet_flags & ENET_PACKET_FLAG_RELIABLE) {
+			return DELIVERY_RELIABLE;
+		}
+
+		return (enet_flags & ENET_PACKET_FLAG_UNSEQUENCED) ? DELIVERY_UNSEQUENCED : DELIVERY_UNRELIABLE_SEQUENCED;
+	}
+
+	void Packet_Sender::send(_ENetPeer* peer, const Packet& packet, channel_id channel) {
+		ASSERT_PANIC(peer != nullptr, "Trying to send a packet without a peer");
+		ASSERT_PANIC(!packet.get_bytes().empty(), "Trying to send a packet but the data is empty");
+		ASSERT_PANIC(m_channels.is_valid(channel), "Trying to send on an unknown channel: {}", (size_t)channel);
+
+		if (!m_batching) {
+			send_now(peer, packet, channel);
+			return;
+		}
+
+		auto& channels = m_batches[peer];
+		if (channels.size() <= (size_t)channel) {
+			channels.resize((size_t)channel + 1);
+		}
+		channels[(size_t)channel].push_back(packet);
+	}
+
+	void Packet_Sender::set_batching(bool enabled, size_t max_frame_size) {
+		ASSERT_PANIC(max_frame_size > BATCH_HEADER_SIZE, "Batch frame size is too small: {}", max_frame_size);
+
+		// Don't strand anything batched under the old settings.
+		flush();
+		m_batching = enabled;
+		m_max_frame_size = max_frame_size;
+	}
+
+	void Packet_Sender::flush() {
+		for (auto& [peer, channels] : m_batches) {
+			for (size_t channel = 0; channel < channels.size(); ++channel) {
+				if (!channels[channel].empty()) {
+					flush_batch(peer, channel_id(channel), channels[channel]);
+				}
+			}
+		}
+	}
+
+	void Packet_Sender::flush_batch(_ENetPeer* peer, channel_id channel, std::vector<Packet>& messages) {
+		size_t first = 0;
+		while (first < messages.size()) {
+			// Take as many messages as fit in one frame.
+			size_t last = first;
+			size_t frame_size = BATCH_HEADER_SIZE;
+			while (last < messages.size() && last - first < MAX_BATCH_MESSAGES) {
+				const size_t entry_size = get_batch_entry_size(messages[last].get_bytes().size());
+				if (frame_size + entry_size > m_max_frame_size) {
+					break;
+				}
+				frame_size += entry_size;
+				last++;
+			}
+
+			// No point framing a single message, and one too big to fit goes alone.
+			if (last - first <= 1) {
+				send_now(peer, messages[first], channel);
+				first++;
+				continue;
+			}
+
+			write_batch_frame({ messages.data() + first, last - first }, m_frame);
+			send_now(peer, Packet(peer, m_frame.data(), m_frame.size()), channel);
+			first = last;
+		}
+
+		messages.clear();
+	}
+
+	void Packet_Sender::send_now(_ENetPeer* peer, const Packet& packet, channel_id channel) {
+		const auto bytes = packet.get_bytes();
+		const auto delivery = m_channels.get_config(channel).delivery;
+		m_channels.on_sent(channel, bytes.size());
+
+		if (m_client_traffic && peer->data) {
+			auto* client = static_cast<Server_Client*>(peer->data);
+			client->on_sent(bytes.size());
+		}
+
+		// Transports send whole ENet packets so views are copied here.
+		const Packet copy = packet.is_view() ? Packet(peer, bytes.data(), bytes.size()) : Packet();
+		const Packet& whole = packet.is_view() ? copy : packet;
+
+		if (m_io_thread) {
+			m_io_thread->submit(peer, whole, channel, delivery);
+		}
+		else {
+			ASSERT_PANIC(m_transport != nullptr, "Trying to send before the host has started");
+			whole.set_delivery(delivery);
+			m_transport->send(peer, channel, whole.get_enet_packet());
+		}
+	}
+}
@@ -12,68 +12,178 @@
 #include "bs/packet.h"
 
 namespace bs {
-	Host_Server::Host_Server(const char* host, int32_t port, int32_t max_clients, logger_t& logger)
-		: m_host(host), m_port(port), m_max_clients(max_clients), m_logger(logger), m_client_manager(logger)
+	Host_Server::Host_Server(const char* host, int32_t port, int32_t max_clients, logger_t& logger, Transport_Factory& transports)
+		: m_transports(transports), m_host(host), m_port(port), m_max_clients(max_clients), m_logger(logger), m_sender(logger), m_client_manager(max_clients, m_sender, logger), m_io_thread(logger), m_metrics(m_sender.get_channels())
 	{
+		m_sender.set_client_traffic(true);
 	}
 
 	Host_Server::~Host_Server() {
-		enet_host_destroy(m_server);
+		// The I/O thread has to let go of the transport before it is destroyed.
+		m_io_thread.stop();
+		m_transport.reset();
 	}
 
-	void Host_Server::start() {
-		ENetAddress address;
-		enet_address_set_host(&address, m_host);
-		address.port = m_port;
-
-		if (m_server = enet_host_create(&address, m_max_clients, 0, 0, 0); m_server == nullptr) {
-			PANIC("An error occurred while trying to create an ENet server.");
+	void Host_Server::start(Io_Mode io_mode) {
+		const size_t channel_count = get_channels().size();
+		if (m_transport = m_transports.create_server(m_host, m_port, m_max_clients, channel_count); m_transport == nullptr) {
+			PANIC("An error occurred while trying to create the server transport.");
 		}
 
-		m_logger->info("Server now running on {}:{}", m_host, m_port);
+		m_logger->info("Server now running on {}:{} with {} channels", m_host, m_port, channel_count);
+
+		m_sender.set_transport(m_transport.get());
+
+		m_io_mode = io_mode;
+		if (m_io_mode == IO_THREADED) {
+			m_sender.set_io_thread(&m_io_thread);
+			m_io_thread.start(m_transport.get());
+		}
 	}
 
 	void Host_Server::on_client_connect(Packet& packet) {
 		auto client = m_client_manager.add_client(packet.get_peer());
 
-		m_logger->info("Adding new client to client manager at slot: {}", client->get_id());
 		ASSERT_PANIC(client != nullptr, "Error trying to add new client");
+		m_logger->info("Adding new client to client manager with id: {}", client->get_id());
 		client->connect();
+		packet.set_client_id(client->get_id());
 	}
 
 	void Host_Server::on_client_disconnect(Packet& packet) {
 		m_logger->info("Disconnecting client: {}", (size_t)packet.get_peer());
 		m_client_manager.disconnect_client(packet.get_peer());
+		m_sender.drop(packet.get_peer());
 	}
 
-	void Host_Server::tick(uint32_t timeout_ms) {
-		ENetEvent enet_event{};
-		while (enet_host_service(m_server, &enet_event, timeout_ms) > 0) {
-			Packet packet(&enet_event);
+	void Host_Server::on_packet(Packet&& packet) {
+		// If there is a stored client attached to this peer then add that to the packet.
+		auto client = m_client_manager.get_client(packet.get_peer());
+		if (client) {
+			packet.set_client_id(client->get_id());
+		}
 
-			// If there is a stored client attached to this peer then add that to the packet.
-			auto client = m_client_manager.get_client(enet_event.peer);
+		switch (packet.get_type()) {
+		case Packet::EVENT_RECIEVED: {
+			get_channels().on_received(packet.get_channel(), packet.get_bytes().size());
 			if (client) {
-				packet.set_client_id(client->get_id());
+				client->on_received(packet.get_bytes().size());
+			}
+
+			if (is_batch_frame(packet.get_bytes())) {
+				const bool unpacked = unpack_batch_frame(packet, [this](Packet&& message) {
+					push_packet(std::move(message));
+					});
+
+				if (!unpacked) {
+					m_logger->warn("Dropping malformed batch frame from client: {}", packet.get_client_id());
+				}
+				return;
+			}
+		} break;
+
+		case Packet::CONNECT: {
+			on_client_connect(packet);
+		} break;
+
+		case Packet::DISCONNECT: {
+			on_client_disconnect(packet);
+		} break;
+
+		default: break;
+		}
+
+		push_packet(std::move(packet));
+	}
+
+	void Host_Server::push_packet(Packet&& packet) {
+		if (m_recorder) {
+			m_recorder->record_inbound(m_tick, packet);
+		}
+
+		// tick() keeps room for a whole batch frame so this can't fail.
+		const bool pushed = m_packets.push(std::move(packet));
+		ASSERT_PANIC(pushed, "Server packet queue overflowed");
+	}
+
+	void Host_Server::tick(uint32_t timeout_ms) {
+		const auto tick_start = Metrics::clock::now();
+		m_tick++;
+
+		m_sender.flush();
+
+		if (m_io_mode == IO_THREADED) {
+			// The I/O thread is already servicing ENet, just take what it received.
+			auto& ingress = m_io_thread.get_ingress();
+			Packet packet;
+			while (m_packets.has_room_for(MAX_BATCH_MESSAGES) && ingress.pop(packet)) {
+				on_packet(std::move(packet));
 			}
-			m_packets.push_front(packet);
+		}
+		else {
+			ENetEvent enet_event{};
 
-			switch (packet.get_type()) {
-			case Packet::CONNECT: {
-				on_client_connect(packet);
-			} break;
+			// Leave events inside ENet while the game hasn't drained the queue.
+			// Any event could be a batch frame so keep room for a full one.
+			while (m_packets.has_room_for(MAX_BATCH_MESSAGES) && m_transport->service(&enet_event, timeout_ms) > 0) {
+				on_packet(Packet(&enet_event));
+			}
+		}
 
-			case Packet::DISCONNECT: {
-				on_client_disconnect(packet);
-			} break;
+		update_metrics(tick_start);
+	}
+
+	void Host_Server::update_metrics(Metrics::clock::time_point tick_start) {
+		auto& peers = m_metrics.get_peers();
+		peers.clear();
+
+		size_t queue_depth = m_packets.size();
 
-			default: break;
+		if (m_io_mode == IO_THREADED) {
+			// The peers belong to the I/O thread, use the links it sampled.
+			m_io_thread.copy_peer_links(m_links);
+			for (const auto& link : m_links) {
+				if (auto client = m_client_manager.get_client(link.peer)) {
+					peers.push_back({ client->get_id(), link, client->get_traffic() });
+				}
 			}
+
+			queue_depth += m_io_thread.get_ingress().size();
 		}
+		else {
+			for (auto* client : m_client_manager.get_connected_clients()) {
+				auto& peer = peers.emplace_back();
+				peer.id = client->get_id();
+				sample_peer_link(client->get_peer(), peer.link);
+				peer.traffic = client->get_traffic();
+			}
+		}
+
+		m_metrics.on_tick(Metrics::clock::now() - tick_start, queue_depth);
+	}
+
+	void Host_Server::send(const Packet& packet, channel_id channel) {
+		if (m_recorder) {
+			auto client = m_client_manager.get_client(packet.get_peer());
+			m_recorder->record_outbound(m_tick, packet, channel, RECORD_TO_CLIENT, client ? client->get_id() : packet.get_client_id());
+		}
+
+		m_sender.send(packet.get_peer(), packet, channel);
 	}
 
-	void Host_Server::broadcast_to_clients(const Packet& packet, bool reliable) {
-		m_logger->trace("Broadcasting packet to clients: '{}'", packet.get_string());
-		m_client_manager.broadcast_to_clients(packet, reliable);
+	void Host_Server::broadcast_to_clients(const Packet& packet, channel_id channel) {
+		m_logger->trace("Broadcasting {} bytes to clients", packet.get_bytes().size());
+		if (m_recorder) {
+			m_recorder->record_outbound(m_tick, packet, channel, RECORD_TO_ALL, -1);
+		}
+		m_client_manager.broadcast_to_clients(packet, channel);
+	}
+
+	void Host_Server::broadcast_to_group(group_id group, const Packet& packet, channel_id channel) {
+		m_logger->trace("Broadcasting {} bytes to group {}", packet.get_bytes().size(), group);
+		if (m_recorder) {
+			m_recorder->record_outbound(m_tick, packet, channel, RECORD_TO_GROUP, (int32_t)group);
+		}
+		m_client_manager.broadcast_to_group(group, packet, channel);
 	}
 }
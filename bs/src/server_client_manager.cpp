@@ -3,63 +3,233 @@
 
 #include <enet/enet.h>
 
+#include <algorithm>
+
 namespace bs {
+	Server_Client_Manager::Server_Client_Manager(size_t max_clients, Packet_Sender& sender, logger_t& logger)
+		: m_slots(std::make_unique<Slot[]>(max_clients)), m_capacity(max_clients), m_sender(sender), m_logger(logger)
+	{
+		ASSERT_PANIC(max_clients <= INDEX_MASK + 1, "Too many clients for the client id index: {}", max_clients);
+
+		// Popped from the back so the lowest slots are handed out first.
+		m_free_slots.reserve(max_clients);
+		for (size_t i = max_clients; i > 0; --i) {
+			m_free_slots.push_back((uint32_t)(i - 1));
+		}
+		m_connected.reserve(max_clients);
+	}
+
 	server_client_ptr Server_Client_Manager::add_client(_ENetPeer* peer) {
 		ASSERT_PANIC(peer != nullptr, "Trying to add client but the peer is NULL");
+		ASSERT_PANIC(peer->data == nullptr, "Trying to add a client for a peer that already has one");
+
+		if (m_free_slots.empty()) {
+			m_logger->error("No free client slots left (max clients: {})", m_capacity);
+			return nullptr;
+		}
+
+		const uint32_t index = m_free_slots.back();
+		m_free_slots.pop_back();
+
+		auto& slot = m_slots[index];
+		auto& client = slot.client.emplace(peer, make_id(index, slot.generation), m_logger);
 
-		client_id id = (client_id)m_clients.size();
+		slot.connected_index = (uint32_t)m_connected.size();
+		m_connected.push_back(&client);
 
-		auto inserted = m_clients.insert({ peer, std::make_shared<Server_Client>(peer, id, m_logger) });
+		peer->data = &client;
 
-		return m_clients[peer];
+		return &client;
 	}
 
-	void Server_Client_Manager::disconnect_client(const _ENetPeer* peer) {
-		for (auto& [id, client] : m_clients) {
-			if (id == peer) {
-				client->disconnect();
-				return;
-			}
+	void Server_Client_Manager::disconnect_client(_ENetPeer* peer) {
+		auto client = get_client(peer);
+		if (!client) {
+			m_logger->warn("Trying to disconnect a peer with no client: {}", (size_t)peer);
+			return;
+		}
+
+		client->disconnect();
+
+		const uint32_t index = get_index(client->get_id());
+		auto& slot = m_slots[index];
+
+		for (auto group : slot.groups) {
+			erase_member(*get_group(group), client);
+		}
+		slot.groups.clear();
+
+		// Swap the last connected client into the hole to keep the list dense.
+		auto* last = m_connected.back();
+		m_connected[slot.connected_index] = last;
+		m_slots[get_index(last->get_id())].connected_index = slot.connected_index;
+		m_connected.pop_back();
+
+		peer->data = nullptr;
+		slot.client.reset();
+		slot.generation = (slot.generation + 1) & GENERATION_MASK;
+		m_free_slots.push_back(index);
+	}
+
+	server_client_ptr Server_Client_Manager::get_client(const _ENetPeer* peer) const {
+		return peer ? static_cast<Server_Client*>(peer->data) : nullptr;
+	}
+
+	server_client_ptr Server_Client_Manager::get_client(client_id id) const {
+		const uint32_t index = get_index(id);
+		if (id < 0 || index >= m_capacity) {
+			return nullptr;
+		}
+
+		auto& slot = m_slots[index];
+		if (!slot.client || slot.generation != get_generation(id)) {
+			return nullptr;
+		}
+
+		return &*slot.client;
+	}
+
+	void Server_Client_Manager::send(const server_client_ptr& client, const Packet& packet, channel_id channel) {
+		m_sender.send(client->get_peer(), packet, channel);
+	}
+
+	void Server_Client_Manager::broadcast_to_clients(const Packet& packet, channel_id channel) {
+		for (auto* client : m_connected) {
+			send(client, packet, channel);
+		}
+	}
+
+
+	void Server_Client_Manager::broadcast_to_group(group_id group, const Packet& packet, channel_id channel) {
+		const auto* found = get_group(group);
+		if (!found) {
+			m_logger->error("Trying to broadcast to a group that doesn't exist: {}", group);
+			return;
+		}
+
+		for (auto* client : found->members) {
+			send(client, packet, channel);
+		}
+	}
+
+	void Server_Client_Manager::broadcast_to_client(server_client_ptr& client, const Packet& packet, channel_id channel) {
+		send(client, packet, channel);
+	}
+
+	void Server_Client_Manager::broadcast_to_client(client_id id, const Packet& packet, channel_id channel) {
+		auto client = get_client(id);
+		if (!client) {
+			m_logger->warn("Trying to send to a client that isn't connected: {}", id);
+			return;
+		}
+
+		send(client, packet, channel);
+	}
+
+	group_id Server_Client_Manager::create_group(std::string_view name) {
+		group_id group;
+		if (!m_free_groups.empty()) {
+			group = m_free_groups.back();
+			m_free_groups.pop_back();
+		}
+		else {
+			group = (group_id)m_groups.size();
+			m_groups.emplace_back();
 		}
 
-		UNREACHABLE();
+		auto& created = m_groups[group];
+		created.name = name;
+		created.alive = true;
+		return group;
 	}
 
-	_ENetPacket* Server_Client_Manager::create_enet_packet(const Packet& packet, bool reliable) {
-		const auto bytes = packet.get_bytes();
-		ASSERT_PANIC(!bytes.empty(), "Trying to broadcast to all clients but the data is empty");
+	void Server_Client_Manager::destroy_group(group_id group) {
+		auto* found = get_group(group);
+		if (!found) {
+			return;
+		}
 
-		enet_uint32 flags = 0;
-		if (reliable) {
-			flags |= ENET_PACKET_FLAG_RELIABLE;
+		for (auto* client : found->members) {
+			auto& groups = m_slots[get_index(client->get_id())].groups;
+			std::erase(groups, group);
 		}
 
-		auto* enet_packet = enet_packet_create(bytes.data(), bytes.size(), flags);
-		ASSERT_PANIC(enet_packet != nullptr, "Error creating packet");
-		return enet_packet;
+		found->members.clear();
+		found->name.clear();
+		found->alive = false;
+		m_free_groups.push_back(group);
 	}
 
-	void Server_Client_Manager::send(server_client_ptr client, _ENetPacket* packet) {
-		enet_peer_send(client->get_peer(), 0, packet);
+	group_id Server_Client_Manager::find_group(std::string_view name) const {
+		for (size_t i = 0; i < m_groups.size(); ++i) {
+			if (m_groups[i].alive && m_groups[i].name == name) {
+				return (group_id)i;
+			}
+		}
+
+		return INVALID_GROUP_ID;
 	}
 
-	void Server_Client_Manager::broadcast_to_clients(const Packet& packet, bool reliable) {
-		auto* enet_packet = create_enet_packet(packet, reliable);
+	bool Server_Client_Manager::add_to_group(group_id group, client_id id) {
+		auto* found = get_group(group);
+		auto client = get_client(id);
+		if (!found || !client) {
+			return false;
+		}
 
-		for (auto& [_, client] : m_clients) {
-			send(client, enet_packet);
+		auto& groups = m_slots[get_index(id)].groups;
+		if (std::find(groups.begin(), groups.end(), group) != groups.end()) {
+			return true;
 		}
+
+		groups.push_back(group);
+		found->members.push_back(client);
+		return true;
+	}
+
+	bool Server_Client_Manager::remove_from_group(group_id group, client_id id) {
+		auto* found = get_group(group);
+		auto client = get_client(id);
+		if (!found || !client) {
+			return false;
+		}
+
+		auto& groups = m_slots[get_index(id)].groups;
+		if (std::erase(groups, group) == 0) {
+			return false;
+		}
+
+		erase_member(*found, client);
+		return true;
 	}
 
+	std::span<Server_Client* const> Server_Client_Manager::get_group_members(group_id group) const {
+		const auto* found = get_group(group);
+		if (!found) {
+			return {};
+		}
 
-	void Server_Client_Manager::broadcast_to_client(server_client_ptr& client, const Packet& packet, bool reliable) {
-		auto* enet_packet = create_enet_packet(packet, reliable);
-		send(client, enet_packet);
+		return found->members;
 	}
 
-	void Server_Client_Manager::broadcast_to_client(client_id& id, const Packet& packet, bool reliable) {
-		auto* enet_packet = create_enet_packet(packet, reliable);
-		auto client = get_client(packet.get_peer());
-		send(client, enet_packet);
+	Server_Client_Manager::Group* Server_Client_Manager::get_group(group_id group) {
+		if (group < 0 || (size_t)group >= m_groups.size() || !m_groups[group].alive) {
+			return nullptr;
+		}
+
+		return &m_groups[group];
+	}
+
+	const Server_Client_Manager::Group* Server_Client_Manager::get_group(group_id group) const {
+		return const_cast<Server_Client_Manager*>(this)->get_group(group);
+	}
+
+	void Server_Client_Manager::erase_member(Group& group, Server_Client* client) {
+		auto& members = group.members;
+		auto found = std::find(members.begin(), members.end(), client);
+		if (found != members.end()) {
+			*found = members.back();
+			members.pop_back();
+		}
 	}
 }
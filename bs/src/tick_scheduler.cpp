@@ -0,0 +1,78 @@
+#include "bs/tick_scheduler.h"
+
+#include <thread>
+
+namespace bs {
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	Tick_Scheduler::Tick_Scheduler(const Config& config, logger_t& logger)
+		: m_config(config), m_logger(logger)
+	{
+		ASSERT_PANIC(config.tick_rate > 0, "Tick rate must be above zero");
+		ASSERT_PANIC(config.max_catch_up_steps > 0, "Max catch up steps must be above zero");
+
+		m_step = duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / config.tick_rate));
+		reset();
+	}
+
+	void Tick_Scheduler::reset() {
+		m_next_tick = clock::now();
+	}
+
+	void Tick_Scheduler::wait() {
+		// Already late, that's an overrun rather than the wait's drift.
+		if (clock::now() >= m_next_tick) {
+			return;
+		}
+
+		const auto sleep_until = m_next_tick - m_config.spin_threshold;
+		if (clock::now() < sleep_until) {
+			std::this_thread::sleep_until(sleep_until);
+		}
+
+		// The OS can oversleep so spin out the remainder. Yield rather than
+		// busy wait so a single core machine still runs the other threads.
+		while (clock::now() < m_next_tick) {
+			std::this_thread::yield();
+		}
+
+		m_drift.record((uint64_t)duration_cast<microseconds>(clock::now() - m_next_tick).count());
+	}
+
+	uint32_t Tick_Scheduler::get_due_steps() {
+		const auto now = clock::now();
+		const auto behind = (uint64_t)((now - m_next_tick) / m_step) + 1;
+
+		if (behind > m_config.max_catch_up_steps) {
+			m_dropped_ticks += behind - m_config.max_catch_up_steps;
+			m_logger->warn("Tick scheduler fell {} ticks behind, dropping {}", behind, behind - m_config.max_catch_up_steps);
+
+			m_next_tick = now + m_step;
+			return m_config.max_catch_up_steps;
+		}
+
+		m_next_tick += m_step * behind;
+		return (uint32_t)behind;
+	}
+
+	void Tick_Scheduler::record_step(clock::duration elapsed) {
+		if (elapsed > m_step) {
+			m_overrun.record((uint64_t)duration_cast<microseconds>(elapsed - m_step).count());
+		}
+	}
+
+	void Tick_Scheduler::log_stats() {
+		m_logger->info("Tick {}: drift p50 {}us p99 {}us max {}us, {} overruns p99 {}us max {}us, {} dropped",
+			m_tick,
+			m_drift.get_percentile(50.0), m_drift.get_percentile(99.0), m_drift.get_max(),
+			m_overrun.get_count(), m_overrun.get_percentile(99.0), m_overrun.get_max(),
+			m_dropped_ticks);
+	}
+
+	void Tick_Scheduler::clear_stats() {
+		m_drift.clear();
+		m_overrun.clear();
+		m_dropped_ticks = 0;
+	}
+}
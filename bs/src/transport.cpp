@@ -0,0 +1,126 @@
+#include "bs/transport.h"
+
+#include <enet/enet.h>
+
+#include <unordered_map>
+
+namespace bs {
+	namespace {
+#ifndef NDEBUG
+		// Which transport owns each ENet host, for get_enet_host_owner.
+		std::mutex g_hosts_mutex;
+		std::unordered_map<const _ENetHost*, const Enet_Transport*> g_hosts;
+#endif
+
+		class Enet_Transport_Factory : public Transport_Factory {
+		public:
+			std::unique_ptr<Transport> create_server(const char* host, int32_t port, size_t max_peers, size_t channel_count) override {
+				ENetAddress address;
+				enet_address_set_host(&address, host);
+				address.port = (enet_uint16)port;
+
+				ENetHost* enet_host = enet_host_create(&address, max_peers, channel_count, 0, 0);
+				if (!enet_host) {
+					return nullptr;
+				}
+
+				return std::make_unique<Enet_Transport>(enet_host);
+			}
+
+			std::unique_ptr<Transport> create_client() override {
+				// No channel limit here, connect() asks for the channels we need.
+				ENetHost* enet_host = enet_host_create(NULL, 1, 0, 0, 0);
+				if (!enet_host) {
+					return nullptr;
+				}
+
+				return std::make_unique<Enet_Transport>(enet_host);
+			}
+		};
+	}
+
+	const char* get_enet_host_owner(const _ENetHost* host) {
+#ifndef NDEBUG
+		std::lock_guard lock(g_hosts_mutex);
+		auto it = g_hosts.find(host);
+		return it != g_hosts.end() ? it->second->get_owner() : nullptr;
+#else
+		(void)host;
+		return nullptr;
+#endif
+	}
+
+	Transport_Factory& Transport_Factory::get_enet() {
+		static Enet_Transport_Factory factory;
+		return factory;
+	}
+
+	Enet_Transport::Enet_Transport(_ENetHost* host)
+		: m_host(host)
+	{
+#ifndef NDEBUG
+		std::lock_guard lock(g_hosts_mutex);
+		g_hosts[m_host] = this;
+#endif
+	}
+
+	Enet_Transport::~Enet_Transport() {
+		ASSERT_PANIC(m_claims.empty(), "Destroying a transport still claimed by {}", m_claims.back());
+
+#ifndef NDEBUG
+		{
+			std::lock_guard lock(g_hosts_mutex);
+			g_hosts.erase(m_host);
+		}
+#endif
+
+		enet_host_destroy(m_host);
+	}
+
+	_ENetPeer* Enet_Transport::connect(const char* host, int32_t port, size_t channel_count) {
+		ENetAddress address;
+		enet_address_set_host(&address, host);
+		address.port = (enet_uint16)port;
+		return enet_host_connect(m_host, &address, channel_count, 0);
+	}
+
+	int Enet_Transport::service(_ENetEvent* event, uint32_t timeout_ms) {
+		return enet_host_service(m_host, event, timeout_ms);
+	}
+
+	int Enet_Transport::check_events(_ENetEvent* event) {
+		return enet_host_check_events(m_host, event);
+	}
+
+	bool Enet_Transport::send(_ENetPeer* peer, channel_id channel, _ENetPacket* packet) {
+		return enet_peer_send(peer, (enet_uint8)channel, packet) == 0;
+	}
+
+	void Enet_Transport::flush() {
+		enet_host_flush(m_host);
+	}
+
+	size_t Enet_Transport::get_peer_count() const {
+		return m_host->peerCount;
+	}
+
+	_ENetPeer* Enet_Transport::get_peer(size_t index) {
+		return &m_host->peers[index];
+	}
+
+	void Enet_Transport::claim(const char* owner) {
+		std::lock_guard lock(m_claims_mutex);
+		m_claims.push_back(owner);
+	}
+
+	void Enet_Transport::release(const char* owner) {
+		std::lock_guard lock(m_claims_mutex);
+		ASSERT_PANIC(!m_claims.empty() && m_claims.back() == owner, "{} is releasing a transport it doesn't hold the last claim on", owner);
+		m_claims.pop_back();
+	}
+
+	const char* Enet_Transport::get_owner() const {
+		std::lock_guard lock(m_claims_mutex);
+		return m_claims.empty() ? nullptr : m_claims.back();
+	}
+}
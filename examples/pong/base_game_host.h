@@ -2,10 +2,15 @@
 
 #include <spdlog/spdlog.h>
 
+#include <memory>
+
 #include "game_messages_generated.h"
 #include "config.h"
+#include "message_dispatch.h"
 
 #include <bs/enet.h>
+#include <bs/link_conditioner.h>
+#include <bs/packet_allocator.h>
 #include <bs/server.h>
 #include <bs/host_client.h>
 
@@ -13,16 +18,21 @@
 // initialise enet and create the relevant server/client type depending
 // on the templated parameter for it. It will also handle the message 
 // creation and parsing for the generated game messages. The tick
-// function takes in a callback so the server/client and process them
-// individually.
+// function hands each message to the server/client's typed handlers, see
+// set_message_handlers().
 
 template <typename Host_Type>
 class Game_Host {
 public:
-	using tick_cb_t = std::function<void(const Game::Message*, const bs::Packet* packet)>;
-	using connect_cb_t = std::function<void()>;
-
-	Game_Host(bs::logger_t logger, const char* host, int32_t port)
+	// Given the connect or disconnect packet, on a server its client id
+	// says who it was.
+	using connect_cb_t = std::function<void(const bs::Packet* packet)>;
+
+	// The I/O mode and client limit only apply to servers. Pass a
+	// bs::Loopback_Network as the transports to run a server and its
+	// clients in one process, or a bs::Link_Conditioner to run over a
+	// simulated link.
+	Game_Host(bs::logger_t logger, const char* host, int32_t port, bs::Host_Server::Io_Mode io_mode = bs::Host_Server::IO_INLINE, bs::Transport_Factory& transports = bs::Transport_Factory::get_enet(), int max_clients = 32)
 		: m_enet(logger)
 		, m_host(host)
 		, m_port(port)
@@ -30,11 +40,11 @@ public:
 
 		// TODO(DC): Make the init/start api the same for both client and server.
 		if constexpr (std::is_same_v<Host_Type, bs::Host_Server>) {
-			m_host_type = m_enet.create_server(host, port, 32);
-			m_host_type->start();
+			m_host_type = m_enet.create_server(host, port, max_clients, transports);
+			m_host_type->start(io_mode);
 		}
 		else if constexpr (std::is_same_v<Host_Type, bs::Host_Client>) {
-			m_host_type = m_enet.create_host_client();
+			m_host_type = m_enet.create_host_client(transports);
 			m_host_type->start(host, port);
 		}
 
@@ -62,8 +72,17 @@ public:
 		return nullptr;
 	}
 
-	void set_tick_callback(tick_cb_t callback) {
-		m_tick_callback = callback;
+	// One on<T>() per message this side takes and an unexpected<...>() for
+	// the rest, e.g.
+	//   set_message_handlers(
+	//     on<Game::PlayerMoved>([&](const Game::PlayerMoved* message, const bs::Packet* packet) { ... }),
+	//     unexpected<Game::Tick, Game::TickDelta>());
+	// Replaces any handlers set before.
+	template <typename... Handlers>
+	void set_message_handlers(Handlers&&... handlers) {
+		auto owned = std::make_shared<Message_Handlers<std::decay_t<Handlers>...>>(std::forward<Handlers>(handlers)...);
+		m_dispatch = owned->get_table();
+		m_handlers = std::move(owned);
 	}
 
 	void set_connect_callback(connect_cb_t callback) {
@@ -79,22 +98,23 @@ public:
 
 		auto& packets = m_host_type->get_packets();
 
-		while (!packets.empty()) {
-			auto packet = packets.pop_front();
+		// Hand the whole batch over in arrival order.
+		packets.drain([&](bs::Packet& packet) {
 			switch (packet.get_type()) {
 			case bs::Packet::CONNECT:
 				if (m_connect_callback)
-					m_connect_callback();
+					m_connect_callback(&packet);
 				break;
 
 			case bs::Packet::DISCONNECT:
 				if (m_disconnect_callback)
-					m_disconnect_callback();
+					m_disconnect_callback(&packet);
 				break;
 
 			case bs::Packet::EVENT_RECIEVED:
-				if (m_tick_callback) {
-					auto packet_bytes = packet.get_bytes();
+				if (m_dispatch) {
+					// View straight into the received ENet packet, no copy.
+					const auto packet_bytes = packet.get_bytes();
 
 					flatbuffers::Verifier verifier(packet_bytes.data(), packet_bytes.size());
 					if (!Game::VerifyMessageBuffer(verifier)) {
@@ -102,15 +122,19 @@ public:
 						break;
 					}
 
+					// Straight through the table to the message's handler.
 					const auto* message = flatbuffers::GetRoot<Game::Message>(packet_bytes.data());
-					m_tick_callback(message, &packet);
+					const size_t tag = message->payload_type();
+					if (tag >= TAG_COUNT || !m_dispatch[tag](m_handlers.get(), message, &packet)) {
+						m_host_type->get_logger()->error("Unexpected message type: {}", tag);
+					}
 				}
 				break;
 
 			default:
 				m_host_type->get_logger()->error("Unknown packet type: {}", (int)packet.get_type());
 			}
-		}
+			});
 	}
 
 	bs::Packet create_client_connect_request() {
@@ -165,7 +189,7 @@ public:
 	}
 
 
-	bs::Packet create_game_starting(float p1_x, float p1_y, float p2_x, float p2_y, float ball_px, float ball_py, float ball_vx, float ball_vy) {
+	bs::Packet create_game_starting(float p1_x, float p1_y, float p2_x, float p2_y, float ball_px, float ball_py, float ball_vx, float ball_vy, bool rollback = false) {
 		m_host_type->get_logger()->trace("Sending client ready request");
 
 		m_builder.Clear();
@@ -174,23 +198,34 @@ public:
 		auto ball_pos = Game::CreateVec2(m_builder, ball_px, ball_py);
 		auto ball_vel = Game::CreateVec2(m_builder, ball_vx, ball_vy);
 
-		auto client_ready = Game::CreateGameStarting(m_builder, player_1, player_2, ball_pos, ball_vel);
+		auto client_ready = Game::CreateGameStarting(m_builder, player_1, player_2, ball_pos, ball_vel, rollback);
 		auto message = Game::CreateMessage(m_builder, Game::Any_GameStarting, client_ready.Union());
 		m_builder.Finish(message);
 		return std::move(create_packet_from_builder());
 	}
 
 
-	bs::Packet create_player_moved_message(int slot, int velocity) {
+	bs::Packet create_player_moved_message(int slot, int velocity, uint32_t sequence = 0, uint32_t view_time_ms = 0) {
 		m_host_type->get_logger()->trace("Sending player moved request");
 
 		m_builder.Clear();
-		auto client_ready = Game::CreatePlayerMoved(m_builder, slot, velocity);
+		auto client_ready = Game::CreatePlayerMoved(m_builder, slot, velocity, sequence, view_time_ms);
 		auto message = Game::CreateMessage(m_builder, Game::Any_PlayerMoved, client_ready.Union());
 		m_builder.Finish(message);
 		return std::move(create_packet_from_builder());
 	}
 
+	bs::Packet create_player_inputs(int slot, uint32_t first_sequence, std::span<const int8_t> velocities, uint32_t view_time_ms = 0) {
+		m_host_type->get_logger()->trace("Sending {} player inputs from {}", velocities.size(), first_sequence);
+
+		m_builder.Clear();
+		auto values = m_builder.CreateVector(velocities.data(), velocities.size());
+		auto player_inputs = Game::CreatePlayerInputs(m_builder, slot, first_sequence, values, view_time_ms);
+		auto message = Game::CreateMessage(m_builder, Game::Any_PlayerInputs, player_inputs.Union());
+		m_builder.Finish(message);
+		return std::move(create_packet_from_builder());
+	}
+
 	bs::Packet create_tick(float p1_x, float p1_y, float p2_x, float p2_y, float ball_px, float ball_py, float ball_vx, float ball_vy, int player_1_score, int player_2_score) {
 		m_host_type->get_logger()->trace("Sending tick request");
 
@@ -207,28 +242,81 @@ public:
 	}
 
 
+	bs::Packet create_tick_delta(uint32_t sequence, uint32_t baseline, std::span<const uint8_t> data, uint32_t last_input = 0, uint32_t time_ms = 0) {
+		m_host_type->get_logger()->trace("Sending tick delta {} against {}", sequence, baseline);
+
+		m_builder.Clear();
+		auto bytes = m_builder.CreateVector(data.data(), data.size());
+		auto tick_delta = Game::CreateTickDelta(m_builder, sequence, baseline, bytes, last_input, time_ms);
+		auto message = Game::CreateMessage(m_builder, Game::Any_TickDelta, tick_delta.Union());
+		m_builder.Finish(message);
+		return std::move(create_packet_from_builder());
+	}
+
+	bs::Packet create_tick_ack(uint32_t sequence) {
+		m_host_type->get_logger()->trace("Sending tick ack {}", sequence);
+
+		m_builder.Clear();
+		auto tick_ack = Game::CreateTickAck(m_builder, sequence);
+		auto message = Game::CreateMessage(m_builder, Game::Any_TickAck, tick_ack.Union());
+		m_builder.Finish(message);
+		return std::move(create_packet_from_builder());
+	}
+
+	bs::Packet create_rollback_inputs(uint32_t first_frame, std::span<const int8_t> velocities, uint32_t ack_frame) {
+		m_host_type->get_logger()->trace("Sending {} rollback inputs from {}", velocities.size(), first_frame);
+
+		m_builder.Clear();
+		auto values = m_builder.CreateVector(velocities.data(), velocities.size());
+		auto rollback_inputs = Game::CreateRollbackInputs(m_builder, first_frame, values, ack_frame);
+		auto message = Game::CreateMessage(m_builder, Game::Any_RollbackInputs, rollback_inputs.Union());
+		m_builder.Finish(message);
+		return std::move(create_packet_from_builder());
+	}
+
+	bs::Packet create_rollback_checksum(uint32_t frame, uint32_t checksum) {
+		m_host_type->get_logger()->trace("Sending rollback checksum for frame {}", frame);
+
+		m_builder.Clear();
+		auto rollback_checksum = Game::CreateRollbackChecksum(m_builder, frame, checksum);
+		auto message = Game::CreateMessage(m_builder, Game::Any_RollbackChecksum, rollback_checksum.Union());
+		m_builder.Finish(message);
+		return std::move(create_packet_from_builder());
+	}
+
+
 	Host_Type* get_host_type() {
 		return m_host_type;
 	}
 
 private:
+	// The builder serializes straight in to a pooled block which becomes the
+	// packet's payload, nothing is copied on the way to ENet.
 	bs::Packet create_packet_from_builder() {
 		// TODO(DC): Make the init/start api the same for both client and server.
 		if constexpr (std::is_same_v<Host_Type, bs::Host_Server>) {
-			return std::move(bs::Packet(NULL, m_builder.GetBufferPointer(), m_builder.GetSize()));
+			return m_allocator.release_packet(m_builder, NULL);
 		}
 		else if constexpr (std::is_same_v<Host_Type, bs::Host_Client>) {
-			return std::move(bs::Packet(m_host_type->get_peer(), m_builder.GetBufferPointer(), m_builder.GetSize()));
+			return m_allocator.release_packet(m_builder, m_host_type->get_peer());
 		}
 	}
 
-	flatbuffers::FlatBufferBuilder m_builder;
+	bs::Packet_Allocator m_allocator;
+	flatbuffers::FlatBufferBuilder m_builder{ bs::Packet_Pool::BLOCK_SIZE, &m_allocator };
 	bs::ENet m_enet;
 
 	const char* m_host = nullptr;
 	int32_t m_port = -1;
 
-	tick_cb_t m_tick_callback;
+	// Every Message_Handlers has a table this long.
+	static constexpr size_t TAG_COUNT = (size_t)Game::Any_MAX + 1;
+
+	// The handlers' type is only known to set_message_handlers(), the table
+	// is what knows how to call them.
+	std::shared_ptr<void> m_handlers;
+	const message_dispatch_t* m_dispatch = nullptr;
+
 	connect_cb_t m_connect_callback;
 	connect_cb_t m_disconnect_callback;
 
@@ -1,6 +1,7 @@
 #include "client_state.h"
 #include "game_messages_generated.h"
 #include "config.h"
+#include "simulation.h"
 
 #include <utils.h>
 
@@ -16,48 +17,50 @@ const float BUTTON_SZ_W = 200;
 const float BUTTON_SZ_H = 75;
 const float BUTTON_Y_PADDING = 20;
 
-Pong_Client_State::Pong_Client_State()
-	: m_client(spdlog::stdout_color_mt("CLIENT"), SAMPLES_HOST, SAMPLES_PORT)
+Pong_Client_State::Pong_Client_State(bs::logger_t logger, bs::Transport_Factory& transports, const bs::Interpolation_Config& interpolation)
+	: m_client(logger, SAMPLES_HOST, SAMPLES_PORT, bs::Host_Server::IO_INLINE, transports)
+	, m_remote(interpolation)
 {
-	m_client.set_connect_callback([&] {
+	m_client.set_connect_callback([&](const bs::Packet*) {
 		// When we connect send over a connection request so we
 		// can get our client id and store it. We shouldn't 
 		// continue until we do so.
-		m_client.create_client_connect_request().send(true);
+		m_client->broadcast_to_server(m_client.create_client_connect_request(), true);
 		});
 
-	m_client.set_disconnect_callback([&] {
+	m_client.set_disconnect_callback([&](const bs::Packet*) {
 		});
 
-	m_client.set_tick_callback([&](const Game::Message* message, const bs::Packet* packet) {
-		ASSERT_PANIC(m_client->get_state() == bs::Base_Client::CONNECTED, "Not currently connected");
-
-		// We can now switch on the type returned and act accordingly.
-		switch (message->payload_type()) {
-		case Game::Any_ClientConnectedResponse: {
-			const auto* client_msg = message->payload_as_ClientConnectedResponse();
+	m_client.set_message_handlers(
+		on<Game::ClientConnectedResponse>([&](const Game::ClientConnectedResponse* client_msg, const bs::Packet*) {
 			auto id = client_msg->client_id();
 
-
 			m_client.get_logger()->info("Server responded to connect with id: {}. Setting client id.", id);
 			m_client->set_id(id);
 
 			m_server_tick_rate = client_msg->tick_rate();
-			break;
-		}
+			}),
 
-		case Game::Any_ClientReadyResponse: {
-			const auto* client_msg = message->payload_as_ClientReadyResponse();
+		on<Game::ClientReadyResponse>([&](const Game::ClientReadyResponse* client_msg, const bs::Packet*) {
 			m_players[client_msg->slot()].is_local = true;
-			break;
-		}
+			}),
 
-		case Game::Any_ClientDisconnected: {
-			const auto* client_msg = message->payload_as_ClientDisconnected();
-		} break;
+		on<Game::ClientDisconnected>([&](const Game::ClientDisconnected*, const bs::Packet*) {
+			// The other player left mid match, the server has closed the
+			// room. Ready up again for a new one.
+			m_client.get_logger()->info("Opponent disconnected, match over");
+			m_state = MULTIPLAYER_WAITING;
+			m_ready = false;
+			m_inputs.clear();
+			m_snapshots.clear();
+			m_latest_snapshot = bs::NO_BASELINE;
+			m_rollback_mode = false;
+			for (auto& player : m_players) {
+				player = {};
+			}
+			}),
 
-		case Game::Any_GameStarting: {
-			const auto* client_msg = message->payload_as_GameStarting();
+		on<Game::GameStarting>([&](const Game::GameStarting* client_msg, const bs::Packet*) {
 			m_state = MULTIPLAYER_IN_GAME;
 			const auto* player_1 = client_msg->player_1();
 			const auto* player_2 = client_msg->player_2();
@@ -76,17 +79,42 @@ Pong_Client_State::Pong_Client_State()
 			m_ball_vx = client_msg->ball_velocity()->x();
 			m_ball_vy = client_msg->ball_velocity()->y();
 
-		} break;
+			// Don't blend from wherever the last game left off. The new room
+			// numbers its snapshots from the start again.
+			m_remote.clear();
+			m_snapshots.clear();
+			m_latest_snapshot = bs::NO_BASELINE;
+
+			// In rollback mode both clients start the match from this same
+			// state and run it themselves.
+			m_rollback_mode = client_msg->rollback();
+			if (m_rollback_mode) {
+				Pong_Match match;
+				for (int i = 0; i < 2; ++i) {
+					match.paddle_x[i] = m_players[i].x;
+					match.paddle_y[i] = m_players[i].y;
+					match.score[i] = m_players[i].score;
+					if (m_players[i].is_local) {
+						m_local_slot = i;
+					}
+				}
+				match.ball_x = m_ball_x;
+				match.ball_y = m_ball_y;
+				match.ball_vx = m_ball_vx;
+				match.ball_vy = m_ball_vy;
+
+				m_rollback.reset(match);
+				m_rollback_time = 0.0f;
+				m_checksum_sent = bs::NO_FRAME;
+				m_desync_reported = false;
+			}
+			}),
 
-		case Game::Any_PlayerMoved: {
-			const auto* client_msg = message->payload_as_PlayerMoved();
+		on<Game::PlayerMoved>([&](const Game::PlayerMoved* client_msg, const bs::Packet*) {
 			m_players[client_msg->slot()].y += client_msg->velocity();
+			}),
 
-			break;
-		}
-
-		case Game::Any_Tick: {
-			const auto* client_msg = message->payload_as_Tick();
+		on<Game::Tick>([&](const Game::Tick* client_msg, const bs::Packet*) {
 			const auto* player_1 = client_msg->player_1();
 			const auto* player_2 = client_msg->player_2();
 
@@ -103,17 +131,58 @@ Pong_Client_State::Pong_Client_State()
 			m_ball_y = client_msg->ball_position()->y();
 			m_ball_vx = client_msg->ball_velocity()->x();
 			m_ball_vy = client_msg->ball_velocity()->y();
+			}),
 
+		on<Game::TickDelta>([&](const Game::TickDelta* delta_msg, const bs::Packet*) {
+			const auto sequence = delta_msg->sequence();
 
-			break;
-		}
+			// Unreliable, so drop anything older than what we already have.
+			if (sequence <= m_latest_snapshot || !delta_msg->data()) {
+				return;
+			}
 
-		default:
-			server_update(message);
-			break;
-		}
+			const auto* baseline = m_snapshots.find(delta_msg->baseline());
+			if (!baseline) {
+				m_client.get_logger()->warn("Missing snapshot baseline {} for {}", delta_msg->baseline(), sequence);
+				return;
+			}
 
-		});
+			Pong_Snapshot snapshot;
+			bs::Bit_Reader reader({ delta_msg->data()->data(), delta_msg->data()->size() });
+			if (!decode_snapshot(reader, *baseline, snapshot)) {
+				m_client.get_logger()->error("Truncated snapshot {}", sequence);
+				return;
+			}
+
+			m_snapshots.insert(sequence, snapshot);
+			m_latest_snapshot = sequence;
+			apply_snapshot(snapshot, delta_msg->last_input(), delta_msg->time_ms());
+
+			m_client->broadcast_to_server(m_client.create_tick_ack(sequence), false);
+			}),
+
+		on<Game::RollbackInputs>([&](const Game::RollbackInputs* inputs_msg, const bs::Packet*) {
+			if (!m_rollback_mode || !inputs_msg->velocities()) {
+				return;
+			}
+
+			// Repeats of inputs we already have are ignored, a different one
+			// than we guessed rolls the match back on the next frame.
+			bs::rollback_frame frame = inputs_msg->first_frame();
+			for (const int8_t velocity : *inputs_msg->velocities()) {
+				m_rollback.add_remote_input(frame++, velocity);
+			}
+			m_rollback.acknowledge(inputs_msg->ack_frame());
+			}),
+
+		on<Game::RollbackChecksum>([&](const Game::RollbackChecksum* checksum_msg, const bs::Packet*) {
+			if (m_rollback_mode) {
+				m_rollback.add_remote_checksum(checksum_msg->frame(), checksum_msg->checksum());
+			}
+			}),
+
+		// Only ever sent by clients.
+		unexpected<Game::ClientConnectedRequest, Game::ClientReady, Game::PlayerInputs, Game::TickAck>());
 }
 
 void Pong_Client_State::tick(float dt) {
@@ -122,10 +191,17 @@ void Pong_Client_State::tick(float dt) {
 	switch (m_state) {
 	case SINGLE_PLAYER:
 	case MULTIPLAYER_IN_GAME: {
+		if (m_state == MULTIPLAYER_IN_GAME && m_rollback_mode) {
+			tick_rollback(dt);
+			break;
+		}
+
 		bool is_single_player = m_state == SINGLE_PLAYER;
 
 		if (is_single_player)
 			game_state_tick(m_players, m_ball_x, m_ball_y, m_ball_vx, m_ball_vy);
+		else
+			update_remote(dt);
 
 		for (int i = 0; i < std::size(m_players); ++i) {
 			auto& player = m_players[i];
@@ -160,13 +236,25 @@ void Pong_Client_State::tick(float dt) {
 				interacted = true;
 			}
 
-			// Send a player moved message.
 			if (interacted) {
-				if (!is_single_player && (m_client.get_host_type()->get_state() == bs::Base_Client::CONNECTED)) {
-					m_client.create_player_moved_message(i, velocity).send(true);
+				if (is_single_player) {
+					player.y += velocity * dt;
+				}
+				else if (m_client.get_host_type()->get_state() == bs::Base_Client::CONNECTED) {
+					// Move straight away rather than waiting a round trip for
+					// the server, the snapshots correct us if it disagrees.
+					const bs::input_seq sequence = m_inputs.push(velocity);
+					if (m_reliable_inputs) {
+						m_client->broadcast_to_server(m_client.create_player_moved_message(i, velocity, sequence, get_view_time_ms()), true);
+					}
+					move_player(player, velocity);
 				}
+			}
 
-				player.y += velocity * dt;
+			// Keep repeating the inputs until a snapshot says the server has
+			// them, whether or not a key is still held.
+			if (!is_single_player && !m_reliable_inputs) {
+				send_inputs(i);
 			}
 		}
 
@@ -225,7 +313,7 @@ void Pong_Client_State::draw() {
 			DrawText(TextFormat("%s", m_ready ? "YES" : "NO"), 10 + MeasureText("Ready: :", 20), y, 20, m_ready ? GREEN : RED);
 			if (IsKeyPressed(KEY_SPACE)) {
 				m_ready = !m_ready;
-				m_client.create_client_ready(m_ready).send(m_ready);
+				m_client->broadcast_to_server(m_client.create_client_ready(m_ready), m_ready);
 			}
 
 			m_connecting_timer = 0.0f;
@@ -250,7 +338,7 @@ void Pong_Client_State::draw() {
 			// Unready the player before we go back to the menu.
 			if (is_connected()) {
 				m_ready = false;
-				m_client.create_client_ready(m_ready).send(m_ready);
+				m_client->broadcast_to_server(m_client.create_client_ready(m_ready), m_ready);
 			}
 		}
 		break;
@@ -270,6 +358,13 @@ void Pong_Client_State::draw() {
 		DrawText(TextFormat("%d", m_players[0].score), 50, HEIGHT - 50, 50, WHITE);
 		DrawText(TextFormat("%d", m_players[1].score), WIDTH - 100, HEIGHT - 50, 50, WHITE);
 
+		if (m_state == MULTIPLAYER_IN_GAME && m_rollback_mode) {
+			DrawText(TextFormat("Rollback frame %u, %d rollbacks", m_rollback.get_frame(), (int)m_rollback.get_rollback_count()), 10, 25, 10, WHITE);
+			if (m_rollback.get_desync_frame() != bs::NO_FRAME) {
+				DrawText(TextFormat("Desync at frame %u", m_rollback.get_desync_frame()), 10, 40, 10, RED);
+			}
+		}
+
 		break;
 
 	case MULTIPLAYER_ENDED: break;
@@ -283,25 +378,154 @@ void Pong_Client_State::draw() {
 	EndDrawing();
 }
 
-void Pong_Client_State::server_update(const Game::Message* message) {
-	ASSERT_PANIC(m_state == MULTIPLAYER_IN_GAME, "Trying to update the game state while not in game");
-	ASSERT_PANIC(message->payload_type() == Game::Any_Tick, "Game state receieved message. Expected Game::Any_Tick but got: {}", Game::EnumNameAny(message->payload_type()));
+void Pong_Client_State::apply_snapshot(const Pong_Snapshot& snapshot, bs::input_seq last_input, uint32_t time_ms) {
+	Remote_Buffer::values_t values;
+	bool scored = false;
+
+	for (int i = 0; i < 2; ++i) {
+		auto& player = m_players[i];
+		values[PLAYER_1_X + i * 2] = snapshot_position(snapshot.player_x[i]);
+		values[PLAYER_1_Y + i * 2] = snapshot_position(snapshot.player_y[i]);
+
+		scored |= player.score != (int)snapshot.score[i];
+		player.score = (int)snapshot.score[i];
+
+		// The snapshot is a round trip behind our own paddle, put back the
+		// inputs the server hadn't applied yet.
+		if (player.is_local) {
+			player.x = values[PLAYER_1_X + i * 2];
+			player.y = values[PLAYER_1_Y + i * 2];
+			player = m_inputs.reconcile(player, last_input, [](Player& predicted, int velocity) {
+				move_player(predicted, velocity);
+				});
+		}
+	}
+
+	values[BALL_X] = snapshot_position(snapshot.ball_x);
+	values[BALL_Y] = snapshot_position(snapshot.ball_y);
+	m_ball_vx = snapshot_velocity(snapshot.ball_vx);
+	m_ball_vy = snapshot_velocity(snapshot.ball_vy);
+
+	// A point resets the ball to the middle, jump there rather than
+	// sliding it back across the court.
+	m_remote.push(time_ms / 1000.0, values, scored);
+}
+
+void Pong_Client_State::send_inputs(int slot) {
+	if (m_inputs.get_pending_count() == 0 || m_client->get_state() != bs::Base_Client::CONNECTED) {
+		return;
+	}
 
-	const auto* client_msg = message->payload_as_Tick();
-	const auto* player_1 = client_msg->player_1();
-	const auto* player_2 = client_msg->player_1();
+	std::array<int8_t, INPUT_REDUNDANCY> velocities;
+	size_t count = 0;
+	bs::input_seq first = bs::NO_INPUT;
 
-	auto update_player = [](Player& player, const Game::Player* player_msg) {
-		player.x = player_msg->position()->x();
-		player.y = player_msg->position()->y();
+	m_inputs.replay_recent(velocities.size(), [&](bs::input_seq sequence, int velocity) {
+		if (count == 0) {
+			first = sequence;
+		}
+		velocities[count++] = (int8_t)velocity;
+		});
+
+	// Sequenced, a newer packet carries everything an older one would.
+	m_client->broadcast_to_server(m_client.create_player_inputs(slot, first, { velocities.data(), count }, get_view_time_ms()), bs::CHANNEL_UNRELIABLE);
+}
+
+void Pong_Client_State::tick_rollback(float dt) {
+	// Frames run at a fixed rate whatever the frame rate, a long hitch only
+	// catches up a few at once.
+	const float frame_time = 1.0f / ROLLBACK_FRAME_RATE;
+	m_rollback_time = std::min(m_rollback_time + dt, frame_time * 4);
+
+	const int slot = m_local_slot;
+	auto step = [slot](Pong_Match& match, int8_t local, int8_t remote) {
+		int velocities[2];
+		velocities[slot] = local;
+		velocities[1 - slot] = remote;
+		step_match(match, velocities);
 		};
 
-	update_player(m_players[0], player_1);
-	update_player(m_players[1], player_2);
+	while (m_rollback_time >= frame_time) {
+		int8_t velocity = 0;
+		if (IsKeyDown(KEY_W)) {
+			velocity = -PLAYER_SPEED;
+		}
+		else if (IsKeyDown(KEY_S)) {
+			velocity = PLAYER_SPEED;
+		}
+
+		// Too far ahead of the other player, wait for their inputs. The
+		// time isn't kept so we don't rush to catch up afterwards.
+		if (!m_rollback.advance(velocity, step)) {
+			m_rollback_time = 0.0f;
+			break;
+		}
+		m_rollback_time -= frame_time;
+	}
+
+	if (m_client->get_state() == bs::Base_Client::CONNECTED) {
+		std::array<int8_t, ROLLBACK_HISTORY> velocities;
+		size_t count = 0;
+		bs::rollback_frame first = bs::NO_FRAME;
+		m_rollback.for_each_unacknowledged([&](bs::rollback_frame frame, int8_t velocity) {
+			if (count == 0) {
+				first = frame;
+			}
+			velocities[count++] = velocity;
+			});
+
+		// Also carries our ack, so it goes even with nothing new in it.
+		m_client->broadcast_to_server(m_client.create_rollback_inputs(first, { velocities.data(), count }, m_rollback.get_confirmed_frame()), bs::CHANNEL_UNRELIABLE);
+
+		const bs::rollback_frame settled = std::min(m_rollback.get_confirmed_frame(), m_rollback.get_frame() - 1);
+		const bs::rollback_frame checked = settled / ROLLBACK_CHECKSUM_INTERVAL * ROLLBACK_CHECKSUM_INTERVAL;
+		uint32_t checksum = 0;
+		if (checked > m_checksum_sent && m_rollback.get_checksum(checked, checksum)) {
+			m_client->broadcast_to_server(m_client.create_rollback_checksum(checked, checksum), bs::CHANNEL_RELIABLE);
+			m_checksum_sent = checked;
+		}
+	}
+
+	if (m_rollback.get_desync_frame() != bs::NO_FRAME && !m_desync_reported) {
+		m_client.get_logger()->error("Rollback desync at frame {}", m_rollback.get_desync_frame());
+		m_desync_reported = true;
+	}
 
-	m_ball_x = client_msg->ball_position()->x();
-	m_ball_y = client_msg->ball_position()->y();
-	m_ball_vx = client_msg->ball_velocity()->x();
-	m_ball_vy = client_msg->ball_velocity()->y();
+	const auto& match = m_rollback.get_state();
+	for (int i = 0; i < 2; ++i) {
+		m_players[i].x = match.paddle_x[i];
+		m_players[i].y = match.paddle_y[i];
+		m_players[i].score = match.score[i];
+	}
+	m_ball_x = match.ball_x;
+	m_ball_y = match.ball_y;
+	m_ball_vx = match.ball_vx;
+	m_ball_vy = match.ball_vy;
 }
 
+uint32_t Pong_Client_State::get_view_time_ms() const {
+	if (m_remote.size() == 0) {
+		return 0;
+	}
+	return (uint32_t)std::max(0.0, m_remote.get_render_time() * 1000.0 + 0.5);
+}
+
+void Pong_Client_State::update_remote(float dt) {
+	m_remote.advance(dt);
+
+	Remote_Buffer::values_t values;
+	if (!m_remote.sample(values)) {
+		return;
+	}
+
+	m_ball_x = values[BALL_X];
+	m_ball_y = values[BALL_Y];
+
+	for (int i = 0; i < 2; ++i) {
+		auto& player = m_players[i];
+		if (!player.is_local) {
+			player.x = values[PLAYER_1_X + i * 2];
+			player.y = values[PLAYER_1_Y + i * 2];
+		}
+	}
+}
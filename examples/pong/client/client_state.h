@@ -1,10 +1,12 @@
 #pragma once
 
-#include "base_game_host.h"
+#include <bs/interpolation.h>
+#include <bs/prediction.h>
+#include <bs/rollback.h>
 
-namespace Game {
-	struct Message;
-}
+#include "base_game_host.h"
+#include "simulation.h"
+#include "snapshot.h"
 
 class Pong_Client_State {
 public:
@@ -17,20 +19,57 @@ public:
 		DISCONNECTED
 	};
 
-	Pong_Client_State();
+	// Sends go through the host so they take the same transport as the
+	// rest of the client's traffic. The interpolation config sets how far
+	// behind the server the ball and the other paddle are drawn.
+	Pong_Client_State(bs::logger_t logger, bs::Transport_Factory& transports = bs::Transport_Factory::get_enet(), const bs::Interpolation_Config& interpolation = {});
 
 	void tick(float dt);
 	void draw();
 
-	void server_update(const Game::Message* message);
+	void apply_snapshot(const Pong_Snapshot& snapshot, bs::input_seq last_input, uint32_t time_ms);
 	bool is_connected() {
 		return m_client->get_state() == bs::Base_Client::CONNECTED;
 	}
 
+	// Sends every input as its own reliable PlayerMoved rather than
+	// streaming the unacknowledged ones unreliably each frame.
+	void set_reliable_inputs(bool reliable) { m_reliable_inputs = reliable; }
+
 	State set_state(const Pong_Client_State::State& state) { m_state = state; }
 	State get_state() const { return m_state; }
 
 private:
+	// Everything drawn from the snapshots rather than predicted, the local
+	// player's paddle values go unused.
+	enum Remote_Value {
+		BALL_X = 0,
+		BALL_Y,
+		PLAYER_1_X,
+		PLAYER_1_Y,
+		PLAYER_2_X,
+		PLAYER_2_Y,
+		REMOTE_VALUE_COUNT
+	};
+
+	using Remote_Buffer = bs::Interpolation_Buffer<REMOTE_VALUE_COUNT, INTERPOLATION_HISTORY>;
+	using Rollback = bs::Rollback_Session<Pong_Match, int8_t, ROLLBACK_HISTORY>;
+
+	// Moves the ball and the other paddle to where the buffer says they
+	// were at the current render time.
+	void update_remote(float dt);
+
+	// Sends the newest unacknowledged inputs as one unreliable PlayerInputs.
+	void send_inputs(int slot);
+
+	// Server time the remote state is being drawn at, sent with inputs so
+	// the server can judge them against what we saw. 0 before any snapshot.
+	uint32_t get_view_time_ms() const;
+
+	// Runs the rollback match's frames due since the last tick and sends
+	// our inputs and checksums to the other player.
+	void tick_rollback(float dt);
+
 	struct Player {
 		float x = 0.0f;
 		float y = 0.0f;
@@ -50,6 +89,28 @@ private:
 
 	Game_Host<bs::Host_Client> m_client;
 
+	// Snapshots received from the server, kept as baselines for the deltas.
+	Pong_Snapshot_Buffer m_snapshots;
+	bs::snapshot_seq m_latest_snapshot = bs::NO_BASELINE;
+
+	// Velocities sent for the local paddle that the server hasn't applied
+	// yet, replayed on top of each snapshot.
+	bs::Input_History<int, INPUT_HISTORY> m_inputs;
+	bool m_reliable_inputs = false;
+
+	// Snapshot positions by server time, rendered a little in the past so
+	// a late or lost snapshot doesn't show.
+	Remote_Buffer m_remote;
+
+	// Rollback mode, the match runs here and on the other client from both
+	// players' inputs rather than on the server.
+	Rollback m_rollback{ ROLLBACK_MAX_PREDICTION, ROLLBACK_CHECKSUM_INTERVAL };
+	bool m_rollback_mode = false;
+	int m_local_slot = 0;
+	float m_rollback_time = 0.0f;
+	bs::rollback_frame m_checksum_sent = bs::NO_FRAME;
+	bool m_desync_reported = false;
+
 	// Server tick rate is set once the server replies with a 
 	// client ready response.
 	int m_server_tick_rate = 0;
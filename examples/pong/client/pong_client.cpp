@@ -1,11 +1,49 @@
 
 #include <raylib.h>
 
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string_view>
+
 #include "config.h"
 #include "client_state.h"
 
-int main() {
-	Pong_Client_State state{};
+int main(int argc, char** argv) {
+	auto logger = spdlog::stdout_color_mt("CLIENT");
+
+	// Pass --netsim <profile> to play over a simulated link, e.g. "mobile"
+	// or "delay=80,jitter=20,loss=0.02", see bs::Link_Script.
+	// --interp-delay <ms> sets how far behind the server the ball and the
+	// other paddle are drawn and --hermite blends them along a curve
+	// rather than a straight line. --reliable-inputs sends each input as a
+	// reliable PlayerMoved instead of streaming them unreliably.
+	bs::Link_Script netsim;
+	bs::Interpolation_Config interpolation;
+	bool reliable_inputs = false;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string_view(argv[i]) == "--netsim" && i + 1 < argc) {
+			std::string error;
+			if (!bs::Link_Script::parse(argv[++i], netsim, error)) {
+				logger->error("{}", error);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (std::string_view(argv[i]) == "--interp-delay" && i + 1 < argc) {
+			interpolation.delay = std::max(0, std::atoi(argv[++i])) / 1000.0;
+		}
+		else if (std::string_view(argv[i]) == "--hermite") {
+			interpolation.mode = bs::INTERPOLATE_HERMITE;
+		}
+		else if (std::string_view(argv[i]) == "--reliable-inputs") {
+			reliable_inputs = true;
+		}
+	}
+
+	bs::Link_Conditioner conditioner(bs::Transport_Factory::get_enet(), netsim);
+	Pong_Client_State state(logger, conditioner, interpolation);
+	state.set_reliable_inputs(reliable_inputs);
 	InitWindow(WIDTH, HEIGHT, "Pong");
 
 	SetTargetFPS(60);
@@ -2,6 +2,8 @@
 
 #include <raylib.h>
 
+#include <algorithm>
+
 #define SAMPLES_HOST "127.0.0.1"
 #define SAMPLES_PORT 1222
 
@@ -14,45 +16,33 @@
 #define PLAYER_HEIGHT 100 
 #define PLAYER_SPEED 8 
 #define BALL_WIDTH 15 
-#define BALL_INITIAL_SPEED 1.5f
-
-template <typename Players>
-inline void game_state_tick(Players& players, float& ball_x, float& ball_y, float& ball_vx, float& ball_vy) {
-	for (auto& player : players) {
-		if (player.y < 0) {
-			player.y = 0;
-		}
-
-		if (player.y + PLAYER_HEIGHT > HEIGHT) {
-			player.y = HEIGHT - PLAYER_HEIGHT;
-		}
-
-		ball_x += ball_vx;
-		ball_y += ball_vy;
-
-		if (ball_y < 0) {
-			ball_vy *= -1;
-		}
-
-		if (ball_y + BALL_WIDTH > HEIGHT) {
-			ball_vy *= -1;
-		}
-
-		if (ball_x < 0 || ball_x + BALL_WIDTH > WIDTH) {
-			if (ball_x < 0) {
-				players[1].score++;
-			}
-			else {
-				players[0].score++;
-			}
-			ball_x = WIDTH / 2.0f;
-			ball_y = HEIGHT / 2.0f;
-			ball_vx = 1;
-		}
-
-		if (CheckCollisionRecs({ ball_x, ball_y, BALL_WIDTH, BALL_WIDTH }, { player.x, player.y, PLAYER_WIDTH, PLAYER_HEIGHT })) {
-			ball_vx *= -1.08f;
-		}
-	}
+#define BALL_INITIAL_SPEED 3.0f
+
+// Inputs the client keeps for replaying on top of the server's state, a
+// couple of seconds of held keys at 60 frames a second.
+#define INPUT_HISTORY 128
+
+// Newest unacknowledged inputs repeated in every PlayerInputs packet. An
+// input only goes missing if this many packets in a row are lost.
+#define INPUT_REDUNDANCY 8
+
+// Snapshots the client keeps to interpolate the ball and the other paddle
+// between, enough for the render delay even at the full send rate.
+#define INTERPOLATION_HISTORY 32
+
+// Rollback mode. Both clients step the match at this rate, guess the
+// other player's input for at most ROLLBACK_MAX_PREDICTION frames before
+// waiting for it and compare checksums of the state every
+// ROLLBACK_CHECKSUM_INTERVAL frames. The history has to hold a little
+// over twice the prediction.
+#define ROLLBACK_FRAME_RATE 60
+#define ROLLBACK_MAX_PREDICTION 8
+#define ROLLBACK_CHECKSUM_INTERVAL 60
+#define ROLLBACK_HISTORY 64
+
+// Applies one PlayerMoved input. The server and the client's prediction
+// both go through this so they land in the same place.
+template <typename Player>
+inline void move_player(Player& player, int velocity) {
+	player.y = std::clamp(player.y + (float)velocity, 0.0f, (float)(HEIGHT - PLAYER_HEIGHT));
 }
-
@@ -0,0 +1,531 @@
+#include <bs/batch.h>
+#include <bs/enet.h>
+#include <bs/histogram.h>
+#include <bs/packet_allocator.h>
+#include <bs/server.h>
+#include <bs/tick_scheduler.h>
+
+#include <enet/enet.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "game_messages_generated.h"
+
+#include "config.h"
+
+// Headless load generator. Scripted bots connect, optionally ready up and
+// then stream PlayerMoved inputs at a fixed rate. By default it runs its own
+// Host_Server that answers every request and echoes inputs back so the bots
+// can time round trips; pass --server to aim at an already running server
+// instead (only the client side numbers are reported then).
+//
+// Bots are spread over worker threads, each worker owns one ENet host with
+// a peer per bot rather than a Host_Client (and a whole ENet host) per bot.
+
+using clock_type = std::chrono::steady_clock;
+
+struct Options {
+	const char* host = SAMPLES_HOST;
+	int32_t port = SAMPLES_PORT + 1;
+	bool external_server = false;
+
+	uint32_t clients = 1000;
+	uint32_t workers = 4;
+	uint32_t duration_s = 10;
+
+	// New connections per second across all workers.
+	uint32_t connect_rate = 500;
+
+	// PlayerMoved messages per second per bot, 0 to only connect.
+	uint32_t input_rate = 30;
+
+	// Fraction of bots that send ClientReady once connected.
+	float ready_ratio = 1.0f;
+
+	bool reliable_inputs = true;
+
+	// Embedded server settings.
+	uint32_t tick_rate = 60;
+	bool threaded_io = false;
+	bool batching = false;
+};
+
+static void print_usage() {
+	fmt::print(
+		"pong_loadgen [options]\n"
+		"  --clients <n>          bots to run (default 1000)\n"
+		"  --workers <n>          worker threads (default 4)\n"
+		"  --duration <s>         seconds to run for (default 10)\n"
+		"  --connect-rate <n>     connections started per second (default 500)\n"
+		"  --input-rate <hz>      inputs per second per bot (default 30)\n"
+		"  --ready-ratio <0..1>   fraction of bots that ready up (default 1)\n"
+		"  --unreliable-inputs    send inputs on the unreliable channel\n"
+		"  --server <host:port>   use a running server instead of the embedded one\n"
+		"  --port <n>             port for the embedded server\n"
+		"  --tick-rate <hz>       embedded server tick rate (default 60)\n"
+		"  --threaded-io          embedded server services ENet on its own thread\n"
+		"  --batching             embedded server batches its sends\n");
+}
+
+static bool parse_options(int argc, char** argv, Options& options) {
+	// Lives for the whole run, options.host may point in to it.
+	static std::string server_host;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		const bool has_value = i + 1 < argc;
+
+		if (arg == "--clients" && has_value) options.clients = (uint32_t)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--workers" && has_value) options.workers = (uint32_t)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--duration" && has_value) options.duration_s = (uint32_t)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--connect-rate" && has_value) options.connect_rate = (uint32_t)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--input-rate" && has_value) options.input_rate = (uint32_t)std::max(0, std::atoi(argv[++i]));
+		else if (arg == "--ready-ratio" && has_value) options.ready_ratio = std::clamp((float)std::atof(argv[++i]), 0.0f, 1.0f);
+		else if (arg == "--unreliable-inputs") options.reliable_inputs = false;
+		else if (arg == "--port" && has_value) options.port = std::atoi(argv[++i]);
+		else if (arg == "--tick-rate" && has_value) options.tick_rate = (uint32_t)std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--threaded-io") options.threaded_io = true;
+		else if (arg == "--batching") options.batching = true;
+		else if (arg == "--server" && has_value) {
+			const std::string_view address = argv[++i];
+			const auto colon = address.rfind(':');
+			if (colon == std::string_view::npos) {
+				return false;
+			}
+			server_host = std::string(address.substr(0, colon));
+			options.host = server_host.c_str();
+			options.port = std::atoi(std::string(address.substr(colon + 1)).c_str());
+			options.external_server = true;
+		}
+		else {
+			return false;
+		}
+	}
+
+	// One ENet host can't have more peers than this.
+	options.clients = std::min<uint32_t>(options.clients, ENET_PROTOCOL_MAXIMUM_PEER_ID);
+	options.workers = std::min(options.workers, options.clients);
+	return true;
+}
+
+static uint64_t elapsed_us(clock_type::time_point start, clock_type::time_point end) {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+}
+
+// -----------------------------
+//  Embedded server
+// -----------------------------
+
+struct Server_Result {
+	uint64_t connects = 0;
+	uint64_t disconnects = 0;
+	uint64_t received = 0;
+	uint64_t sent = 0;
+	uint64_t malformed = 0;
+};
+
+// Answers each request the way pong_server would and echoes every input
+// back on the channel it arrived on.
+static void run_server(bs::Host_Server& server, const Options& options, std::atomic<bool>& stop, Server_Result& result, bs::Tick_Scheduler& scheduler) {
+	bs::Packet_Allocator allocator;
+	flatbuffers::FlatBufferBuilder builder(bs::Packet_Pool::BLOCK_SIZE, &allocator);
+
+	scheduler.run([&](uint64_t) {
+		if (stop.load(std::memory_order_acquire)) {
+			scheduler.stop();
+			return;
+		}
+
+		server.tick(0);
+		server.get_packets().drain([&](bs::Packet& packet) {
+			switch (packet.get_type()) {
+			case bs::Packet::CONNECT: result.connects++; break;
+			case bs::Packet::DISCONNECT: result.disconnects++; break;
+
+			case bs::Packet::EVENT_RECIEVED: {
+				result.received++;
+
+				const auto bytes = packet.get_bytes();
+				flatbuffers::Verifier verifier(bytes.data(), bytes.size());
+				if (!Game::VerifyMessageBuffer(verifier)) {
+					result.malformed++;
+					break;
+				}
+
+				const auto* message = flatbuffers::GetRoot<Game::Message>(bytes.data());
+				switch (message->payload_type()) {
+				case Game::Any_ClientConnectedRequest: {
+					builder.Clear();
+					auto response = Game::CreateClientConnectedResponse(builder, packet.get_client_id(), 1000 / options.tick_rate);
+					builder.Finish(Game::CreateMessage(builder, Game::Any_ClientConnectedResponse, response.Union()));
+					server.send(allocator.release_packet(builder, packet.get_peer()), bs::CHANNEL_RELIABLE);
+					result.sent++;
+				} break;
+
+				case Game::Any_ClientReady: {
+					builder.Clear();
+					auto response = Game::CreateClientReadyResponse(builder, -1);
+					builder.Finish(Game::CreateMessage(builder, Game::Any_ClientReadyResponse, response.Union()));
+					server.send(allocator.release_packet(builder, packet.get_peer()), bs::CHANNEL_RELIABLE);
+					result.sent++;
+				} break;
+
+				case Game::Any_PlayerMoved: {
+					server.send(packet, packet.get_channel());
+					result.sent++;
+				} break;
+
+				default: break;
+				}
+			} break;
+
+			default: break;
+			}
+			});
+
+		server.flush();
+		});
+}
+
+// -----------------------------
+//  Bots
+// -----------------------------
+
+// Inputs in flight that can be matched to their echo, per bot.
+static constexpr uint32_t INPUT_WINDOW = 64;
+
+struct Bot {
+	enum State {
+		IDLE = 0,
+		CONNECTING,
+		HANDSHAKING,
+		ACTIVE,
+		DISCONNECTED,
+	};
+
+	ENetPeer* peer = nullptr;
+	State state = IDLE;
+
+	clock_type::time_point connect_start;
+	clock_type::time_point next_input;
+	uint32_t sequence = 0;
+	clock_type::time_point sent_at[INPUT_WINDOW];
+	uint32_t sent_sequence[INPUT_WINDOW] = {};
+};
+
+struct Worker_Result {
+	bs::Histogram connect_us;
+	bs::Histogram round_trip_us;
+	uint64_t sent = 0;
+	uint64_t received = 0;
+	uint64_t connected = 0;
+	uint64_t ready = 0;
+	uint64_t failed = 0;
+
+	// Read by the main thread for progress lines.
+	std::atomic<uint64_t> live_connected = 0;
+};
+
+static void run_worker(const Options& options, uint32_t bot_count, uint32_t connect_rate, uint32_t seed, std::atomic<bool>& stop, Worker_Result& result) {
+	const size_t channel_count = bs::Channel_Set().size();
+
+	ENetHost* host = enet_host_create(NULL, bot_count, channel_count, 0, 0);
+	ASSERT_PANIC(host != nullptr, "Failed to create a worker host for {} bots", bot_count);
+
+	ENetAddress address;
+	enet_address_set_host(&address, options.host);
+	address.port = (enet_uint16)options.port;
+
+	bs::Packet_Allocator allocator;
+	flatbuffers::FlatBufferBuilder builder(bs::Packet_Pool::BLOCK_SIZE, &allocator);
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<Bot> bots(bot_count);
+	const auto input_interval = options.input_rate ? std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / options.input_rate)) : clock_type::duration::zero();
+	const auto connect_interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / connect_rate));
+	const auto input_channel = bs::get_default_channel(options.reliable_inputs);
+	const auto input_delivery = options.reliable_inputs ? bs::DELIVERY_RELIABLE : bs::DELIVERY_UNRELIABLE_SEQUENCED;
+
+	auto send = [&](Bot& bot, bs::channel_id channel, bs::Delivery delivery) {
+		allocator.release_packet(builder, bot.peer).send_to(bot.peer, channel, delivery);
+		result.sent++;
+	};
+
+	auto on_message = [&](Bot& bot, const bs::Packet& packet, clock_type::time_point now) {
+		result.received++;
+
+		const auto bytes = packet.get_bytes();
+		flatbuffers::Verifier verifier(bytes.data(), bytes.size());
+		if (!Game::VerifyMessageBuffer(verifier)) {
+			return;
+		}
+
+		const auto* message = flatbuffers::GetRoot<Game::Message>(bytes.data());
+		switch (message->payload_type()) {
+		case Game::Any_ClientConnectedResponse: {
+			if (bot.state != Bot::HANDSHAKING) {
+				break;
+			}
+
+			result.connect_us.record(elapsed_us(bot.connect_start, now));
+			result.connected++;
+			result.live_connected.fetch_add(1, std::memory_order_relaxed);
+			bot.state = Bot::ACTIVE;
+
+			// Spread the inputs out over the interval rather than in lockstep.
+			bot.next_input = now + std::chrono::duration_cast<clock_type::duration>(input_interval * unit(random));
+
+			if (unit(random) < options.ready_ratio) {
+				builder.Clear();
+				auto ready = Game::CreateClientReady(builder, true);
+				builder.Finish(Game::CreateMessage(builder, Game::Any_ClientReady, ready.Union()));
+				send(bot, bs::CHANNEL_RELIABLE, bs::DELIVERY_RELIABLE);
+			}
+		} break;
+
+		case Game::Any_ClientReadyResponse: {
+			result.ready++;
+		} break;
+
+		case Game::Any_PlayerMoved: {
+			const uint32_t sequence = message->payload_as_PlayerMoved()->sequence();
+			const uint32_t slot = sequence % INPUT_WINDOW;
+			if (bot.sent_sequence[slot] == sequence) {
+				result.round_trip_us.record(elapsed_us(bot.sent_at[slot], now));
+			}
+		} break;
+
+		default: break;
+		}
+	};
+
+	uint32_t next_bot = 0;
+	auto next_connect = clock_type::now();
+
+	while (!stop.load(std::memory_order_acquire)) {
+		auto now = clock_type::now();
+
+		while (next_bot < bot_count && now >= next_connect) {
+			auto& bot = bots[next_bot++];
+			bot.peer = enet_host_connect(host, &address, channel_count, 0);
+			if (!bot.peer) {
+				bot.state = Bot::DISCONNECTED;
+				result.failed++;
+				continue;
+			}
+
+			bot.peer->data = &bot;
+			bot.state = Bot::CONNECTING;
+			bot.connect_start = now;
+			next_connect += connect_interval;
+		}
+
+		if (input_interval != clock_type::duration::zero()) {
+			for (auto& bot : bots) {
+				if (bot.state != Bot::ACTIVE || now < bot.next_input) {
+					continue;
+				}
+
+				const uint32_t sequence = ++bot.sequence;
+				bot.sent_sequence[sequence % INPUT_WINDOW] = sequence;
+				bot.sent_at[sequence % INPUT_WINDOW] = now;
+				bot.next_input += input_interval;
+
+				builder.Clear();
+				auto moved = Game::CreatePlayerMoved(builder, 0, (int)(sequence % 3) - 1, sequence);
+				builder.Finish(Game::CreateMessage(builder, Game::Any_PlayerMoved, moved.Union()));
+				send(bot, input_channel, input_delivery);
+			}
+		}
+
+		ENetEvent event{};
+		int serviced = enet_host_service(host, &event, 1);
+		while (serviced > 0) {
+			now = clock_type::now();
+			auto* bot = static_cast<Bot*>(event.peer->data);
+
+			switch (event.type) {
+			case ENET_EVENT_TYPE_CONNECT: {
+				bot->state = Bot::HANDSHAKING;
+
+				builder.Clear();
+				auto request = Game::CreateClientConnectedRequest(builder);
+				builder.Finish(Game::CreateMessage(builder, Game::Any_ClientConnectedRequest, request.Union()));
+				send(*bot, bs::CHANNEL_RELIABLE, bs::DELIVERY_RELIABLE);
+			} break;
+
+			case ENET_EVENT_TYPE_DISCONNECT: {
+				if (bot->state == Bot::ACTIVE) {
+					result.live_connected.fetch_sub(1, std::memory_order_relaxed);
+				}
+				bot->state = Bot::DISCONNECTED;
+				result.failed++;
+			} break;
+
+			case ENET_EVENT_TYPE_RECEIVE: {
+				bs::Packet packet(&event);
+				if (bs::is_batch_frame(packet.get_bytes())) {
+					bs::unpack_batch_frame(packet, [&](bs::Packet&& message) { on_message(*bot, message, now); });
+				}
+				else {
+					on_message(*bot, packet, now);
+				}
+			} break;
+
+			default: break;
+			}
+
+			serviced = enet_host_check_events(host, &event);
+		}
+	}
+
+	for (auto& bot : bots) {
+		if (bot.peer && bot.state != Bot::DISCONNECTED) {
+			enet_peer_disconnect_now(bot.peer, 0);
+		}
+	}
+	enet_host_flush(host);
+	enet_host_destroy(host);
+}
+
+// -----------------------------
+//  Report
+// -----------------------------
+
+static void print_histogram(const char* name, const bs::Histogram& histogram) {
+	fmt::print("  {:<16} n={:<9} p50 {:>7}us  p90 {:>7}us  p99 {:>7}us  p99.9 {:>7}us  max {:>7}us\n",
+		name,
+		histogram.get_count(),
+		histogram.get_percentile(50.0),
+		histogram.get_percentile(90.0),
+		histogram.get_percentile(99.0),
+		histogram.get_percentile(99.9),
+		histogram.get_max());
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parse_options(argc, argv, options)) {
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	auto logger = spdlog::stdout_color_mt("LOADGEN");
+	logger->set_level(spdlog::level::warn);
+	bs::ENet enet(logger);
+
+	// Embedded server, on its own thread so it competes with the bots the
+	// same way a real one would.
+	std::atomic<bool> stop_server = false;
+	Server_Result server_result;
+	bs::Host_Server* server = nullptr;
+	std::unique_ptr<bs::Tick_Scheduler> scheduler;
+	std::thread server_thread;
+
+	if (!options.external_server) {
+		server = enet.create_server(options.host, options.port, (int32_t)options.clients);
+		server->set_batching(options.batching);
+		server->start(options.threaded_io ? bs::Host_Server::IO_THREADED : bs::Host_Server::IO_INLINE);
+
+		scheduler = std::make_unique<bs::Tick_Scheduler>(bs::Tick_Scheduler::Config{ .tick_rate = options.tick_rate }, logger);
+		server_thread = std::thread([&] { run_server(*server, options, stop_server, server_result, *scheduler); });
+	}
+
+	fmt::print("{} bots on {} workers against {}:{}{} for {}s, {} inputs/s each ({})\n",
+		options.clients, options.workers, options.host, options.port,
+		options.external_server ? "" : " (embedded)",
+		options.duration_s, options.input_rate,
+		options.reliable_inputs ? "reliable" : "unreliable");
+
+	std::atomic<bool> stop_workers = false;
+	std::vector<std::unique_ptr<Worker_Result>> results;
+	std::vector<std::thread> workers;
+
+	for (uint32_t i = 0; i < options.workers; ++i) {
+		const uint32_t bot_count = options.clients / options.workers + (i < options.clients % options.workers ? 1 : 0);
+		const uint32_t connect_rate = std::max(1u, options.connect_rate / options.workers);
+
+		results.push_back(std::make_unique<Worker_Result>());
+		workers.emplace_back([&options, &stop_workers, result = results.back().get(), bot_count, connect_rate, i] {
+			run_worker(options, bot_count, connect_rate, 1234 + i, stop_workers, *result);
+			});
+	}
+
+	const auto start = clock_type::now();
+	for (uint32_t second = 1; second <= options.duration_s; ++second) {
+		std::this_thread::sleep_until(start + std::chrono::seconds(second));
+
+		uint64_t connected = 0;
+		for (auto& result : results) {
+			connected += result->live_connected.load(std::memory_order_relaxed);
+		}
+		fmt::print("[{:>3}s] {} bots connected\n", second, connected);
+	}
+
+	stop_workers.store(true, std::memory_order_release);
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	const double seconds = (double)elapsed_us(start, clock_type::now()) / 1e6;
+
+	if (server) {
+		stop_server.store(true, std::memory_order_release);
+		server_thread.join();
+	}
+
+	Worker_Result total;
+	for (auto& result : results) {
+		total.connect_us.merge(result->connect_us);
+		total.round_trip_us.merge(result->round_trip_us);
+		total.sent += result->sent;
+		total.received += result->received;
+		total.connected += result->connected;
+		total.ready += result->ready;
+		total.failed += result->failed;
+	}
+
+	fmt::print("\nClient observed over {:.1f}s\n", seconds);
+	fmt::print("  connected {} of {} ({:.0f}/s), {} ready, {} failed or dropped\n",
+		total.connected, options.clients, (double)total.connected / seconds, total.ready, total.failed);
+	fmt::print("  sent {} ({:.0f} msg/s), received {} ({:.0f} msg/s)\n",
+		total.sent, (double)total.sent / seconds, total.received, (double)total.received / seconds);
+	print_histogram("connect", total.connect_us);
+	print_histogram("input round trip", total.round_trip_us);
+
+	if (server) {
+		fmt::print("\nServer observed\n");
+		fmt::print("  {} connects, {} disconnects, {} malformed\n", server_result.connects, server_result.disconnects, server_result.malformed);
+		fmt::print("  received {} ({:.0f} msg/s), sent {} ({:.0f} msg/s)\n",
+			server_result.received, (double)server_result.received / seconds, server_result.sent, (double)server_result.sent / seconds);
+
+		const auto& channels = server->get_channels();
+		for (size_t i = 0; i < channels.size(); ++i) {
+			const auto channel = bs::channel_id(i);
+			const auto& stats = channels.get_stats(channel);
+			fmt::print("  channel {:<12} in {:>9} pkts {:>11} B   out {:>9} pkts {:>11} B\n",
+				channels.get_config(channel).name, stats.packets_received, stats.bytes_received, stats.packets_sent, stats.bytes_sent);
+		}
+
+		fmt::print("  tick drift p99 {}us, {} overruns (p99 {}us, max {}us), {} ticks dropped\n",
+			scheduler->get_drift().get_percentile(99.0),
+			scheduler->get_overrun().get_count(),
+			scheduler->get_overrun().get_percentile(99.0),
+			scheduler->get_overrun().get_max(),
+			scheduler->get_dropped_ticks());
+	}
+
+	return EXIT_SUCCESS;
+}
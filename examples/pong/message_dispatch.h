@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "game_messages_generated.h"
+
+#include <bs/packet.h>
+
+// Typed handlers for the messages in the Game::Any union, handed to
+// Game_Host::set_message_handlers(). Every message gets either an on<T>()
+// handler or is listed in an unexpected<...>() for the ones this side
+// should never be sent. The set is turned in to a table of plain function
+// pointers indexed by the union tag, each entry casts the payload to its
+// table and calls the handler directly.
+//
+// A message left out, or handled twice, doesn't compile.
+
+// Called with (const T* message, const bs::Packet* packet).
+template <typename Table, typename Fn>
+struct Message_Handler {
+	using table_t = Table;
+	Fn fn;
+};
+
+template <typename... Tables>
+struct Unexpected_Messages {};
+
+template <typename Table, typename Fn>
+Message_Handler<Table, std::decay_t<Fn>> on(Fn&& fn) {
+	static_assert(Game::AnyTraits<Table>::enum_value != Game::Any_NONE, "on<T>() takes a table from the Game::Any union");
+	static_assert(std::is_invocable_v<std::decay_t<Fn>&, const Table*, const bs::Packet*>, "Message handlers are called with (const T*, const bs::Packet*)");
+	return { std::forward<Fn>(fn) };
+}
+
+// Messages this side doesn't take, Game_Host logs them as errors.
+template <typename... Tables>
+Unexpected_Messages<Tables...> unexpected() {
+	static_assert(((Game::AnyTraits<Tables>::enum_value != Game::Any_NONE) && ...), "unexpected<...>() takes tables from the Game::Any union");
+	return {};
+}
+
+// Returns false for a message with no handler.
+using message_dispatch_t = bool (*)(void* handlers, const Game::Message* message, const bs::Packet* packet);
+
+template <typename... Handlers>
+class Message_Handlers {
+public:
+	static constexpr size_t TAG_COUNT = (size_t)Game::Any_MAX + 1;
+
+	Message_Handlers(Handlers... handlers)
+		: m_handlers(std::move(handlers)...)
+	{
+		static_assert(handles_every_message(), "Every Game::Any message needs an on<T>() handler or to be listed in unexpected<...>()");
+		static_assert(handles_each_once(), "A Game::Any message is handled more than once");
+	}
+
+	// Indexed by the union tag, which is checked against TAG_COUNT first.
+	static const message_dispatch_t* get_table() { return TABLE.data(); }
+
+private:
+	using tuple_t = std::tuple<Handlers...>;
+	static constexpr size_t NO_HANDLER = sizeof...(Handlers);
+
+	template <typename Handler>
+	struct Handler_Tags;
+
+	template <typename Table, typename Fn>
+	struct Handler_Tags<Message_Handler<Table, Fn>> {
+		static constexpr bool calls = true;
+		static constexpr std::array<size_t, 1> tags = { (size_t)Game::AnyTraits<Table>::enum_value };
+	};
+
+	template <typename... Tables>
+	struct Handler_Tags<Unexpected_Messages<Tables...>> {
+		static constexpr bool calls = false;
+		static constexpr std::array<size_t, sizeof...(Tables)> tags = { (size_t)Game::AnyTraits<Tables>::enum_value... };
+	};
+
+	static constexpr std::array<size_t, TAG_COUNT> count_tags() {
+		std::array<size_t, TAG_COUNT> counts{};
+		([&] {
+			for (const size_t tag : Handler_Tags<Handlers>::tags) {
+				counts[tag]++;
+			}
+			}(), ...);
+		return counts;
+	}
+
+	// NONE is never sent so it needs no handler.
+	static constexpr bool handles_every_message() {
+		const auto counts = count_tags();
+		for (size_t tag = 1; tag < TAG_COUNT; ++tag) {
+			if (counts[tag] == 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static constexpr bool handles_each_once() {
+		for (const size_t count : count_tags()) {
+			if (count > 1) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <size_t Tag, size_t I = 0>
+	static constexpr size_t find_handler() {
+		if constexpr (I == sizeof...(Handlers)) {
+			return NO_HANDLER;
+		}
+		else if constexpr (Handler_Tags<std::tuple_element_t<I, tuple_t>>::calls && Handler_Tags<std::tuple_element_t<I, tuple_t>>::tags[0] == Tag) {
+			return I;
+		}
+		else {
+			return find_handler<Tag, I + 1>();
+		}
+	}
+
+	// The message has been verified and its tag picked this entry, so the
+	// payload is the handler's table without asking flatbuffers again.
+	template <size_t Tag>
+	static bool dispatch(void* handlers, const Game::Message* message, const bs::Packet* packet) {
+		constexpr size_t index = find_handler<Tag>();
+		if constexpr (index == NO_HANDLER) {
+			return false;
+		}
+		else {
+			auto& handler = std::get<index>(static_cast<Message_Handlers*>(handlers)->m_handlers);
+			using table_t = typename std::tuple_element_t<index, tuple_t>::table_t;
+			handler.fn(static_cast<const table_t*>(message->payload()), packet);
+			return true;
+		}
+	}
+
+	template <size_t... Tags>
+	static constexpr std::array<message_dispatch_t, TAG_COUNT> make_table(std::index_sequence<Tags...>) {
+		return { &dispatch<Tags>... };
+	}
+
+	static constexpr std::array<message_dispatch_t, TAG_COUNT> TABLE = make_table(std::make_index_sequence<TAG_COUNT>{});
+
+	tuple_t m_handlers;
+};
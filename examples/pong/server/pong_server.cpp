@@ -1,34 +1,52 @@
+#include <bs/job_system.h>
+#include <bs/lag_compensation.h>
+#include <bs/loopback.h>
+#include <bs/packet_recording.h>
+#include <bs/prediction.h>
+#include <bs/room_manager.h>
 #include <bs/server.h>
+#include <bs/tick_scheduler.h>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <thread>
+#include <vector>
+#include <string_view>
 
 #include "game_messages_generated.h"
 
 #include "config.h"
+#include "simulation.h"
 #include "base_game_host.h"
+#include "snapshot.h"
 
 #include <raylib.h>
 
 
-#define TICK_RATE (int)((float)(1.0f / 60.0f) * 1000.0f)
+#define TICKS_PER_SECOND 60
+#define TICK_RATE (int)((float)(1.0f / TICKS_PER_SECOND) * 1000.0f)
 
 struct Player {
-	int id = -1;
+	bs::client_id id = -1;
 	float x = 0.0f;
 	float y = 0.0f;
 	bool ready = false;
 	int score = 0;
-};
-float ball_x = 0.0f;
-float ball_y = 0.0f;
-float ball_vx = 0.0f;
-float ball_vy = 0.0f;
 
-static Player players[2] = {};
-bool game_started = false;
+	// Latest snapshot this player's client has acknowledged.
+	bs::snapshot_seq acked_snapshot = bs::NO_BASELINE;
+
+	// Last numbered input applied, echoed back in every snapshot.
+	bs::input_seq last_input = bs::NO_INPUT;
+
+	// How many ticks behind the server the ball was on this player's
+	// screen when their newest input was sent, -1 until they've said.
+	int64_t view_lag = -1;
+};
 
 enum Game_State {
 	WAITING = 0,
@@ -45,157 +63,611 @@ const char* GameStateToString(Game_State& s) {
 	default: return "UNKNOWN";
 	}
 }
-Game_State gameState = WAITING;
 
-int main() {
+// The ball and score at the start of a tick, what lag compensation looks
+// back at.
+struct Pong_Frame {
+	float ball_x = 0.0f;
+	float ball_y = 0.0f;
+	float ball_vx = 0.0f;
+	float ball_vy = 0.0f;
+	int score[2] = {};
+};
+
+// Ticks of Pong_Frames each room keeps, a little over half a second.
+#define REWIND_HISTORY 32
+
+// One match. The players are indexed by their seat in the room.
+struct Pong_Room {
+	static constexpr size_t SEATS = 2;
+
+	Player players[SEATS] = {};
+
+	float ball_x = 0.0f;
+	float ball_y = 0.0f;
+	float ball_vx = 0.0f;
+	float ball_vy = 0.0f;
+
+	Game_State state = WAITING;
+
+	Pong_Snapshot_Buffer snapshot_history;
+	bs::snapshot_seq snapshot_sequence = bs::NO_BASELINE;
+
+	// This tick's snapshot for each seat, encoded alongside the simulation
+	// and sent afterwards from the network thread.
+	bs::Bit_Writer snapshot_writers[SEATS];
+	bs::snapshot_seq snapshot_baselines[SEATS] = {};
+
+	bs::Rewind_Buffer<Pong_Frame, REWIND_HISTORY> history;
+};
+
+using Pong_Rooms = bs::Room_Manager<Pong_Room>;
+
+// Rooms stepped per job, enough that splitting isn't most of the work.
+#define ROOMS_PER_JOB 32
+
+static Pong_Snapshot make_snapshot(const Pong_Room& room) {
+	Pong_Snapshot snapshot;
+	for (int i = 0; i < 2; ++i) {
+		snapshot.player_x[i] = snapshot_position(room.players[i].x);
+		snapshot.player_y[i] = snapshot_position(room.players[i].y);
+		snapshot.score[i] = (uint32_t)room.players[i].score;
+	}
+	snapshot.ball_x = snapshot_position(room.ball_x);
+	snapshot.ball_y = snapshot_position(room.ball_y);
+	snapshot.ball_vx = snapshot_velocity(room.ball_vx);
+	snapshot.ball_vy = snapshot_velocity(room.ball_vy);
+	return snapshot;
+}
+
+int main(int argc, char** argv) {
 	auto logger = spdlog::stdout_color_mt("SERVER");
 
-	auto server = Game_Host<bs::Host_Server>(logger, SAMPLES_HOST, SAMPLES_PORT);
+	// Pass --threaded-io to service the network on its own thread,
+	// --batching to coalesce each tick's messages per client, --headless
+	// to run without the status window and --metrics <file> to write the
+	// server's metrics every second (JSON if the file ends in .json,
+	// otherwise Prometheus text). --netsim <profile> runs the server's side
+	// of every link through a simulated network, e.g. "mobile",
+	// "delay=80,jitter=20,loss=0.02" or "wifi;10s:bad", see bs::Link_Script.
+	// --send-rate <hz> sends snapshots less often than the simulation
+	// ticks, the clients interpolate between them. --max-clients <n> sets
+	// how many clients (two per match) the server takes and --workers <n>
+	// how many threads besides the main one step the rooms (one less than
+	// the core count by default). --max-rewind <ms> is how far back a
+	// player's view is trusted when the ball gets past them, 0 turns lag
+	// compensation off. --rollback has the two clients of each match run it
+	// themselves with rollback, the server only relays their inputs.
+	// --record <file> writes every packet in and out to a recording and
+	// --replay <file> plays one back at a server with no window on an
+	// in-process network, tick for tick and as fast as it will go, then
+	// says how long it took. Both at once records the replay to compare.
+	auto io_mode = bs::Host_Server::IO_INLINE;
+	bool batching = false;
+	bool headless = false;
+	const char* metrics_path = nullptr;
+	int send_rate = TICKS_PER_SECOND;
+	int max_clients = 32;
+	size_t workers = bs::Job_System::get_default_worker_count();
+	int max_rewind_ms = 300;
+	bool rollback = false;
+	const char* record_path = nullptr;
+	const char* replay_path = nullptr;
+	bs::Link_Script netsim;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string_view(argv[i]) == "--threaded-io") {
+			io_mode = bs::Host_Server::IO_THREADED;
+		}
+		else if (std::string_view(argv[i]) == "--batching") {
+			batching = true;
+		}
+		else if (std::string_view(argv[i]) == "--headless") {
+			headless = true;
+		}
+		else if (std::string_view(argv[i]) == "--metrics" && i + 1 < argc) {
+			metrics_path = argv[++i];
+		}
+		else if (std::string_view(argv[i]) == "--send-rate" && i + 1 < argc) {
+			send_rate = std::clamp(std::atoi(argv[++i]), 1, TICKS_PER_SECOND);
+		}
+		else if (std::string_view(argv[i]) == "--max-clients" && i + 1 < argc) {
+			// ENet numbers peers in 12 bits.
+			max_clients = std::clamp(std::atoi(argv[++i]), 2, 4095);
+		}
+		else if (std::string_view(argv[i]) == "--workers" && i + 1 < argc) {
+			workers = (size_t)std::max(0, std::atoi(argv[++i]));
+		}
+		else if (std::string_view(argv[i]) == "--max-rewind" && i + 1 < argc) {
+			max_rewind_ms = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (std::string_view(argv[i]) == "--rollback") {
+			rollback = true;
+		}
+		else if (std::string_view(argv[i]) == "--record" && i + 1 < argc) {
+			record_path = argv[++i];
+		}
+		else if (std::string_view(argv[i]) == "--replay" && i + 1 < argc) {
+			replay_path = argv[++i];
+		}
+		else if (std::string_view(argv[i]) == "--netsim" && i + 1 < argc) {
+			std::string error;
+			if (!bs::Link_Script::parse(argv[++i], netsim, error)) {
+				logger->error("{}", error);
+				return EXIT_FAILURE;
+			}
+		}
+	}
 
-	server.set_disconnect_callback([&] {
-		gameState = DISCONNECTED;
-		});
+	const uint64_t send_interval = TICKS_PER_SECOND / send_rate;
+	const bs::server_tick max_rewind = std::min<bs::server_tick>((uint64_t)max_rewind_ms * TICKS_PER_SECOND / 1000, REWIND_HISTORY - 1);
+	const auto metrics_format = metrics_path && std::string_view(metrics_path).ends_with(".json") ? bs::Metrics::FORMAT_JSON : bs::Metrics::FORMAT_PROMETHEUS;
 
-	server.set_tick_callback([&](const Game::Message* message, const bs::Packet* packet) {
-		auto type = message->payload_type();
+	bs::Packet_Recording recording;
+	if (replay_path && !recording.open(replay_path)) {
+		logger->error("Failed to open recording {}", replay_path);
+		return EXIT_FAILURE;
+	}
 
-		switch (type) {
-		case Game::Any_ClientConnectedRequest: {
-			const auto* client_msg = message->payload_as_ClientConnectedRequest();
+	// Replays play to the server in process, still through any netsim.
+	bs::Loopback_Network loopback;
+	bs::Link_Conditioner conditioner(replay_path ? (bs::Transport_Factory&)loopback : bs::Transport_Factory::get_enet(), netsim);
 
-			for (auto& player : players) {
-				if (player.id == -1) {
-					player.id = packet->get_client_id();
-					break;
-				}
+	// Outlives the server, which records right up until it goes.
+	bs::Packet_Recorder recorder(logger);
+	auto server = Game_Host<bs::Host_Server>(logger, SAMPLES_HOST, SAMPLES_PORT, io_mode, conditioner, max_clients);
+	server->set_batching(batching);
+
+	if (record_path) {
+		if (!recorder.open(record_path)) {
+			return EXIT_FAILURE;
+		}
+		server->set_recorder(&recorder);
+	}
+
+	// Every match is a room of two, clients are seated as they ready up.
+	Pong_Rooms rooms(*server.get_host_type(), Pong_Room::SEATS);
+
+	auto get_player = [&](bs::client_id id) -> Player* {
+		auto* room = rooms.get(rooms.get_room_id(id));
+		return room ? &room->players[rooms.get_seat(id)] : nullptr;
+		};
+
+	auto start_game = [&](bs::room_id room_id, Pong_Room& room) {
+		server.get_logger()->info("All players are ready in room {}, starting game...", room_id);
+
+		room.state = PLAYING;
+		rooms.close(room_id);
+
+		auto& player_1 = room.players[0];
+		player_1.x = 5.0f;
+		player_1.y = (HEIGHT / 2.0f) - PLAYER_HEIGHT / 2.0f;
+
+		auto& player_2 = room.players[1];
+		player_2.x = WIDTH - PLAYER_WIDTH - 5.0f;
+		player_2.y = (HEIGHT / 2.0f) - PLAYER_HEIGHT / 2.0f;
+
+		// Start each client off with a full snapshot.
+		player_1.acked_snapshot = bs::NO_BASELINE;
+		player_2.acked_snapshot = bs::NO_BASELINE;
+
+		room.ball_x = WIDTH / 2.0f;
+		room.ball_y = HEIGHT / 2.0f;
+
+		room.ball_vx = BALL_INITIAL_SPEED;
+		room.ball_vy = BALL_INITIAL_SPEED;
+
+		bs::Packet start_packet = server.create_game_starting(player_1.x, player_1.y, player_2.x, player_2.y, room.ball_x, room.ball_y, room.ball_vx, room.ball_vy, rollback);
+		rooms.broadcast(room_id, start_packet, bs::CHANNEL_RELIABLE);
+		};
+
+	// Encode the game state for each client as a delta against the last
+	// snapshot it acknowledged, or a full snapshot if that one has fallen
+	// out of the history. Only touches the room so rooms can be encoded in
+	// parallel.
+	auto encode_snapshots = [](Pong_Room& room) {
+		const auto snapshot = make_snapshot(room);
+		room.snapshot_history.insert(++room.snapshot_sequence, snapshot);
+
+		for (size_t seat = 0; seat < Pong_Room::SEATS; ++seat) {
+			const auto acked = room.players[seat].acked_snapshot;
+			const auto baseline = Pong_Snapshot_Buffer::in_window(room.snapshot_sequence, acked) ? acked : bs::NO_BASELINE;
+
+			auto& writer = room.snapshot_writers[seat];
+			writer.clear();
+			encode_snapshot(writer, *room.snapshot_history.find(baseline), snapshot);
+			writer.finish();
+			room.snapshot_baselines[seat] = baseline;
+		}
+		};
+
+	// The tick being stepped, messages are handled at the start of it.
+	bs::server_tick current_tick = bs::NO_TICK;
+
+	// Inputs carry the server time the client was drawing the ball at. Keep
+	// how far behind that was rather than the tick itself, so a player
+	// that stops sending inputs is still judged by their usual lag.
+	auto set_view = [&](Player& player, uint32_t view_time_ms) {
+		if (view_time_ms == 0) {
+			return;
+		}
+
+		const auto view_tick = ((bs::server_tick)view_time_ms * TICKS_PER_SECOND + 500) / 1000;
+		player.view_lag = current_tick > view_tick ? (int64_t)(current_tick - view_tick) : 0;
+		};
+
+	// Lag compensation, run after the room has stepped the tick. A ball
+	// that got past a paddle here but was touching it on that player's
+	// screen is a save: the goal is taken back and the ball comes off the
+	// paddle from where it was at the start of the tick. Only touches the
+	// room, like encode_snapshots.
+	auto compensate = [&](Pong_Room& room, bs::server_tick tick) {
+		const auto* before = room.history.find(tick);
+		if (!before || max_rewind == 0) {
+			return;
+		}
+
+		for (size_t seat = 0; seat < Pong_Room::SEATS; ++seat) {
+			// The other seat scoring means the ball got past this one.
+			const size_t other = 1 - seat;
+			const auto& player = room.players[seat];
+			if (room.players[other].score == before->score[other] || player.view_lag < 0 || (bs::server_tick)player.view_lag >= tick) {
+				continue;
 			}
 
-			auto client = server.get_host_type()->get_client_manager().get_client(packet->get_peer());
+			const auto* seen = room.history.rewind(tick - (bs::server_tick)player.view_lag, max_rewind);
+			if (!seen || !ball_hits_paddle(seen->ball_x, seen->ball_y, player.x, player.y)) {
+				continue;
+			}
 
-			bs::Packet packet = server.create_client_connect_response(client->get_id(), TICK_RATE);
-			packet.set_peer(client->get_peer());
-			packet.send(true);
+			// Put the ball against the paddle's face so it doesn't bounce
+			// straight back in to it next tick.
+			room.players[other].score = before->score[other];
+			room.ball_x = seat == 0 ? player.x + PLAYER_WIDTH : player.x - BALL_WIDTH;
+			room.ball_y = before->ball_y;
+			room.ball_vx = before->ball_vx * BALL_PADDLE_BOUNCE;
+			room.ball_vy = before->ball_vy;
+			server.get_logger()->debug("Client {} saved the ball {} ticks back", player.id, player.view_lag);
 			break;
 		}
+		};
+
+	// These go unreliably, a lost one is simply superseded by the next.
+	// Each is stamped with the tick's time so the clients can space them
+	// out properly.
+	auto send_snapshots = [&](Pong_Room& room, uint64_t tick) {
+		const auto time_ms = (uint32_t)(tick * 1000 / TICKS_PER_SECOND);
+
+		for (size_t seat = 0; seat < Pong_Room::SEATS; ++seat) {
+			const auto& player = room.players[seat];
+			auto client = server->get_client_manager().get_client(player.id);
+			if (!client) {
+				continue;
+			}
+
+			bs::Packet tick_packet = server.create_tick_delta(room.snapshot_sequence, room.snapshot_baselines[seat], room.snapshot_writers[seat].finish(), player.last_input, time_ms);
+			tick_packet.set_peer(client->get_peer());
+			server->send(tick_packet, bs::CHANNEL_UNRELIABLE);
+		}
+		};
+
+	server.set_disconnect_callback([&](const bs::Packet* packet) {
+		const auto room_id = rooms.get_room_id(packet->get_client_id());
+		const auto* room = rooms.get(room_id);
+		if (!room) {
+			return;
+		}
+
+		// A match can't go on a player down, send the other one back to
+		// waiting for a new match.
+		const bool playing = room->state == PLAYING;
+		rooms.leave(packet->get_client_id());
+		if (playing) {
+			rooms.broadcast(room_id, server.create_client_disconnect(), bs::CHANNEL_RELIABLE);
+			rooms.destroy(room_id);
+		}
+		});
 
-		case Game::Any_ClientDisconnected: {
-			const auto* client_msg = message->payload_as_ClientDisconnected();
-		} break;
+	// Rollback matches run on the clients, pass what one sends on to the
+	// other untouched.
+	auto relay_to_opponent = [&](const bs::Packet* packet, bs::channel_id channel) {
+		const auto id = packet->get_client_id();
+		const auto room_id = rooms.get_room_id(id);
+		const auto* room = rooms.get(room_id);
+		if (!rollback || !room || room->state != PLAYING) {
+			server.get_logger()->error("Rollback message from client {} outside of a rollback match", id);
+			return;
+		}
 
-		case Game::Any_ClientReady: {
-			const auto* client_msg = message->payload_as_ClientReady();
-			for (size_t i = 0; i < std::size(players); ++i) {
-				auto& player = players[i];
+		const auto other_id = rooms.get_seated(room_id, Pong_Room::SEATS - 1 - rooms.get_seat(id));
+		if (auto other = server->get_client_manager().get_client(other_id)) {
+			const auto bytes = packet->get_bytes();
+			bs::Packet relay(other->get_peer(), bytes.data(), bytes.size());
+			server->send(relay, channel);
+		}
+		};
+
+	server.set_message_handlers(
+		on<Game::ClientConnectedRequest>([&](const Game::ClientConnectedRequest*, const bs::Packet* packet) {
+			// By id, not peer, the client may have disconnected (and its peer been
+			// reused) in the same tick it asked to connect.
+			auto client = server.get_host_type()->get_client_manager().get_client(packet->get_client_id());
+			if (!client) {
+				return;
+			}
 
-				if (player.id == packet->get_client_id()) {
-					player.ready = client_msg->ready();
-					server.get_logger()->trace("Client {} is ready: {}", packet->get_client_id(), player.ready);
+			bs::Packet response = server.create_client_connect_response(client->get_id(), TICK_RATE);
+			response.set_peer(client->get_peer());
+			server->send(response, bs::CHANNEL_RELIABLE);
+			}),
 
-					if (player.ready) {
-						bs::Packet response = server.create_client_ready_response((int)i);
-						response.set_peer(packet->get_peer());
-						response.send(true);
-					}
+		on<Game::ClientReady>([&](const Game::ClientReady* client_msg, const bs::Packet* packet) {
+			const auto id = packet->get_client_id();
+			const bool ready = client_msg->ready();
+			server.get_logger()->trace("Client {} is ready: {}", id, ready);
 
-					break;
+			auto room_id = rooms.get_room_id(id);
+			if (room_id == bs::INVALID_ROOM_ID) {
+				if (!ready) {
+					return;
 				}
+
+				room_id = rooms.join(id);
+				if (room_id == bs::INVALID_ROOM_ID) {
+					return;
+				}
+
+				auto* player = get_player(id);
+				*player = {};
+				player->id = id;
 			}
 
-			// Once all players have readied up, start the game.
-			if (players[0].ready && players[1].ready) {
-				gameState = PLAYING;
-				server.get_logger()->info("All players are ready starting game...");
+			auto& room = *rooms.get(room_id);
+			if (room.state != WAITING) {
+				return;
+			}
+
+			// Unreadying gives up the seat.
+			if (!ready) {
+				rooms.leave(id);
+				return;
+			}
 
-				game_started = true;
+			const size_t seat = rooms.get_seat(id);
+			room.players[seat].ready = true;
 
-				auto& player_1 = players[0];
-				player_1.x = 5.0f;
-				player_1.y = (HEIGHT / 2.0f) - PLAYER_HEIGHT / 2.0f;
+			bs::Packet response = server.create_client_ready_response((int)seat);
+			response.set_peer(packet->get_peer());
+			server->send(response, bs::CHANNEL_RELIABLE);
 
-				auto& player_2 = players[1];
-				player_2.x = WIDTH - PLAYER_WIDTH - 5.0f;
-				player_2.y = (HEIGHT / 2.0f) - PLAYER_HEIGHT / 2.0f;
+			// Once all players have readied up, start the game.
+			if (rooms.get_seated_count(room_id) == Pong_Room::SEATS && room.players[0].ready && room.players[1].ready) {
+				start_game(room_id, room);
+			}
+			}),
 
-				ball_x = WIDTH / 2.0f;
-				ball_y = HEIGHT / 2.0f;
+		on<Game::PlayerMoved>([&](const Game::PlayerMoved* player_msg, const bs::Packet* packet) {
+			server.get_logger()->trace("Player moved receieved for {}: Vel: {}", player_msg->slot(), player_msg->velocity());
 
-				ball_vx = BALL_INITIAL_SPEED;
-				ball_vy = BALL_INITIAL_SPEED;
+			// Players only move their own paddle, the seat comes from the
+			// room they're in rather than the message.
+			auto* player = get_player(packet->get_client_id());
+			if (!player) {
+				server.get_logger()->error("Player moved from client {} outside of a room", packet->get_client_id());
+				return;
+			}
 
-				bs::Packet start_packet = server.create_game_starting(player_1.x, player_1.y, player_2.x, player_2.y, ball_x, ball_y, ball_vx, ball_vy);
-				server.get_host_type()->broadcast_to_clients(start_packet, true);
+			// Numbered inputs are applied once and in order, a stale one is
+			// already part of the state the client predicted from.
+			const auto sequence = player_msg->sequence();
+			if (sequence == bs::NO_INPUT || sequence > player->last_input) {
+				move_player(*player, player_msg->velocity());
+				player->last_input = std::max(player->last_input, sequence);
+				set_view(*player, player_msg->view_time_ms());
 			}
-		} break;
+			}),
 
-		case Game::Any_PlayerMoved: {
-			const auto* player_msg = message->payload_as_PlayerMoved();
-			const auto slot = player_msg->slot();
+		on<Game::PlayerInputs>([&](const Game::PlayerInputs* inputs_msg, const bs::Packet* packet) {
+			auto* player = get_player(packet->get_client_id());
+			if (!player || !inputs_msg->velocities()) {
+				server.get_logger()->error("Invalid player inputs from client {}", packet->get_client_id());
+				return;
+			}
 
-			server.get_logger()->trace("Player moved receieved for {}: Vel: {}", slot, player_msg->velocity());
+			// Every packet repeats inputs earlier ones carried, only those
+			// newer than the last applied count. A gap means an input was
+			// lost in more packets in a row than the client repeats it for,
+			// it's skipped rather than holding up the rest.
+			bs::input_seq sequence = inputs_msg->first_sequence();
+			bool applied = false;
+			for (const int8_t velocity : *inputs_msg->velocities()) {
+				if (sequence > player->last_input) {
+					move_player(*player, velocity);
+					player->last_input = sequence;
+					applied = true;
+				}
+				sequence++;
+			}
 
-			if (slot >= 0 && slot < std::size(players)) {
-				auto& player = players[slot];
-				player.y += player_msg->velocity();
+			// Only the packet with the newest inputs says what the player
+			// sees now, older ones arrived late.
+			if (applied) {
+				set_view(*player, inputs_msg->view_time_ms());
 			}
-			else {
-				server.get_logger()->error("Invalid player slot: {}", slot);
+			}),
+
+		on<Game::RollbackInputs>([&](const Game::RollbackInputs*, const bs::Packet* packet) {
+			relay_to_opponent(packet, bs::CHANNEL_UNRELIABLE);
+			}),
+
+		on<Game::RollbackChecksum>([&](const Game::RollbackChecksum*, const bs::Packet* packet) {
+			relay_to_opponent(packet, bs::CHANNEL_RELIABLE);
+			}),
+
+		on<Game::TickAck>([&](const Game::TickAck* ack_msg, const bs::Packet* packet) {
+			const auto* room = rooms.get(rooms.get_room_id(packet->get_client_id()));
+
+			// Acks arrive unreliably and may be out of order, only move forward.
+			if (auto* player = get_player(packet->get_client_id()); player && ack_msg->sequence() <= room->snapshot_sequence) {
+				player->acked_snapshot = std::max(player->acked_snapshot, ack_msg->sequence());
 			}
-			break;
-		}
+			}),
 
-		default:
-			server.get_logger()->error("Unknown message type");
-		}
-		});
+		// Only ever sent by the server.
+		unexpected<Game::ClientConnectedResponse, Game::ClientDisconnected, Game::ClientReadyResponse, Game::GameStarting, Game::Tick, Game::TickDelta>());
 
-	InitWindow(300, 300, "PongServer");
+	bs::Job_System jobs(workers);
+	logger->info("Stepping rooms on {} threads ({})", jobs.get_thread_count(), PONG_SIMD_NAME);
 
-	// NOTE(DC): This will also control the server's tick rate.
-	SetTargetFPS(60);
+	// Scratch space for each thread's piece of the rooms.
+	std::vector<Pong_Batch> batches(jobs.get_thread_count());
 
-	while (!WindowShouldClose()) {
+	// The scheduler paces the simulation, the window (if any) is only a view
+	// of it and is drawn between ticks.
+	bs::Tick_Scheduler scheduler({ .tick_rate = TICKS_PER_SECOND }, logger);
+
+	auto step = [&](uint64_t tick) {
+		current_tick = tick;
 		server.tick(0);
 
-		if (gameState == PLAYING) {
-			// Send out the game state to all the clients.
-			bs::Packet tick_packet = server.create_tick(players[0].x, players[0].y, players[1].x, players[1].y, ball_x, ball_y, ball_vx, ball_vy, players[0].score, players[1].score);
-			server.get_host_type()->broadcast_to_clients(tick_packet, true);
+		// Rooms are independent, step them all at once. Everything network
+		// stays on this thread, the jobs only touch their own rooms. Rollback
+		// matches are run by their clients.
+		const bool send = !rollback && tick % send_interval == 0;
+		jobs.parallel_for(rollback ? 0 : rooms.size(), ROOMS_PER_JOB, [&](size_t begin, size_t end) {
+			// Rooms live apart on the heap, copy this piece's matches in to
+			// the thread's batch, step them side by side and copy them back.
+			auto& batch = batches[bs::Job_System::get_thread_index()];
+			batch.resize(end - begin);
+
+			size_t count = 0;
+			for (size_t i = begin; i < end; ++i) {
+				auto& room = rooms.get_at(i);
+				if (room.state != PLAYING) {
+					continue;
+				}
+
+				if (send) {
+					encode_snapshots(room);
+				}
+
+				if (tick != bs::NO_TICK) {
+					auto& frame = room.history.record(tick);
+					frame.ball_x = room.ball_x;
+					frame.ball_y = room.ball_y;
+					frame.ball_vx = room.ball_vx;
+					frame.ball_vy = room.ball_vy;
+					frame.score[0] = room.players[0].score;
+					frame.score[1] = room.players[1].score;
+				}
+
+				for (int p = 0; p < 2; ++p) {
+					batch.paddle_x[p][count] = room.players[p].x;
+					batch.paddle_y[p][count] = room.players[p].y;
+					batch.score[p][count] = room.players[p].score;
+				}
+				batch.ball_x[count] = room.ball_x;
+				batch.ball_y[count] = room.ball_y;
+				batch.ball_vx[count] = room.ball_vx;
+				batch.ball_vy[count] = room.ball_vy;
+				count++;
+			}
+
+			step_batch(batch, 0, count);
+
+			count = 0;
+			for (size_t i = begin; i < end; ++i) {
+				auto& room = rooms.get_at(i);
+				if (room.state != PLAYING) {
+					continue;
+				}
+
+				for (int p = 0; p < 2; ++p) {
+					room.players[p].y = batch.paddle_y[p][count];
+					room.players[p].score = batch.score[p][count];
+				}
+				room.ball_x = batch.ball_x[count];
+				room.ball_y = batch.ball_y[count];
+				room.ball_vx = batch.ball_vx[count];
+				room.ball_vy = batch.ball_vy[count];
+				count++;
+
+				compensate(room, tick);
+			}
+			});
+
+		if (send) {
+			rooms.for_each([&](bs::room_id, Pong_Room& room) {
+				if (room.state == PLAYING) {
+					send_snapshots(room, tick);
+				}
+				});
 		}
 
-		BeginDrawing();
+		// Everything for this tick has been sent, get it out now rather
+		// than on the next tick.
+		server->flush();
 
-		int y = 0;
-		int x = 10;
-		for (auto& player : players) {
-			DrawText(TextFormat("Player %d: %s", player.id, player.ready ? "Ready" : "Not Ready"), x, y += 20, 10, WHITE);
+		if (metrics_path && tick % TICKS_PER_SECOND == 0) {
+			if (!server->get_metrics().write_file(metrics_path, metrics_format)) {
+				logger->warn("Failed to write metrics to {}", metrics_path);
+			}
 		}
 
-		if (players[0].ready && players[1].ready) {
-			DrawText("All players ready, starting game", x, y += 20, 10, WHITE);
+		if (tick % (TICKS_PER_SECOND * 10) == 0) {
+			scheduler.log_stats();
+		}
+	};
+
+	if (replay_path) {
+		bs::Packet_Replayer replayer(recording, loopback, SAMPLES_HOST, SAMPLES_PORT, server->get_channels(), logger);
+		logger->info("Replaying {} packets over {} ticks from {}", recording.get_record_count(), recording.get_last_tick(), replay_path);
+
+		// Each record goes in just before the host tick it arrived on, the
+		// same tick the server steps here. Keep going a little past the end
+		// so the last of it is handled.
+		const auto start = std::chrono::steady_clock::now();
+		uint64_t tick = 0;
+		while (replayer.play_until(server->get_tick() + 1) || server->get_tick() <= recording.get_last_tick() + TICKS_PER_SECOND) {
+			step(tick++);
 		}
+		const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const double recorded = (double)recording.get_duration_ns() / 1e9;
 
-		DrawText("Connected Clients:", x, y += 20, 10, WHITE);
+		logger->info("Replayed {} ticks in {:.3f}s, recorded over {:.3f}s ({:.1f}x)", tick, elapsed, recorded, elapsed > 0.0 ? recorded / elapsed : 0.0);
+		logger->info("Sent {} packets, {} dropped, {} received back", replayer.get_played_count(), replayer.get_dropped_count(), replayer.get_received_count());
+		return EXIT_SUCCESS;
+	}
 
-		auto connected_clients = server.get_host_type()->get_client_manager().get_connected_clients();
-		for (auto& client : connected_clients) {
-			DrawText(TextFormat("Client %d: %s", client->get_id(), client->get_state() == bs::Base_Client::CONNECTED ? "Connected" : "Disconnected"), x, y += 20, 10, WHITE);
-		}
+	if (headless) {
+		scheduler.run(step);
+		return EXIT_SUCCESS;
+	}
 
-		DrawText(TextFormat("Game State %s", GameStateToString(gameState)), x, y += 20, 10, WHITE);
-		switch (gameState) {
-		case DISCONNECTED:
-		case PLAYING: {
-			for (auto& player : players) {
-				DrawText(TextFormat("Player %d: Pos: %f, %f", player.id, player.x, player.y), x, y += 20, 10, WHITE);
-			}
-			DrawText(TextFormat("Ball: Pos: %.2f, %.2f", ball_x, ball_y), x, y += 20, 10, WHITE);
-			DrawText(TextFormat("Ball: Vel: %.2f, %f Vel: %.2f, %f", ball_vx, ball_vy), x, y += 20, 10, WHITE);
+	InitWindow(300, 300, "PongServer");
+
+	while (!WindowShouldClose()) {
+		scheduler.advance(step);
+
+		BeginDrawing();
+
+		int y = 0;
+		int x = 10;
 
-			if (gameState != DISCONNECTED) {
-				game_state_tick(players, ball_x, ball_y, ball_vx, ball_vy);
+		auto& client_manager = server.get_host_type()->get_client_manager();
+		DrawText(TextFormat("Connected Clients: %d / %d", (int)client_manager.size(), (int)client_manager.capacity()), x, y += 20, 10, WHITE);
+
+		// Too many matches to list, count them by state instead.
+		int room_counts[DISCONNECTED + 1] = {};
+		rooms.for_each([&](bs::room_id, Pong_Room& room) {
+			room_counts[room.state]++;
+			});
+
+		DrawText(TextFormat("Rooms: %d", (int)rooms.size()), x, y += 20, 10, WHITE);
+		for (int state = WAITING; state <= DISCONNECTED; ++state) {
+			auto game_state = (Game_State)state;
+			if (room_counts[state] > 0) {
+				DrawText(TextFormat("  %s: %d", GameStateToString(game_state), room_counts[state]), x, y += 20, 10, WHITE);
 			}
-			break;
-		}
 		}
 
 		ClearBackground(BLACK);
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PONG_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PONG_SIMD_SSE2 1
+#endif
+
+#include "config.h"
+
+// Pong's rules for one tick. step_match() runs a single match and is the
+// reference, Pong_Batch steps many matches stored as structure of arrays
+// several at a time with SSE2 or AVX2 (build with BS_ENABLE_AVX2). Every
+// path does the same float operations in the same order, only adds,
+// multiplies and compares, so they agree bit for bit.
+//
+// Each tick the paddles are clamped to the court, the ball moves once,
+// bounces off the top and bottom, and a ball leaving either side scores
+// and is served again from the middle. Touching a paddle sends it back
+// the other way a little faster.
+
+#define BALL_SERVE_SPEED 2.0f
+#define BALL_PADDLE_BOUNCE -1.08f
+
+// Same test as raylib's CheckCollisionRecs.
+inline bool ball_hits_paddle(float ball_x, float ball_y, float paddle_x, float paddle_y) {
+	return ball_x < paddle_x + (float)PLAYER_WIDTH && ball_x + (float)BALL_WIDTH > paddle_x
+		&& ball_y < paddle_y + (float)PLAYER_HEIGHT && ball_y + (float)BALL_WIDTH > paddle_y;
+}
+
+inline void step_match(float p1_x, float& p1_y, float p2_x, float& p2_y, int& p1_score, int& p2_score, float& ball_x, float& ball_y, float& ball_vx, float& ball_vy) {
+	auto clamp_paddle = [](float& y) {
+		if (y < 0.0f) {
+			y = 0.0f;
+		}
+		if (y + (float)PLAYER_HEIGHT > (float)HEIGHT) {
+			y = (float)(HEIGHT - PLAYER_HEIGHT);
+		}
+		};
+
+	clamp_paddle(p1_y);
+	clamp_paddle(p2_y);
+
+	ball_x += ball_vx;
+	ball_y += ball_vy;
+
+	if (ball_y < 0.0f) {
+		ball_vy *= -1.0f;
+	}
+	if (ball_y + (float)BALL_WIDTH > (float)HEIGHT) {
+		ball_vy *= -1.0f;
+	}
+
+	const bool left = ball_x < 0.0f;
+	const bool right = ball_x + (float)BALL_WIDTH > (float)WIDTH;
+	if (left || right) {
+		if (left) {
+			p2_score++;
+		}
+		else {
+			p1_score++;
+		}
+		ball_x = (float)WIDTH / 2.0f;
+		ball_y = (float)HEIGHT / 2.0f;
+		ball_vx = BALL_SERVE_SPEED;
+	}
+
+	if (ball_hits_paddle(ball_x, ball_y, p1_x, p1_y)) {
+		ball_vx *= BALL_PADDLE_BOUNCE;
+	}
+	if (ball_hits_paddle(ball_x, ball_y, p2_x, p2_y)) {
+		ball_vx *= BALL_PADDLE_BOUNCE;
+	}
+}
+
+// A whole match in one block, for keeping copies of it, e.g. for rollback.
+// No padding so its bytes can be checksummed.
+struct Pong_Match {
+	float paddle_x[2] = {};
+	float paddle_y[2] = {};
+	int score[2] = {};
+	float ball_x = 0.0f;
+	float ball_y = 0.0f;
+	float ball_vx = 0.0f;
+	float ball_vy = 0.0f;
+};
+
+// A frame driven by both players' inputs, the paddles move the same way
+// as move_player() and then the rules run.
+inline void step_match(Pong_Match& match, const int velocities[2]) {
+	for (int p = 0; p < 2; ++p) {
+		match.paddle_y[p] = std::clamp(match.paddle_y[p] + (float)velocities[p], 0.0f, (float)(HEIGHT - PLAYER_HEIGHT));
+	}
+	step_match(match.paddle_x[0], match.paddle_y[0], match.paddle_x[1], match.paddle_y[1], match.score[0], match.score[1], match.ball_x, match.ball_y, match.ball_vx, match.ball_vy);
+}
+
+template <typename Players>
+inline void game_state_tick(Players& players, float& ball_x, float& ball_y, float& ball_vx, float& ball_vy) {
+	step_match(players[0].x, players[0].y, players[1].x, players[1].y, players[0].score, players[1].score, ball_x, ball_y, ball_vx, ball_vy);
+}
+
+// Matches side by side, one array per field. Lanes are independent, step
+// any range of them from any thread.
+struct Pong_Batch {
+	std::vector<float> paddle_x[2];
+	std::vector<float> paddle_y[2];
+	std::vector<int32_t> score[2];
+	std::vector<float> ball_x;
+	std::vector<float> ball_y;
+	std::vector<float> ball_vx;
+	std::vector<float> ball_vy;
+
+	void resize(size_t count) {
+		for (int i = 0; i < 2; ++i) {
+			paddle_x[i].resize(count);
+			paddle_y[i].resize(count);
+			score[i].resize(count);
+		}
+		ball_x.resize(count);
+		ball_y.resize(count);
+		ball_vx.resize(count);
+		ball_vy.resize(count);
+	}
+
+	size_t size() const { return ball_x.size(); }
+};
+
+inline void step_batch_scalar(Pong_Batch& batch, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		step_match(batch.paddle_x[0][i], batch.paddle_y[0][i], batch.paddle_x[1][i], batch.paddle_y[1][i], batch.score[0][i], batch.score[1][i],
+			batch.ball_x[i], batch.ball_y[i], batch.ball_vx[i], batch.ball_vy[i]);
+	}
+}
+
+// The handful of operations the kernel needs, per instruction set. Masks
+// are all ones in lanes where a compare held.
+#if defined(PONG_SIMD_AVX2)
+struct Pong_Simd {
+	using f = __m256;
+	using i = __m256i;
+	static constexpr size_t LANES = 8;
+	static constexpr const char* NAME = "AVX2";
+
+	static f load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, f v) { _mm256_storeu_ps(p, v); }
+	static i load(const int32_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static void store(int32_t* p, i v) { _mm256_storeu_si256((__m256i*)p, v); }
+	static f set(float v) { return _mm256_set1_ps(v); }
+	static f add(f a, f b) { return _mm256_add_ps(a, b); }
+	static f mul(f a, f b) { return _mm256_mul_ps(a, b); }
+	static f lt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static f gt(f a, f b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static f both(f a, f b) { return _mm256_and_ps(a, b); }
+	static f either(f a, f b) { return _mm256_or_ps(a, b); }
+	static f and_not(f a, f b) { return _mm256_andnot_ps(a, b); }
+	static f select(f mask, f a, f b) { return _mm256_blendv_ps(b, a, mask); }
+	// A set mask is -1, subtracting it counts one.
+	static i count(i v, f mask) { return _mm256_sub_epi32(v, _mm256_castps_si256(mask)); }
+};
+#elif defined(PONG_SIMD_SSE2)
+struct Pong_Simd {
+	using f = __m128;
+	using i = __m128i;
+	static constexpr size_t LANES = 4;
+	static constexpr const char* NAME = "SSE2";
+
+	static f load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, f v) { _mm_storeu_ps(p, v); }
+	static i load(const int32_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+	static void store(int32_t* p, i v) { _mm_storeu_si128((__m128i*)p, v); }
+	static f set(float v) { return _mm_set1_ps(v); }
+	static f add(f a, f b) { return _mm_add_ps(a, b); }
+	static f mul(f a, f b) { return _mm_mul_ps(a, b); }
+	static f lt(f a, f b) { return _mm_cmplt_ps(a, b); }
+	static f gt(f a, f b) { return _mm_cmpgt_ps(a, b); }
+	static f both(f a, f b) { return _mm_and_ps(a, b); }
+	static f either(f a, f b) { return _mm_or_ps(a, b); }
+	static f and_not(f a, f b) { return _mm_andnot_ps(a, b); }
+	// No blend before SSE4.1.
+	static f select(f mask, f a, f b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	static i count(i v, f mask) { return _mm_sub_epi32(v, _mm_castps_si128(mask)); }
+};
+#endif
+
+#if defined(PONG_SIMD_AVX2) || defined(PONG_SIMD_SSE2)
+// step_match() a vector of matches at a time, end - begin must be a
+// multiple of the width.
+inline void step_batch_simd(Pong_Batch& batch, size_t begin, size_t end) {
+	using S = Pong_Simd;
+
+	const S::f zero = S::set(0.0f);
+	const S::f height = S::set((float)HEIGHT);
+	const S::f width = S::set((float)WIDTH);
+	const S::f paddle_width = S::set((float)PLAYER_WIDTH);
+	const S::f paddle_height = S::set((float)PLAYER_HEIGHT);
+	const S::f paddle_max = S::set((float)(HEIGHT - PLAYER_HEIGHT));
+	const S::f ball_size = S::set((float)BALL_WIDTH);
+	const S::f flip = S::set(-1.0f);
+	const S::f bounce = S::set(BALL_PADDLE_BOUNCE);
+	const S::f centre_x = S::set((float)WIDTH / 2.0f);
+	const S::f centre_y = S::set((float)HEIGHT / 2.0f);
+	const S::f serve = S::set(BALL_SERVE_SPEED);
+
+	for (size_t lane = begin; lane < end; lane += S::LANES) {
+		S::f paddle_x[2];
+		S::f paddle_y[2];
+		for (int p = 0; p < 2; ++p) {
+			paddle_x[p] = S::load(&batch.paddle_x[p][lane]);
+			S::f y = S::load(&batch.paddle_y[p][lane]);
+			y = S::select(S::lt(y, zero), zero, y);
+			y = S::select(S::gt(S::add(y, paddle_height), height), paddle_max, y);
+			S::store(&batch.paddle_y[p][lane], y);
+			paddle_y[p] = y;
+		}
+
+		S::f vx = S::load(&batch.ball_vx[lane]);
+		S::f vy = S::load(&batch.ball_vy[lane]);
+		S::f x = S::add(S::load(&batch.ball_x[lane]), vx);
+		S::f y = S::add(S::load(&batch.ball_y[lane]), vy);
+
+		vy = S::select(S::lt(y, zero), S::mul(vy, flip), vy);
+		vy = S::select(S::gt(S::add(y, ball_size), height), S::mul(vy, flip), vy);
+
+		const S::f left = S::lt(x, zero);
+		const S::f right = S::gt(S::add(x, ball_size), width);
+		const S::f scored = S::either(left, right);
+		S::store(&batch.score[1][lane], S::count(S::load(&batch.score[1][lane]), left));
+		S::store(&batch.score[0][lane], S::count(S::load(&batch.score[0][lane]), S::and_not(left, right)));
+		x = S::select(scored, centre_x, x);
+		y = S::select(scored, centre_y, y);
+		vx = S::select(scored, serve, vx);
+
+		for (int p = 0; p < 2; ++p) {
+			const S::f hit = S::both(
+				S::both(S::lt(x, S::add(paddle_x[p], paddle_width)), S::gt(S::add(x, ball_size), paddle_x[p])),
+				S::both(S::lt(y, S::add(paddle_y[p], paddle_height)), S::gt(S::add(y, ball_size), paddle_y[p])));
+			vx = S::select(hit, S::mul(vx, bounce), vx);
+		}
+
+		S::store(&batch.ball_x[lane], x);
+		S::store(&batch.ball_y[lane], y);
+		S::store(&batch.ball_vx[lane], vx);
+		S::store(&batch.ball_vy[lane], vy);
+	}
+}
+
+inline constexpr const char* PONG_SIMD_NAME = Pong_Simd::NAME;
+#else
+inline constexpr const char* PONG_SIMD_NAME = "scalar";
+#endif
+
+// Steps lanes [begin, end) with the widest instructions the build has and
+// the scalar path for whatever's left over.
+inline void step_batch(Pong_Batch& batch, size_t begin, size_t end) {
+#if defined(PONG_SIMD_AVX2) || defined(PONG_SIMD_SSE2)
+	const size_t vector_end = begin + (end - begin) / Pong_Simd::LANES * Pong_Simd::LANES;
+	step_batch_simd(batch, begin, vector_end);
+	begin = vector_end;
+#endif
+	step_batch_scalar(batch, begin, end);
+}
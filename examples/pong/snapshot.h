@@ -0,0 +1,80 @@
+#pragma once
+
+#include <bs/snapshot.h>
+
+#include "config.h"
+
+// Quantized pong world state replicated to clients each tick. Positions
+// are kept to roughly 1/15th of a pixel and velocities to 1/256th, the
+// ranges leave some headroom for the ball leaving the screen before it's
+// reset.
+#define SNAPSHOT_POSITION_MIN -64.0f
+#define SNAPSHOT_POSITION_MAX (WIDTH + 64.0f)
+#define SNAPSHOT_POSITION_BITS 14
+#define SNAPSHOT_VELOCITY_MIN -128.0f
+#define SNAPSHOT_VELOCITY_MAX 128.0f
+#define SNAPSHOT_VELOCITY_BITS 16
+#define SNAPSHOT_SCORE_BITS 16
+
+// Snapshots the server keeps and the client remembers. At 60 ticks a
+// second this is about a second of history to delta against.
+#define SNAPSHOT_HISTORY 64
+
+struct Pong_Snapshot {
+	uint32_t player_x[2] = {};
+	uint32_t player_y[2] = {};
+	uint32_t score[2] = {};
+	uint32_t ball_x = 0;
+	uint32_t ball_y = 0;
+	uint32_t ball_vx = 0;
+	uint32_t ball_vy = 0;
+};
+
+using Pong_Snapshot_Buffer = bs::Snapshot_Buffer<Pong_Snapshot, SNAPSHOT_HISTORY>;
+
+inline uint32_t snapshot_position(float value) {
+	return bs::quantize(value, SNAPSHOT_POSITION_MIN, SNAPSHOT_POSITION_MAX, SNAPSHOT_POSITION_BITS);
+}
+
+inline float snapshot_position(uint32_t value) {
+	return bs::dequantize(value, SNAPSHOT_POSITION_MIN, SNAPSHOT_POSITION_MAX, SNAPSHOT_POSITION_BITS);
+}
+
+inline uint32_t snapshot_velocity(float value) {
+	return bs::quantize(value, SNAPSHOT_VELOCITY_MIN, SNAPSHOT_VELOCITY_MAX, SNAPSHOT_VELOCITY_BITS);
+}
+
+inline float snapshot_velocity(uint32_t value) {
+	return bs::dequantize(value, SNAPSHOT_VELOCITY_MIN, SNAPSHOT_VELOCITY_MAX, SNAPSHOT_VELOCITY_BITS);
+}
+
+// Each field is a changed bit followed by its value if it differs from
+// the baseline. Fields that hold still cost a single bit.
+inline void encode_snapshot(bs::Bit_Writer& writer, const Pong_Snapshot& baseline, const Pong_Snapshot& snapshot) {
+	for (int i = 0; i < 2; ++i) {
+		writer.write_delta(baseline.player_x[i], snapshot.player_x[i], SNAPSHOT_POSITION_BITS);
+		writer.write_delta(baseline.player_y[i], snapshot.player_y[i], SNAPSHOT_POSITION_BITS);
+		writer.write_delta(baseline.score[i], snapshot.score[i], SNAPSHOT_SCORE_BITS);
+	}
+
+	writer.write_delta(baseline.ball_x, snapshot.ball_x, SNAPSHOT_POSITION_BITS);
+	writer.write_delta(baseline.ball_y, snapshot.ball_y, SNAPSHOT_POSITION_BITS);
+	writer.write_delta(baseline.ball_vx, snapshot.ball_vx, SNAPSHOT_VELOCITY_BITS);
+	writer.write_delta(baseline.ball_vy, snapshot.ball_vy, SNAPSHOT_VELOCITY_BITS);
+}
+
+// Returns false if the data was truncated.
+inline bool decode_snapshot(bs::Bit_Reader& reader, const Pong_Snapshot& baseline, Pong_Snapshot& snapshot) {
+	for (int i = 0; i < 2; ++i) {
+		snapshot.player_x[i] = reader.read_delta(baseline.player_x[i], SNAPSHOT_POSITION_BITS);
+		snapshot.player_y[i] = reader.read_delta(baseline.player_y[i], SNAPSHOT_POSITION_BITS);
+		snapshot.score[i] = reader.read_delta(baseline.score[i], SNAPSHOT_SCORE_BITS);
+	}
+
+	snapshot.ball_x = reader.read_delta(baseline.ball_x, SNAPSHOT_POSITION_BITS);
+	snapshot.ball_y = reader.read_delta(baseline.ball_y, SNAPSHOT_POSITION_BITS);
+	snapshot.ball_vx = reader.read_delta(baseline.ball_vx, SNAPSHOT_VELOCITY_BITS);
+	snapshot.ball_vy = reader.read_delta(baseline.ball_vy, SNAPSHOT_VELOCITY_BITS);
+
+	return !reader.overflowed();
+}
@@ -6,6 +6,8 @@
 #include "config.h"
 
 #include <bs/enet.h>
+#include <bs/link_conditioner.h>
+#include <bs/packet_allocator.h>
 #include <bs/server.h>
 
 // Base class for the Host_Client and Server to use. This class will
@@ -21,7 +23,9 @@ public:
 	using tick_cb_t = std::function<void(const Game::Message*, const bs::Packet* packet)>;
 	using connect_cb_t = std::function<void()>;
 
-	Game_Host(bs::logger_t logger, const char* host, int32_t port)
+	// The I/O mode only applies to servers. The transports default to real
+	// UDP sockets, pass a bs::Link_Conditioner to run over a simulated link.
+	Game_Host(bs::logger_t logger, const char* host, int32_t port, bs::Host_Server::Io_Mode io_mode = bs::Host_Server::IO_INLINE, bs::Transport_Factory& transports = bs::Transport_Factory::get_enet())
 		: m_enet(logger)
 		, m_host(host)
 		, m_port(port)
@@ -29,11 +33,11 @@ public:
 
 		// TODO(DC): Make the init/start api the same for both client and server.
 		if constexpr (std::is_same_v<Host_Type, bs::Host_Server>) {
-			m_host_type = m_enet.create_server(host, port, 32);
-			m_host_type->start();
+			m_host_type = m_enet.create_server(host, port, 32, transports);
+			m_host_type->start(io_mode);
 		}
 		else if constexpr (std::is_same_v<Host_Type, bs::Host_Client>) {
-			m_host_type = m_enet.create_host_client();
+			m_host_type = m_enet.create_host_client(transports);
 			m_host_type->start(host, port);
 		}
 
@@ -78,8 +82,8 @@ public:
 
 		auto& packets = m_host_type->get_packets();
 
-		while (!packets.empty()) {
-			auto packet = packets.pop_front();
+		// Hand the whole batch over in arrival order.
+		packets.drain([&](bs::Packet& packet) {
 			switch (packet.get_type()) {
 			case bs::Packet::CONNECT:
 				if (m_connect_callback)
@@ -92,7 +96,8 @@ public:
 
 			case bs::Packet::EVENT_RECIEVED:
 				if (m_tick_callback) {
-					auto packet_bytes = packet.get_bytes();
+					// View straight into the received ENet packet, no copy.
+					const auto packet_bytes = packet.get_bytes();
 
 					flatbuffers::Verifier verifier(packet_bytes.data(), packet_bytes.size());
 					if (!Game::VerifyMessageBuffer(verifier)) {
@@ -108,7 +113,7 @@ public:
 			default:
 				m_host_type->get_logger()->error("Unknown packet type: {}", (int)packet.get_type());
 			}
-		}
+			});
 	}
 
 	bs::Packet create_client_connect_request() {
@@ -156,17 +161,20 @@ public:
 	}
 
 private:
+	// The builder serializes straight in to a pooled block which becomes the
+	// packet's payload, nothing is copied on the way to ENet.
 	bs::Packet create_packet_from_builder() {
 		// TODO(DC): Make the init/start api the same for both client and server.
 		if constexpr (std::is_same_v<Host_Type, bs::Host_Server>) {
-			return std::move(bs::Packet(NULL, m_builder.GetBufferPointer(), m_builder.GetSize()));
+			return m_allocator.release_packet(m_builder, NULL);
 		}
 		else if constexpr (std::is_same_v<Host_Type, bs::Host_Client>) {
-			return std::move(bs::Packet(m_host_type->get_peer(), m_builder.GetBufferPointer(), m_builder.GetSize()));
+			return m_allocator.release_packet(m_builder, m_host_type->get_peer());
 		}
 	}
 
-	flatbuffers::FlatBufferBuilder m_builder;
+	bs::Packet_Allocator m_allocator;
+	flatbuffers::FlatBufferBuilder m_builder{ bs::Packet_Pool::BLOCK_SIZE, &m_allocator };
 	bs::ENet m_enet;
 
 	const char* m_host = nullptr;
@@ -3,6 +3,7 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <string_view>
 #include <thread>
 
 #include "game_messages_generated.h"
@@ -10,16 +11,29 @@
 #include "config.h"
 #include "base_game_host.h"
 
-int main() {
-	Game_Host<bs::Host_Client> client(
-		spdlog::stdout_color_mt("CLIENT"),
-		SAMPLES_HOST, SAMPLES_PORT);
+int main(int argc, char** argv) {
+	auto logger = spdlog::stdout_color_mt("CLIENT");
+
+	// Pass --netsim <profile> to run over a simulated link, see bs::Link_Script.
+	bs::Link_Script netsim;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string_view(argv[i]) == "--netsim" && i + 1 < argc) {
+			std::string error;
+			if (!bs::Link_Script::parse(argv[++i], netsim, error)) {
+				logger->error("{}", error);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	bs::Link_Conditioner conditioner(bs::Transport_Factory::get_enet(), netsim);
+	Game_Host<bs::Host_Client> client(logger, SAMPLES_HOST, SAMPLES_PORT, bs::Host_Server::IO_INLINE, conditioner);
 
 	client.set_connect_callback([&] {
 		// When we connect send over a connection request so we
 		// can get our client id and store it. We shouldn't 
 		// continue until we do so.
-		client.create_client_connect_request().send(true);
+		client->broadcast_to_server(client.create_client_connect_request(), true);
 		});
 
 	client.set_disconnect_callback([&] {
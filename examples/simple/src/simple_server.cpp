@@ -1,20 +1,47 @@
 #include <bs/server.h>
+#include <bs/tick_scheduler.h>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <thread>
+#include <string_view>
 
 #include "game_messages_generated.h"
 
 #include "config.h"
 #include "base_game_host.h"
 
-int main() {
+int main(int argc, char** argv) {
 	auto logger = spdlog::stdout_color_mt("SERVER");
 
-	auto server = Game_Host<bs::Host_Server>(logger, SAMPLES_HOST, SAMPLES_PORT);
+	// Pass --threaded-io to service the network on its own thread,
+	// --tick-rate <hz> to change how often the server ticks and
+	// --netsim <profile> to run over a simulated link, see bs::Link_Script.
+	auto io_mode = bs::Host_Server::IO_INLINE;
+	bs::Tick_Scheduler::Config tick_config;
+	bs::Link_Script netsim;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string_view(argv[i]) == "--threaded-io") {
+			io_mode = bs::Host_Server::IO_THREADED;
+		}
+		else if (std::string_view(argv[i]) == "--tick-rate" && i + 1 < argc) {
+			tick_config.tick_rate = (uint32_t)std::max(1, std::atoi(argv[++i]));
+		}
+		else if (std::string_view(argv[i]) == "--netsim" && i + 1 < argc) {
+			std::string error;
+			if (!bs::Link_Script::parse(argv[++i], netsim, error)) {
+				logger->error("{}", error);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	bs::Link_Conditioner conditioner(bs::Transport_Factory::get_enet(), netsim);
+	auto server = Game_Host<bs::Host_Server>(logger, SAMPLES_HOST, SAMPLES_PORT, io_mode, conditioner);
 
 	server.set_tick_callback([&](const Game::Message* message, const bs::Packet* packet) {
 		auto type = message->payload_type();
@@ -23,11 +50,16 @@ int main() {
 		case Game::Any_ClientConnectedRequest: {
 			const auto* client_msg = message->payload_as_ClientConnectedRequest();
 
-			auto client = server.get_host_type()->get_client_manager().get_client(packet->get_peer());
+			// By id, not peer, the client may have disconnected (and its peer been
+			// reused) in the same tick it asked to connect.
+			auto client = server.get_host_type()->get_client_manager().get_client(packet->get_client_id());
+			if (!client) {
+				break;
+			}
 
 			bs::Packet packet = server.create_client_connect_response(client->get_id());
 			packet.set_peer(client->get_peer());
-			packet.send(true);
+			server->send(packet, true);
 			break;
 		}
 
@@ -44,9 +76,14 @@ int main() {
 		}
 		});
 
-	while (1) {
+	bs::Tick_Scheduler scheduler(tick_config, logger);
+	scheduler.run([&](uint64_t tick) {
 		server.tick();
-	}
+
+		if (tick % (tick_config.tick_rate * 10) == 0) {
+			scheduler.log_stats();
+		}
+		});
 
 	return EXIT_SUCCESS;
 }